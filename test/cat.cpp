@@ -60,7 +60,10 @@ static tpie::stream_header_t get_stream_header(const std::string & path) {
 	tpie::stream_header_t res;
 	int fd = ::open(path.c_str(), O_RDONLY);
 	if (fd == -1) throw_errno();
-	if (::read(fd, &res, sizeof(res)) != sizeof(res)) throw_errno();
+	// Version 3 headers end before the compression field.
+	const ssize_t minimum = static_cast<ssize_t>(
+		tpie::stream_header_t::size_on_disk(tpie::stream_header_t::uncompressedVersionConst));
+	if (::read(fd, &res, sizeof(res)) < minimum) throw_errno();
 	::close(fd);
 	return res;
 }
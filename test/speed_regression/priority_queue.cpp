@@ -39,7 +39,9 @@ using namespace tpie::test;
 const size_t mb_default=1;
 
 void usage() {
-	std::cout << "Parameters: [times] [mb]" << std::endl;
+	std::cout << "Parameters: [-s] [-q] [times] [mb] [block factor]\n"
+			  << "  -s  Use 64-bit integers rather than segments\n"
+			  << "  -q  Use pq_sequence_heap as the overflow heap" << std::endl;
 }
 
 struct intgenerator {
@@ -60,7 +62,7 @@ struct segmentgenerator {
 	inline void use(item_type & a, item_type & x) { a.first += x.second.first; }
 };
 
-template <typename Generator>
+template <typename OPQType, typename Generator>
 void test(Generator g, size_t mb, size_t times, float blockFactor = 0.125f) {
 	typedef typename Generator::item_type test_t;
 	test_t a = test_t();
@@ -78,7 +80,7 @@ void test(Generator g, size_t mb, size_t times, float blockFactor = 0.125f) {
 		test_realtime_t end;
 		getTestRealtime(start);
 		{
-			tpie::ami::priority_queue<test_t> pq(0.95f, blockFactor);
+			tpie::ami::priority_queue<test_t, std::less<test_t>, OPQType> pq(0.95f, blockFactor);
 		
 			for(TPIE_OS_OFFSET i=0; i < count; ++i) {
 				test_t x = g();
@@ -105,12 +107,15 @@ int main(int argc, char **argv) {
 	size_t mb = mb_default;
 	float blockFactor = 0.125;
 	bool segments = false;
+	bool sequenceHeap = false;
 
 	int i;
 	for (i = 1; i < argc; ++i) {
 		std::string arg(argv[i]);
 		if (arg == "-s") {
 			segments = true;
+		} else if (arg == "-q") {
+			sequenceHeap = true;
 		} else {
 			break;
 		}
@@ -145,12 +150,19 @@ int main(int argc, char **argv) {
 
 	testinfo t("Priority queue speed test", 1024, mb, times);
 	sysinfo().printinfo("Block factor", blockFactor);
+	sysinfo().printinfo("Overflow heap", sequenceHeap ? "pq_sequence_heap" : "pq_overflow_heap");
 	if (segments) {
 		sysinfo().printinfo("Item type", "segments");
-		::test(intgenerator(), mb, times, blockFactor);
+		if (sequenceHeap)
+			::test<pq_sequence_heap<intgenerator::item_type> >(intgenerator(), mb, times, blockFactor);
+		else
+			::test<pq_overflow_heap<intgenerator::item_type> >(intgenerator(), mb, times, blockFactor);
 	} else {
 		sysinfo().printinfo("Item type", "64-bit integers");
-		::test(segmentgenerator(), mb, times, blockFactor);
+		if (sequenceHeap)
+			::test<pq_sequence_heap<segmentgenerator::item_type> >(segmentgenerator(), mb, times, blockFactor);
+		else
+			::test<pq_overflow_heap<segmentgenerator::item_type> >(segmentgenerator(), mb, times, blockFactor);
 	}
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,116 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino=(0 :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+// Round trip tests of the block codecs.
+
+#include "common.h"
+#include <vector>
+#include <cstring>
+#include <boost/random.hpp>
+#include <tpie/compression.h>
+#include <tpie/exception.h>
+
+using namespace tpie;
+
+// Compress and decompress data, requiring the compressed size to be at most
+// maxRatio times the original size.
+bool round_trip(memory_size_type codecId, const std::vector<char> & data,
+				memory_size_type itemSize, double maxRatio) {
+	const block_codec * codec = get_block_codec(codecId);
+	if (codec == 0) {
+		log_error() << "Codec " << codecId << " is not registered" << std::endl;
+		return false;
+	}
+	std::vector<char> compressed(data.size() + 1);
+	memory_size_type size = codec->compress(&data[0], data.size(), itemSize,
+											&compressed[0], data.size() - 1);
+	log_debug() << data.size() << " bytes compressed to " << size << std::endl;
+	if (size == 0) {
+		if (maxRatio < 1.0) {
+			log_error() << "Data was not compressed" << std::endl;
+			return false;
+		}
+		return true;
+	}
+	if (size > maxRatio * data.size()) {
+		log_error() << "Compressed size " << size << " exceeds " << maxRatio << " of " << data.size() << std::endl;
+		return false;
+	}
+	std::vector<char> output(data.size());
+	codec->decompress(&compressed[0], size, itemSize, &output[0], output.size());
+	if (output != data) {
+		log_error() << "Decompressed data differs" << std::endl;
+		return false;
+	}
+	// Decompressing a truncated block must be detected.
+	try {
+		codec->decompress(&compressed[0], size - 1, itemSize, &output[0], output.size());
+		log_error() << "Truncated block was not detected" << std::endl;
+		return false;
+	} catch (io_exception &) {
+	}
+	return true;
+}
+
+bool codec_test(memory_size_type codecId, memory_size_type items) {
+	boost::mt19937 rng(42);
+
+	// Sorted 64-bit keys with small gaps.
+	std::vector<char> sorted(items * sizeof(uint64_t));
+	uint64_t key = 1000000007;
+	for (memory_size_type i = 0; i < items; ++i) {
+		key += rng() % 100;
+		std::memcpy(&sorted[i * sizeof(uint64_t)], &key, sizeof(key));
+	}
+	if (!round_trip(codecId, sorted, sizeof(uint64_t), 0.6)) return false;
+
+	// Records of a 12-byte key and a mostly constant payload.
+	std::vector<char> records(items * 12);
+	for (memory_size_type i = 0; i < items; ++i) {
+		uint32_t fields[3] = {static_cast<uint32_t>(i), static_cast<uint32_t>(i / 7), 0xdeadbeef};
+		std::memcpy(&records[i * 12], fields, 12);
+	}
+	if (!round_trip(codecId, records, 12, 0.6)) return false;
+
+	// Random bytes must either round trip or be left uncompressed.
+	std::vector<char> noise(items * 3);
+	for (memory_size_type i = 0; i < noise.size(); ++i) noise[i] = static_cast<char>(rng());
+	if (!round_trip(codecId, noise, 3, 1.0)) return false;
+
+	// Blocks too small to contain a match.
+	for (memory_size_type size = 1; size < 20; ++size) {
+		std::vector<char> tiny(size, 'x');
+		if (!round_trip(codecId, tiny, 1, 1.0)) return false;
+	}
+	return true;
+}
+
+bool lz4_test(memory_size_type items) {
+	return codec_test(compression_lz4, items);
+}
+
+bool delta_test(memory_size_type items) {
+	return codec_test(compression_delta, items);
+}
+
+int main(int argc, char **argv) {
+	return tests(argc, argv)
+		.test(lz4_test, "lz4", "n", static_cast<memory_size_type>(100000))
+		.test(delta_test, "delta", "n", static_cast<memory_size_type>(100000));
+}
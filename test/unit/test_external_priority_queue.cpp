@@ -19,6 +19,8 @@
 #include "common.h"
 #include <tpie/priority_queue.h>
 #include <vector>
+#include <iterator>
+#include <queue>
 #include "priority_queue.h"
 #include "../test_portability.h"
 
@@ -267,6 +269,77 @@ bool very_large_test() {
 	}
 }
 
+bool sequence_heap_test() {
+	get_memory_manager().set_limit(32*1024*1024);
+	{
+		// The overflow heap by itself, within its capacity.
+		const memory_size_type size = 100003;
+		pq_sequence_heap<boost::uint64_t, bit_pertume_compare<std::greater<boost::uint64_t> > > opq(size);
+		if (!basic_pq_test(opq, size-1)) return false;
+	}
+	ami::priority_queue<boost::uint64_t, bit_pertume_compare< std::greater<boost::uint64_t> >,
+		pq_sequence_heap<boost::uint64_t, bit_pertume_compare< std::greater<boost::uint64_t> > > >
+		pq(static_cast<memory_size_type>(8*1024*1024));
+#ifdef NDEBUG
+	const boost::uint64_t size = 350003;
+#else // DEBUG
+	const boost::uint64_t size = 350;
+#endif
+	return basic_pq_test(pq, size);
+}
+
+// Interleave batches of pushes and pops, mixed with single-item operations,
+// and compare with std::priority_queue.
+bool batch_test(memory_size_type mmAvail, stream_size_type batches) {
+	ami::priority_queue<boost::uint64_t, std::greater<boost::uint64_t> > pq(mmAvail);
+	std::priority_queue<boost::uint64_t> pq2;
+	boost::uint64_t x = 42;
+	std::vector<boost::uint64_t> in;
+	std::vector<boost::uint64_t> out;
+	for (stream_size_type i = 0; i < batches; ++i) {
+		in.resize(x % 5000);
+		for (size_t j = 0; j < in.size(); ++j) {
+			x = x * 6364136223846793005ull + 1442695040888963407ull;
+			in[j] = x >> 40;
+			pq2.push(in[j]);
+		}
+		pq.push_batch(in.begin(), in.end());
+		if (i % 3 == 0) {
+			x = x * 6364136223846793005ull + 1442695040888963407ull;
+			pq.push(x >> 40);
+			pq2.push(x >> 40);
+		}
+
+		out.clear();
+		memory_size_type n = static_cast<memory_size_type>((x >> 20) % 4000);
+		memory_size_type popped = pq.pop_batch(std::back_inserter(out), n);
+		for (size_t j = 0; j < out.size(); ++j) {
+			if (pq2.empty() || out[j] != pq2.top()) {
+				log_error() << "Batch " << i << " item " << j << " is " << out[j] << std::endl;
+				return false;
+			}
+			pq2.pop();
+		}
+		if (popped != out.size() || (popped < n && !pq2.empty())) {
+			log_error() << "Batch " << i << " popped " << popped << " of " << n << std::endl;
+			return false;
+		}
+		if (!pq.empty()) {
+			if (pq.top() != pq2.top()) {
+				log_error() << "Top is " << pq.top() << ", expected " << pq2.top() << std::endl;
+				return false;
+			}
+			pq.pop();
+			pq2.pop();
+		}
+		if (pq.size() != pq2.size()) {
+			log_error() << "Size is " << pq.size() << ", expected " << pq2.size() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 template <typename T>
 bool parameter_test(double kb, double blockSizeKB) {
 	float blockFact = file<T>::calculate_block_factor(static_cast<memory_size_type>(blockSizeKB*1024.0));
@@ -295,6 +368,10 @@ int main(int argc, char **argv) {
 		.test(memory_test, "memory")
 		.test(very_large_test<4294967311, uint64_t>, "very_large")
 		.test(overflow_test, "overflow")
+		.test(sequence_heap_test, "sequence_heap")
+		.test(batch_test, "batch",
+			  "mmavail", static_cast<memory_size_type>(8*1024*1024),
+			  "batches", static_cast<stream_size_type>(2000))
 		.test(parameter_test<uint64_t>, "parameters", "kb", 50000.0, "bs_kb", 128.0)
 		.test(remove_group_buffer_test<uint64_t>, "remove_group_buffer",
 			  "mmavail", static_cast<memory_size_type>(23552),
@@ -20,6 +20,8 @@
 #include <queue>
 #include <boost/filesystem.hpp>
 #include <tpie/queue.h>
+#include <tpie/buffered_queue.h>
+#include <tpie/stats.h>
 
 using namespace tpie;
 
@@ -33,9 +35,9 @@ std::ostream & debug = std::cout;
 std::ostream debug(0); // bit bucket
 #endif
 
-bool queue_test(const size_t elements = 2*1024*1024/sizeof(uint64_t)) {
+template <typename queue_t>
+bool queue_test(queue_t & q1, const size_t elements) {
 	const size_t maxpush = 64;
-	queue<uint64_t> q1;
 	std::queue<uint64_t> q2;
 
 	size_t i = 0;
@@ -84,8 +86,13 @@ bool queue_test(const size_t elements = 2*1024*1024/sizeof(uint64_t)) {
 	return true;
 }
 
+bool sized_test(size_t elements) {
+	queue<uint64_t> q;
+	return queue_test(q, elements);
+}
+
 bool basic_test() {
-	return queue_test();
+	return sized_test(2*1024*1024/sizeof(uint64_t));
 }
 
 bool named_test(uint64_t items) {
@@ -127,10 +134,78 @@ bool named_test(uint64_t items) {
 	return true;
 }
 
+bool buffered_test(size_t elements) {
+	// Small blocks and segments to exercise spilling and segment chaining.
+	buffered_queue<uint64_t> q(1.0/32, 4);
+	return queue_test(q, elements);
+}
+
+bool buffered_reclaim_test(size_t elements) {
+	// Keep about one segment in the queue while pushing many times as much.
+	const double blockFactor = 1.0/32;
+	const memory_size_type segmentBlocks = 4;
+	const size_t segmentItems = segmentBlocks * file_stream<uint64_t>::block_size(blockFactor) / sizeof(uint64_t);
+	buffered_queue<uint64_t> q(blockFactor, segmentBlocks);
+	stream_size_type baseUsage = get_temp_file_usage();
+	stream_size_type maxUsage = 0;
+	uint64_t popped = 0;
+	for (size_t i = 0; i < elements; ++i) {
+		q.push(i);
+		if (q.size() > segmentItems) {
+			if (q.pop() != popped++) {
+				log_error() << "Wrong item popped" << std::endl;
+				return false;
+			}
+		}
+		maxUsage = std::max(maxUsage, get_temp_file_usage() - baseUsage);
+	}
+	while (!q.empty()) {
+		if (q.pop() != popped++) {
+			log_error() << "Wrong item popped" << std::endl;
+			return false;
+		}
+	}
+	// At most the segment being read and the segment being written, with a
+	// segment to spare for file headers and partial blocks.
+	stream_size_type bound = 3 * segmentItems * sizeof(uint64_t);
+	log_debug() << "Maximum temp file usage " << maxUsage << ", bound " << bound << std::endl;
+	if (maxUsage > bound) {
+		log_error() << "Used " << maxUsage << " bytes of temp files, expected at most " << bound << std::endl;
+		return false;
+	}
+	if (get_temp_file_usage() != baseUsage) {
+		log_error() << "Temp files were not released" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool buffered_memory_test() {
+	// A queue shorter than a block never touches the disk.
+	buffered_queue<uint64_t> q;
+	stream_size_type baseUsage = get_temp_file_usage();
+	uint64_t popped = 0;
+	for (uint64_t i = 0; i < 1000000; ++i) {
+		q.push(i);
+		if (q.size() > 100 && q.pop() != popped++) {
+			log_error() << "Wrong item popped" << std::endl;
+			return false;
+		}
+		if (get_temp_file_usage() != baseUsage) {
+			log_error() << "Short queue used temp files" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	return tpie::tests(argc, argv, 32)
 		.test(basic_test, "basic")
-		.test(queue_test, "sized", "n", static_cast<size_t>(32*1024*1024/sizeof(uint64_t)))
+		.test(sized_test, "sized", "n", static_cast<size_t>(32*1024*1024/sizeof(uint64_t)))
+		.test(buffered_test, "buffered", "n", static_cast<size_t>(2*1024*1024/sizeof(uint64_t)))
+		.test(buffered_memory_test, "buffered_memory")
+		.test(buffered_reclaim_test, "buffered_reclaim", "n", static_cast<size_t>(8*1024*1024/sizeof(uint64_t)))
 		.test(named_test, "named", "n", static_cast<uint64_t>(32*1024*1024/sizeof(uint64_t)))
 		;
 }
@@ -0,0 +1,98 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino=(0 :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+// Block-level tests of the raw file accessors through stream_accessor.
+
+#include "common.h"
+#include <vector>
+#include <tpie/file_accessor/file_accessor.h>
+#include <tpie/file_accessor/posix.h>
+#ifdef TPIE_HAVE_LINUX_IO_URING_H
+#include <tpie/file_accessor/uring.h>
+#endif
+#include <tpie/tempname.h>
+
+using namespace tpie;
+
+template <typename raw_t>
+bool block_test(memory_size_type blocks) {
+	typedef file_accessor::stream_accessor<raw_t> accessor_t;
+	temp_file tmp;
+	const memory_size_type blockSize = get_block_size();
+	const memory_size_type blockItems = blockSize / sizeof(uint64_t);
+	const memory_size_type items = blocks * blockItems - blockItems / 3;
+	std::vector<uint64_t> buffer(blockItems);
+	{
+		accessor_t fa;
+		fa.open(tmp.path(), true, true, sizeof(uint64_t), blockSize, sizeof(uint64_t), access_sequential);
+		// Write the blocks in reverse order to exercise seeking past the end.
+		for (memory_size_type b = blocks; b--;) {
+			memory_size_type n = std::min<memory_size_type>(blockItems, items - b * blockItems);
+			for (memory_size_type i = 0; i < n; ++i) buffer[i] = b * blockItems + i;
+			fa.write_block(&buffer[0], b, n);
+		}
+		uint64_t userData = 42;
+		fa.write_user_data(&userData, sizeof(userData));
+		if (fa.size() != items) {
+			log_error() << "Wrong size " << fa.size() << " after writing " << items << " items" << std::endl;
+			return false;
+		}
+	}
+	accessor_t fa;
+	fa.open(tmp.path(), true, false, sizeof(uint64_t), blockSize, sizeof(uint64_t), access_random);
+	uint64_t userData = 0;
+	if (fa.read_user_data(&userData, sizeof(userData)) != sizeof(userData) || userData != 42) {
+		log_error() << "Wrong user data" << std::endl;
+		return false;
+	}
+	for (memory_size_type b = 0; b < blocks; ++b) {
+		memory_size_type n = fa.read_block(&buffer[0], b, blockItems);
+		if (n != std::min<memory_size_type>(blockItems, items - b * blockItems)) {
+			log_error() << "Wrong number of items read from block " << b << std::endl;
+			return false;
+		}
+		for (memory_size_type i = 0; i < n; ++i) {
+			if (buffer[i] != b * blockItems + i) {
+				log_error() << "Wrong item " << i << " in block " << b << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool posix_test(memory_size_type blocks) {
+	return block_test<file_accessor::posix>(blocks);
+}
+
+bool uring_test(memory_size_type blocks) {
+#ifdef TPIE_HAVE_LINUX_IO_URING_H
+	return block_test<file_accessor::uring>(blocks);
+#else
+	unused(blocks);
+	log_info() << "io_uring is not available on this platform" << std::endl;
+	return true;
+#endif
+}
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(posix_test, "posix", "blocks", static_cast<memory_size_type>(8))
+		.test(uring_test, "uring", "blocks", static_cast<memory_size_type>(8));
+}
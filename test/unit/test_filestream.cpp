@@ -69,8 +69,212 @@ bool memory(bool block_factor) {
 	return file_stream_memory_test(block_factor)();
 }
 
+bool async_test(size_t items) {
+	boost::filesystem::remove(TEMPFILE);
+	file_stream<size_t> fs;
+	fs.set_async_io(true);
+	fs.open(TEMPFILE);
+	for (size_t i = 0; i < items; ++i) fs.write(i);
+	fs.seek(0);
+	for (size_t i = 0; i < items; ++i) {
+		if (fs.read() != i) {
+			log_error() << "Wrong item read in forward scan at " << i << std::endl;
+			return false;
+		}
+	}
+	if (fs.can_read()) {
+		log_error() << "Could read past the end of the stream" << std::endl;
+		return false;
+	}
+	// Overwrite every other block's worth of items and append to the end.
+	size_t step = fs.block_items() * 2;
+	for (size_t i = 0; i < items; i += step) {
+		fs.seek(i);
+		fs.write(items + i);
+	}
+	fs.seek(0, file_stream<size_t>::end);
+	fs.write(items);
+	fs.seek(0);
+	for (size_t i = 0; i <= items; ++i) {
+		size_t expect = (i < items && i % step == 0) ? items + i : i;
+		if (fs.read() != expect) {
+			log_error() << "Wrong item read after overwrite at " << i << std::endl;
+			return false;
+		}
+	}
+	for (size_t i = items + 1; i--;) {
+		size_t expect = (i < items && i % step == 0) ? items + i : i;
+		if (fs.read_back() != expect) {
+			log_error() << "Wrong item read in backward scan at " << i << std::endl;
+			return false;
+		}
+	}
+	fs.close();
+	fs.open(TEMPFILE, access_read);
+	for (size_t i = 0; i <= items; ++i) {
+		size_t expect = (i < items && i % step == 0) ? items + i : i;
+		if (fs.read() != expect) {
+			log_error() << "Wrong item read after reopen at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool direct_test(size_t items) {
+	boost::filesystem::remove(TEMPFILE);
+	file_stream<size_t> fs;
+	fs.open(TEMPFILE, access_read_write, sizeof(size_t), access_direct);
+	size_t userData = 42;
+	fs.write_user_data(userData);
+	for (size_t i = 0; i < items; ++i) fs.write(i);
+	fs.seek(fs.block_items() / 2);
+	fs.write(items);
+	fs.close();
+
+	fs.open(TEMPFILE, access_read, sizeof(size_t), access_direct);
+	userData = 0;
+	fs.read_user_data(userData);
+	if (userData != 42) {
+		log_error() << "Wrong user data read" << std::endl;
+		return false;
+	}
+	if (fs.size() != items) {
+		log_error() << "Wrong stream size " << fs.size() << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < items; ++i) {
+		size_t expect = (i == fs.block_items() / 2) ? items : i;
+		if (fs.read() != expect) {
+			log_error() << "Wrong item read at " << i << std::endl;
+			return false;
+		}
+	}
+	fs.close();
+	boost::filesystem::remove(TEMPFILE);
+	return true;
+}
+
+bool mmap_test(size_t items) {
+	boost::filesystem::remove(TEMPFILE);
+	{
+		file_stream<size_t> fs;
+		fs.open(TEMPFILE, access_write);
+		for (size_t i = 0; i < items; ++i) fs.write(i);
+	}
+	file_stream<size_t> fs;
+	fs.set_memory_mapped(true);
+	fs.open(TEMPFILE, access_read, 0, access_random);
+	if (!fs.memory_mapped()) {
+		log_error() << "Stream is not memory mapped" << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < items; ++i) {
+		if (fs.read() != i) {
+			log_error() << "Wrong item read in forward scan at " << i << std::endl;
+			return false;
+		}
+	}
+	if (fs.can_read()) {
+		log_error() << "Could read past the end of the stream" << std::endl;
+		return false;
+	}
+	for (size_t i = items; i--;) {
+		if (fs.read_back() != i) {
+			log_error() << "Wrong item read in backward scan at " << i << std::endl;
+			return false;
+		}
+	}
+	size_t step = fs.block_items() / 3 + 1;
+	for (size_t i = items; i > step; i -= step) {
+		fs.seek(i - step);
+		if (fs.read() != i - step) {
+			log_error() << "Wrong item read after seek to " << i - step << std::endl;
+			return false;
+		}
+	}
+	fs.close();
+	if (fs.memory_mapped()) {
+		log_error() << "Stream is still memory mapped after close" << std::endl;
+		return false;
+	}
+	boost::filesystem::remove(TEMPFILE);
+	return true;
+}
+
+bool compression_test(size_t items) {
+	for (memory_size_type codec = compression_lz4; codec <= compression_delta; ++codec) {
+		boost::filesystem::remove(TEMPFILE);
+		stream_size_type written = get_bytes_written();
+		file_stream<size_t> fs;
+		fs.set_compression(codec);
+		fs.open(TEMPFILE, access_read_write, sizeof(size_t));
+		size_t userData = 42;
+		fs.write_user_data(userData);
+		for (size_t i = 0; i < items; ++i) fs.write(i);
+		// Overwrite an item in the middle of a block.
+		fs.seek(fs.block_items() + 7);
+		fs.write(items);
+		fs.close();
+		written = get_bytes_written() - written;
+		// Consecutive integers are the best case of the delta codec.
+		memory_size_type ratio = (codec == compression_delta) ? 4 : 1;
+		if (written * ratio > items * sizeof(size_t)) {
+			log_error() << "Codec " << codec << " wrote " << written << " bytes" << std::endl;
+			return false;
+		}
+
+		fs.set_compression(compression_none);
+		fs.open(TEMPFILE, access_read_write, sizeof(size_t));
+		if (fs.compression() != codec) {
+			log_error() << "Wrong codec " << fs.compression() << " read from header" << std::endl;
+			return false;
+		}
+		fs.read_user_data(userData);
+		if (userData != 42) {
+			log_error() << "Wrong user data read" << std::endl;
+			return false;
+		}
+		for (size_t i = 0; i < items; ++i) {
+			size_t expect = (i == fs.block_items() + 7) ? items : i;
+			if (fs.read() != expect) {
+				log_error() << "Wrong item read at " << i << std::endl;
+				return false;
+			}
+		}
+		// Random access and truncation in the middle of a block.
+		fs.seek(items / 3);
+		if (fs.read() != items / 3) {
+			log_error() << "Wrong item read after seek" << std::endl;
+			return false;
+		}
+		fs.truncate(items / 2);
+		fs.seek(0, file_stream<size_t>::end);
+		fs.write(0);
+		fs.close();
+
+		fs.open(TEMPFILE, access_read);
+		if (fs.size() != items / 2 + 1) {
+			log_error() << "Wrong size " << fs.size() << " after truncate" << std::endl;
+			return false;
+		}
+		fs.seek(items / 2 - 1);
+		if (fs.read() != items / 2 - 1 || fs.read() != 0) {
+			log_error() << "Wrong items read after truncate" << std::endl;
+			return false;
+		}
+		fs.close();
+	}
+	boost::filesystem::remove(TEMPFILE);
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
-		.test(memory, "memory", "block-factor", 1.0);
+		.test(memory, "memory", "block-factor", 1.0)
+		.test(async_test, "async", "n", static_cast<size_t>(1000000))
+		.test(direct_test, "direct", "n", static_cast<size_t>(1000003))
+		.test(mmap_test, "mmap", "n", static_cast<size_t>(1000003))
+		.test(compression_test, "compression", "n", static_cast<size_t>(1000003));
 
 }
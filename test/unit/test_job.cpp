@@ -60,8 +60,55 @@ bool repeat_test() {
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Job that spawns a binary tree of subjobs and joins them from within the
+/// job, so all workers end up joining at once.
+///////////////////////////////////////////////////////////////////////////////
+class tree_job : public tpie::job {
+	size_t depth;
+	boost::mutex * mutex;
+	size_t * ctr;
+public:
+	tree_job(size_t depth, boost::mutex * mutex, size_t * ctr)
+		: depth(depth)
+		, mutex(mutex)
+		, ctr(ctr)
+	{
+	}
+
+	void operator()() {
+		{
+			boost::mutex::scoped_lock lock(*mutex);
+			++*ctr;
+		}
+		if (depth == 0) return;
+		tree_job left(depth-1, mutex, ctr);
+		tree_job right(depth-1, mutex, ctr);
+		left.enqueue(this);
+		right.enqueue(this);
+		left.join();
+		right.join();
+	}
+};
+
+bool nested_test(size_t depth) {
+	boost::mutex mutex;
+	size_t ctr = 0;
+	tree_job root(depth, &mutex, &ctr);
+	root.enqueue();
+	root.join();
+	size_t expected = (static_cast<size_t>(1) << (depth+1)) - 1;
+	if (ctr != expected) {
+		tpie::log_error() << "Ran " << ctr << " jobs, expected " << expected << std::endl;
+		return false;
+	}
+	tpie::log_info() << "Ran " << ctr << " nested jobs" << std::endl;
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(repeat_test, "repeat")
+		.test(nested_test, "nested", "depth", static_cast<size_t>(12))
 		;
 }
@@ -0,0 +1,84 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include "common.h"
+#include <tpie/loser_tree.h>
+#include <boost/random.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace tpie;
+
+// Merge k sorted runs of random lengths, some of them empty, and compare
+// with the sorted concatenation.
+bool merge_test(memory_size_type k) {
+	boost::mt19937 rng(k);
+	std::vector<std::vector<boost::uint64_t> > runs(k);
+	std::vector<boost::uint64_t> expected;
+	for (memory_size_type i = 0; i < k; ++i) {
+		memory_size_type n = (i % 5 == 3) ? 0 : rng() % 1000;
+		for (memory_size_type j = 0; j < n; ++j) runs[i].push_back(rng() % 5000);
+		std::sort(runs[i].begin(), runs[i].end());
+		expected.insert(expected.end(), runs[i].begin(), runs[i].end());
+	}
+	std::sort(expected.begin(), expected.end());
+
+	loser_tree<boost::uint64_t> lt(k);
+	std::vector<memory_size_type> pos(k, 0);
+	for (memory_size_type i = 0; i < k; ++i) {
+		if (!runs[i].empty()) lt.unsafe_set(i, runs[i][pos[i]++]);
+	}
+	lt.make_safe();
+
+	std::vector<boost::uint64_t> merged;
+	while (!lt.empty()) {
+		memory_size_type i = lt.top_index();
+		merged.push_back(lt.top());
+		if (pos[i] < runs[i].size())
+			lt.pop_and_push(runs[i][pos[i]++]);
+		else
+			lt.pop();
+	}
+	if (merged != expected) {
+		log_error() << "Merge of " << k << " runs is wrong" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool basic_test() {
+	memory_size_type sizes[] = {1, 2, 3, 7, 8, 13, 64, 250};
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i) {
+		if (!merge_test(sizes[i])) return false;
+	}
+	return true;
+}
+
+class my_memory_test: public memory_test {
+public:
+	loser_tree<int> * a;
+	virtual void alloc() {a = tpie_new<loser_tree<int> >(123456);}
+	virtual void free() {tpie_delete(a);}
+	virtual size_type claimed_size() {return static_cast<size_type>(loser_tree<int>::memory_usage(123456));}
+};
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(basic_test, "basic")
+		.test(my_memory_test(), "memory");
+}
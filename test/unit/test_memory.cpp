@@ -25,6 +25,7 @@
 #include <boost/random.hpp>
 #include <tpie/job.h>
 #include <tpie/cpu_timer.h>
+#include <boost/thread.hpp>
 
 struct mtest {
 	size_t & r;
@@ -204,9 +205,126 @@ bool parallel_test(const size_t nJobs, const size_t times, const size_t capacity
 	return true;
 }
 
+struct thread_allocator {
+	std::vector<int *> * allocated;
+	std::vector<int *> * freed;
+
+	void operator()() {
+		// Free the pointers allocated by another thread.
+		for (size_t i = 0; i < freed->size(); ++i) tpie::tpie_delete((*freed)[i]);
+		for (size_t i = 0; i < allocated->size(); ++i) (*allocated)[i] = tpie::tpie_new<int>();
+	}
+};
+
+// Registers an allocation and keeps it unflushed until released.
+struct pending_allocator {
+	tpie::memory_manager * mm;
+	size_t bytes;
+	boost::barrier * allocated;
+	boost::barrier * release;
+
+	void operator()() {
+		mm->register_allocation(bytes);
+		allocated->wait();
+		release->wait();
+	}
+};
+
+struct thread_deallocator {
+	tpie::memory_manager * mm;
+	size_t bytes;
+
+	void operator()() {
+		mm->register_deallocation(bytes);
+	}
+};
+
+struct thread_enforced_allocator {
+	tpie::memory_manager * mm;
+	size_t bytes;
+	bool * threw;
+
+	void operator()() {
+		try {
+			mm->register_allocation(bytes);
+		} catch (tpie::out_of_memory_error &) {
+			*threw = true;
+		}
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Memory allocated in one thread and freed in another before the allocating
+/// thread flushes leaves the shared counter below zero. An enforced allocation
+/// at that point must not be seen as exceeding the limit.
+///////////////////////////////////////////////////////////////////////////////
+bool cross_thread_free_test() {
+	const size_t allocators = 2;
+	const size_t bytes = tpie::memory_manager::bucket_size - 1024;
+	tpie::memory_manager mm;
+	mm.set_limit(16*tpie::memory_manager::bucket_size);
+	mm.set_enforcement(tpie::memory_manager::ENFORCE_THROW);
+
+	boost::barrier allocated(allocators + 1);
+	boost::barrier release(allocators + 1);
+	boost::thread_group group;
+	for (size_t i = 0; i < allocators; ++i) {
+		pending_allocator a = {&mm, bytes, &allocated, &release};
+		group.create_thread(a);
+	}
+	allocated.wait();
+
+	// Free everything in another thread, which flushes a negative count.
+	thread_deallocator d = {&mm, allocators * bytes};
+	boost::thread(d).join();
+
+	bool threw = false;
+	thread_enforced_allocator e = {&mm, tpie::memory_manager::bucket_size, &threw};
+	boost::thread(e).join();
+
+	release.wait();
+	group.join_all();
+
+	if (threw) {
+		tpie::log_error() << "Spurious out_of_memory_error" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool thread_test() {
+	const size_t threads = 4;
+	const size_t n = 100000;
+	size_t a1 = tpie::get_memory_manager().used();
+	std::vector<std::vector<int *> > pointers(threads + 1, std::vector<int *>(n));
+	for (size_t i = 0; i < n; ++i) pointers[0][i] = tpie::tpie_new<int>();
+	for (size_t i = 0; i < threads; ++i) {
+		thread_allocator a;
+		a.freed = &pointers[i];
+		a.allocated = &pointers[i + 1];
+		boost::thread t(a);
+		t.join();
+	}
+	// All threads have exited and flushed their allocations.
+	size_t a2 = tpie::get_memory_manager().used();
+	if (a2 != a1 + n * sizeof(int)) {
+		tpie::log_error() << "Expected " << (a1 + n * sizeof(int)) << " bytes used, got " << a2 << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < n; ++i) tpie::tpie_delete(pointers[threads][i]);
+	size_t a3 = tpie::get_memory_manager().used();
+	if (a3 != a1) {
+		tpie::log_error() << "Expected " << a1 << " bytes used, got " << a3 << std::endl;
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	return tpie::tests(argc, argv, 128)
 		.test(basic_test, "basic")
+		.test(thread_test, "threads")
+		.test(cross_thread_free_test, "cross_thread_free")
 		.test(parallel_test<tpie_alloc>, "parallel",
 			  "n", static_cast<size_t>(8),
 			  "times", static_cast<size_t>(500000),
@@ -21,6 +21,7 @@
 #include <tpie/pipelining/merge_sorter.h>
 #include <tpie/parallel_sort.h>
 #include <tpie/sysinfo.h>
+#include <tpie/progress_indicator_null.h>
 #include <boost/random.hpp>
 
 using namespace tpie;
@@ -115,11 +116,153 @@ bool temp_file_usage_test() {
 	return result;
 }
 
+template <typename sorter_t>
+bool check_sorted_output(sorter_t & s, memory_size_type items, uint64_t sum) {
+	memory_size_type count = 0;
+	uint64_t prev = 0;
+	while (s.can_pull()) {
+		uint64_t x = s.pull();
+		if (x < prev) {
+			log_error() << "Items out of order at " << count << std::endl;
+			return false;
+		}
+		prev = x;
+		sum -= x;
+		++count;
+	}
+	if (count != items) {
+		log_error() << "Pulled " << count << " items, expected " << items << std::endl;
+		return false;
+	}
+	if (sum != 0) {
+		log_error() << "Pulled items differ from pushed items" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool compressed_runs_test(memory_size_type codec) {
+	const memory_size_type runLength = get_block_size() / sizeof(uint64_t) / 3;
+	const memory_size_type fanout = 4;
+	const memory_size_type items = runLength * 23 + 17;
+	tempname::set_default_compression(codec);
+	bool result;
+	{
+		merge_sorter<uint64_t, false> s;
+		s.set_parameters(runLength, fanout);
+		boost::mt19937 rng(42);
+		uint64_t sum = 0;
+		s.begin();
+		for (memory_size_type i = 0; i < items; ++i) {
+			uint64_t x = rng() % (items * 4);
+			sum += x;
+			s.push(x);
+		}
+		s.end();
+		dummy_progress_indicator pi;
+		s.calc(pi);
+		result = check_sorted_output(s, items, sum);
+	}
+	tempname::set_default_compression(compression_none);
+	return result;
+}
+
+bool parallel_merges_test(memory_size_type merges) {
+	const memory_size_type runLength = 1000;
+	const memory_size_type fanout = 4;
+	const memory_size_type items = runLength * 70 + 17;
+	merge_sorter<uint64_t, true> s;
+	s.set_parameters(runLength, fanout);
+	s.set_parallel_merges(merges);
+	boost::mt19937 rng(42);
+	uint64_t sum = 0;
+	s.begin();
+	for (memory_size_type i = 0; i < items; ++i) {
+		uint64_t x = rng();
+		sum += x;
+		s.push(x);
+	}
+	s.end();
+	progress_indicator_null pi(1);
+	s.calc(pi);
+	return check_sorted_output(s, items, sum);
+}
+
+bool heap_merger_test() {
+	const memory_size_type runLength = 1000;
+	const memory_size_type fanout = 5;
+	const memory_size_type items = runLength * 40 + 17;
+	merge_sorter<uint64_t, false> s;
+	s.set_parameters(runLength, fanout);
+	s.set_loser_tree(false);
+	boost::mt19937 rng(42);
+	uint64_t sum = 0;
+	s.begin();
+	for (memory_size_type i = 0; i < items; ++i) {
+		uint64_t x = rng();
+		sum += x;
+		s.push(x);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	return check_sorted_output(s, items, sum);
+}
+
+bool double_buffering_test(bool enabled, memory_size_type mb) {
+	const memory_size_type items = 3000000;
+	merge_sorter<uint64_t, false> s;
+	s.set_double_buffering(enabled);
+	s.set_available_memory(mb*1024*1024);
+	boost::mt19937 rng(42);
+	uint64_t sum = 0;
+	s.begin();
+	for (memory_size_type i = 0; i < items; ++i) {
+		uint64_t x = rng();
+		sum += x;
+		s.push(x);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	return check_sorted_output(s, items, sum);
+}
+
+bool parallel_final_merge_test(memory_size_type jobs, memory_size_type keys) {
+	const memory_size_type items = 3000000;
+	merge_sorter<uint64_t, false> s;
+	s.set_parameters(100000, 8);
+	s.set_parallel_final_merge(jobs);
+	boost::mt19937 rng(42);
+	uint64_t sum = 0;
+	s.begin();
+	for (memory_size_type i = 0; i < items; ++i) {
+		uint64_t x = (keys > 0) ? rng() % keys : rng();
+		sum += x;
+		s.push(x);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	return check_sorted_output(s, items, sum);
+}
+
+bool parallel_final_merge_duplicates_test(memory_size_type jobs) {
+	// Few distinct keys give empty ranges and ranges larger than a buffer.
+	return parallel_final_merge_test(jobs, 3);
+}
+
 int main(int argc, char ** argv) {
 	tests t(argc, argv);
 	return
 		sort_tester<use_merge_sort>::add_all(t)
 		.test(sort_upper_bound_test, "sort_upper_bound")
 		.test(temp_file_usage_test, "temp_file_usage")
+		.test(compressed_runs_test, "compressed_runs", "codec", static_cast<memory_size_type>(compression_delta))
+		.test(parallel_merges_test, "parallel_merges", "merges", static_cast<memory_size_type>(4))
+		.test(heap_merger_test, "heap_merger")
+		.test(double_buffering_test, "double_buffering", "enabled", true, "mb", static_cast<memory_size_type>(16))
+		.test(parallel_final_merge_test, "parallel_final_merge", "jobs", static_cast<memory_size_type>(2), "keys", static_cast<memory_size_type>(0))
+		.test(parallel_final_merge_duplicates_test, "parallel_final_merge_duplicates", "jobs", static_cast<memory_size_type>(2))
 		;
 }
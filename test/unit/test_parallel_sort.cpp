@@ -285,6 +285,57 @@ bool large_item_test_chooser(size_t mb, size_t itemSize) {
 	return large_item_test_helper<0, 8>::go(mb, itemSize);
 }
 
+struct less_than_fn {
+	less_than_fn(int pivot) : pivot(pivot) {}
+	bool operator()(int x) const {return x < pivot;}
+	int pivot;
+};
+
+bool parallel_partition_test(size_t n, size_t chunks) {
+	boost::rand48 prng(42);
+	std::vector<int> v(n);
+	for (size_t i = 0; i < n; ++i) v[i] = static_cast<int>(prng() % 1000);
+	std::vector<int> sorted(v);
+	std::sort(sorted.begin(), sorted.end());
+	typedef parallel_sort_impl<std::vector<int>::iterator, std::less<int>, false> sorter_t;
+	for (int pivot = 0; pivot <= 1000; pivot += 250) {
+		std::vector<int>::iterator m = sorter_t::parallel_partition(v.begin(), v.end(), less_than_fn(pivot), chunks);
+		size_t expected = std::lower_bound(sorted.begin(), sorted.end(), pivot) - sorted.begin();
+		if (static_cast<size_t>(m - v.begin()) != expected) {
+			tpie::log_error() << "Partition around " << pivot << " at " << (m - v.begin()) << ", expected " << expected << std::endl;
+			return false;
+		}
+		if (std::find_if(v.begin(), m, std::not1(std::bind2nd(std::less<int>(), pivot))) != m
+			|| std::find_if(m, v.end(), std::bind2nd(std::less<int>(), pivot)) != v.end()) {
+			tpie::log_error() << "Items on the wrong side of " << pivot << std::endl;
+			return false;
+		}
+	}
+	std::vector<int> v2(v);
+	std::sort(v2.begin(), v2.end());
+	if (v2 != sorted) {
+		tpie::log_error() << "Partitioning changed the items" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool few_keys_test(size_t n, size_t keys) {
+	boost::rand48 prng(42);
+	std::vector<int> v1(n);
+	std::vector<int> v2(n);
+	for (size_t i = 0; i < n; ++i) v1[i] = v2[i] = static_cast<int>(prng() % keys);
+	std::sort(v1.begin(), v1.end());
+	// Small enough ranges that the top layers are partitioned in parallel.
+	parallel_sort_impl<std::vector<int>::iterator, std::less<int>, false, 65536> s(0);
+	s(v2.begin(), v2.end());
+	if (v1 != v2) {
+		tpie::log_error() << "std::sort and parallel_sort disagree" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 template <size_t stdsort_limit>
 struct sort_tester {
 	bool operator()(size_t n) {
@@ -303,6 +354,8 @@ int main(int argc, char **argv) {
 		.test(bad_case, "bad_case", "n", 1024*1024, "seconds", 1.0)
 		.test(adversarial<make_random_data>(), "general2", "n", 1024*1024, "seconds", 1.0)
 		.test(stress_test, "stress_test")
+		.test(parallel_partition_test, "parallel_partition", "n", static_cast<size_t>(1000003), "chunks", static_cast<size_t>(7))
+		.test(few_keys_test, "few_keys", "n", static_cast<size_t>(8*1024*1024), "keys", static_cast<size_t>(3))
 		.test(large_item_test_chooser, "large_item", "mb", static_cast<size_t>(2048), "item-size", static_cast<size_t>(32))
 		;
 }
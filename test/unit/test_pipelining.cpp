@@ -21,9 +21,11 @@
 #include <tpie/pipelining.h>
 #include <tpie/file_stream.h>
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 #include <algorithm>
 #include <tpie/pipelining/graph.h>
 #include <tpie/sysinfo.h>
+#include <tpie/stats.h>
 #include <tpie/pipelining/virtual.h>
 #include <tpie/progress_indicator_arrow.h>
 
@@ -138,6 +140,109 @@ bool file_stream_test() {
 	return true;
 }
 
+class batch_recorder_t : public node {
+public:
+	typedef test_t item_type;
+
+	batch_recorder_t(std::vector<test_t> & output, size_t & batches, size_t & singles)
+		: output(output)
+		, batches(batches)
+		, singles(singles)
+	{
+		set_name("Batch recorder");
+	}
+
+	void push(const test_t & item) {
+		output.push_back(item);
+		++singles;
+	}
+
+	void push_batch(array_view<const test_t> items) {
+		output.insert(output.end(), items.begin(), items.end());
+		++batches;
+	}
+
+private:
+	std::vector<test_t> & output;
+	size_t & batches;
+	size_t & singles;
+};
+
+pipe_end<termfactory_3<batch_recorder_t, std::vector<test_t> &, size_t &, size_t &> >
+batch_recorder(std::vector<test_t> & output, size_t & batches, size_t & singles) {
+	return termfactory_3<batch_recorder_t, std::vector<test_t> &, size_t &, size_t &>(output, batches, singles);
+}
+
+struct add_one : public std::unary_function<test_t, test_t> {
+	test_t operator()(test_t x) const { return x + 1; }
+};
+
+struct keep_multiples_of_four : public std::unary_function<test_t, std::pair<test_t, bool> > {
+	std::pair<test_t, bool> operator()(test_t x) const { return std::make_pair(x, x % 4 == 0); }
+};
+
+bool push_batch_test(size_t n) {
+	if (!has_push_batch<batch_recorder_t>::value) {
+		log_error() << "push_batch of batch_recorder_t not detected" << std::endl;
+		return false;
+	}
+	if (has_push_batch<multiply_t<batch_recorder_t> >::value) {
+		log_error() << "push_batch detected in multiply_t" << std::endl;
+		return false;
+	}
+	file_system_cleanup();
+	{
+		file_stream<test_t> in;
+		in.open("input");
+		for (size_t i = 0; i < n; ++i) in.write(i);
+	}
+	std::vector<test_t> output;
+	size_t batches = 0;
+	size_t singles = 0;
+	{
+		file_stream<test_t> in;
+		in.open("input");
+		pipeline p = input(in) | linear<test_t>(2, 1) | lambda(add_one())
+			| exclude_lambda(keep_multiples_of_four()) | batch_recorder(output, batches, singles);
+		p();
+	}
+	log_debug() << output.size() << " items in " << batches << " batches and "
+		<< singles << " single items" << std::endl;
+	if (singles != 0 || batches == 0) return false;
+	if (output.size() != n/2) return false;
+	for (size_t i = 0; i < output.size(); ++i) {
+		if (output[i] != 4*i + 4) {
+			log_error() << "Got " << output[i] << " at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool push_batch_fallback_test(size_t n) {
+	file_system_cleanup();
+	{
+		file_stream<test_t> in;
+		in.open("input");
+		for (size_t i = 0; i < n; ++i) in.write(i);
+	}
+	std::vector<test_t> output;
+	{
+		file_stream<test_t> in;
+		in.open("input");
+		pipeline p = input(in) | linear<test_t>(2, 1) | multiply(3) | output_vector(output);
+		p();
+	}
+	if (output.size() != n) return false;
+	for (size_t i = 0; i < n; ++i) {
+		if (output[i] != 3*(2*i + 1)) {
+			log_error() << "Got " << output[i] << " at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 bool file_stream_pull_test() {
 	file_system_cleanup();
 	{
@@ -234,16 +339,128 @@ bool reverse_test() {
 	expectvector = inputvector;
 	std::reverse(expectvector.begin(), expectvector.end());
 
-	
-	//reverser<test_t> r(inputvector.size());
-	//pipeline p1 = input_vector(inputvector) | r.sink();
-	//pipeline p2 = r.source() | output_vector(outputvector);
-	//p1.plot(log_info());
-	//p1();
-
 	return check_test_vectors();
 }
 
+bool reverse_items(size_t n, memory_size_type memory, stream_size_type & written) {
+	std::vector<size_t> input(n);
+	for (size_t i = 0; i < n; ++i) input[i] = i;
+	std::vector<size_t> output;
+	pipeline p = input_vector(input) | reverser() | output_vector(output);
+	progress_indicator_null pi;
+	stream_size_type writtenBefore = get_bytes_written();
+	p(n, pi, memory);
+	written = get_bytes_written() - writtenBefore;
+	if (output.size() != n) {
+		log_error() << "Got " << output.size() << " items, expected " << n << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		if (output[i] != n - 1 - i) {
+			log_error() << "Bad item at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool reverse_memory_test(size_t n, memory_size_type memory) {
+	stream_size_type written;
+	if (!reverse_items(n, memory, written)) return false;
+	if (written != 0) {
+		log_error() << "Reverser wrote " << written << " bytes, expected none" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool reverse_spill_test(size_t n, memory_size_type memory) {
+	stream_size_type written;
+	if (!reverse_items(n, memory, written)) return false;
+	if (written == 0) {
+		log_error() << "Reverser did not spill" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool passive_reverser_test(size_t n, memory_size_type memory) {
+	std::vector<size_t> input(n);
+	for (size_t i = 0; i < n; ++i) input[i] = i;
+	std::vector<size_t> output;
+	passive_reverser<size_t> r;
+	pipeline p1 = input_vector(input) | r.sink();
+	pipeline p2 = r.source() | output_vector(output);
+	progress_indicator_null pi;
+	p1(n, pi, memory);
+	if (output.size() != n) {
+		log_error() << "Got " << output.size() << " items, expected " << n << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		if (output[i] != n - 1 - i) {
+			log_error() << "Bad item at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool delayed_buffer_test(size_t n, memory_size_type memory) {
+	std::vector<size_t> input(n);
+	for (size_t i = 0; i < n; ++i) input[i] = i;
+	std::vector<size_t> output;
+	pipeline p = input_vector(input) | delayed_buffer() | output_vector(output);
+	progress_indicator_null pi;
+	p(n, pi, memory);
+	if (output != input) {
+		log_error() << "Delayed buffer changed the items" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool buffer_evacuate_test(size_t n, memory_size_type memory) {
+	tpie::pipelining::bits::spill_buffer<size_t> buffer;
+	buffer.set_input_memory(memory);
+	buffer.set_output_memory(memory);
+	buffer.begin();
+	// Spill some items before the evacuation and push some after it.
+	for (size_t i = 0; i < n / 2; ++i) buffer.push(i);
+	stream_size_type written = get_bytes_written();
+	buffer.evacuate();
+	if (get_bytes_written() - written >= n / 2 * sizeof(size_t)) {
+		log_error() << "Evacuation wrote " << get_bytes_written() - written
+					<< " bytes, rewriting the spilled items" << std::endl;
+		return false;
+	}
+	for (size_t i = n / 2; i < n; ++i) buffer.push(i);
+	if (buffer.size() != n) {
+		log_error() << "Evacuated buffer has " << buffer.size() << " items, expected " << n << std::endl;
+		return false;
+	}
+	buffer.rewind();
+	for (size_t i = 0; i < n; ++i) {
+		if (!buffer.can_read() || buffer.read() != i) {
+			log_error() << "Bad item at " << i << std::endl;
+			return false;
+		}
+	}
+	buffer.rewind_back();
+	for (size_t i = n; i > 0; --i) {
+		if (!buffer.can_read_back() || buffer.read_back() != i - 1) {
+			log_error() << "Bad item at " << i - 1 << " reading back" << std::endl;
+			return false;
+		}
+	}
+	if (buffer.can_read_back()) {
+		log_error() << "Too many items reading back" << std::endl;
+		return false;
+	}
+	buffer.free();
+	return true;
+}
+
 template <typename dest_t>
 struct sequence_generator : public node {
 	typedef size_t item_type;
@@ -353,6 +570,19 @@ bool sort_test_large() {
 	return sort_test(300*1024);
 }
 
+struct size_t_key : public std::unary_function<size_t, size_t> {
+	size_t operator()(size_t x) const {return x;}
+};
+
+bool sort_by_key_test() {
+	bool result = false;
+	pipeline p = make_pipe_begin_1<sequence_generator>(static_cast<size_t>(300*1024))
+		| pipesort(by_key(size_t_key()))
+		| make_pipe_end_2<sequence_verifier, size_t, bool &>(300*1024, result);
+	p();
+	return result;
+}
+
 // This tests that pipe_middle | pipe_middle -> pipe_middle,
 // and that pipe_middle | pipe_end -> pipe_end.
 // The other tests already test that pipe_begin | pipe_middle -> pipe_middle,
@@ -383,6 +613,44 @@ bool uniq_test() {
 	return check_test_vectors();
 }
 
+bool hash_aggregate_test(size_t groups, size_t repeats, memory_size_type memory) {
+	typedef std::pair<size_t, size_t> group_t;
+	std::vector<group_t> input(groups * repeats);
+	for (size_t i = 0; i < input.size(); ++i) {
+		size_t key = (i * 7919) % groups;
+		input[i] = group_t(key, key);
+	}
+	std::vector<group_t> output;
+	pipeline p = input_vector(input)
+		| hash_aggregate<size_t>(std::plus<size_t>())
+		| output_vector(output);
+	progress_indicator_null pi;
+	p(input.size(), pi, memory);
+	if (output.size() != groups) {
+		log_error() << "Got " << output.size() << " groups, expected " << groups << std::endl;
+		return false;
+	}
+	std::sort(output.begin(), output.end());
+	for (size_t i = 0; i < groups; ++i) {
+		if (output[i] != group_t(i, i * repeats)) {
+			log_error() << "Got (" << output[i].first << ", " << output[i].second
+						<< "), expected (" << i << ", " << i * repeats << ")" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool hash_aggregate_memory_test() {
+	return hash_aggregate_test(1000, 100, 50*1024*1024);
+}
+
+// The groups do not fit in the table, so pairs are spilled and aggregated
+// recursively.
+bool hash_aggregate_spill_test() {
+	return hash_aggregate_test(300000, 4, 10*1024*1024);
+}
+
 struct memtest {
 	size_t totalMemory;
 	size_t minMem1;
@@ -1119,6 +1387,56 @@ bool parallel_ordered_test(size_t modulo) {
 	return result;
 }
 
+bool parallel_fine_grained_test(size_t modulo) {
+	// One item per batch makes every item a handoff between threads.
+	bool result = false;
+	pipeline p = make_pipe_begin_2<sequence_generator>(modulo-1, false)
+		| parallel(multiplicative_inverter(modulo) | multiplicative_inverter(modulo), maintain_order, 4, 1)
+		| make_pipe_end_2<sequence_verifier, size_t, bool &>(modulo-1, result);
+	progress_indicator_null pi;
+	p(modulo-1, pi);
+	return result;
+}
+
+bool check_parallel_stats(const parallel_stats & stats, size_t items) {
+	if (stats.items != items) {
+		log_error() << "Parallel stats report " << stats.items << " items, expected " << items << std::endl;
+		return false;
+	}
+	if (stats.batches == 0 || stats.batches > items) {
+		log_error() << "Parallel stats report " << stats.batches << " batches" << std::endl;
+		return false;
+	}
+	if (stats.batchSize == 0) {
+		log_error() << "Parallel stats report batch size 0" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parallel_adaptive_test(size_t modulo) {
+	bool result = false;
+	parallel_stats stats;
+	pipeline p = make_pipe_begin_1<sequence_generator>(modulo-1)
+		| parallel_adaptive(multiplicative_inverter(modulo), arbitrary_order, 4, 4096, &stats)
+		| pipesort()
+		| make_pipe_end_2<sequence_verifier, size_t, bool &>(modulo-1, result);
+	progress_indicator_null pi;
+	p(modulo-1, pi);
+	return result && check_parallel_stats(stats, modulo-1);
+}
+
+bool parallel_adaptive_ordered_test(size_t modulo) {
+	bool result = false;
+	parallel_stats stats;
+	pipeline p = make_pipe_begin_2<sequence_generator>(modulo-1, false)
+		| parallel_adaptive(multiplicative_inverter(modulo) | multiplicative_inverter(modulo), maintain_order, 4, 4096, &stats)
+		| make_pipe_end_2<sequence_verifier, size_t, bool &>(modulo-1, result);
+	progress_indicator_null pi;
+	p(modulo-1, pi);
+	return result && check_parallel_stats(stats, modulo-1);
+}
+
 template <typename dest_t>
 class Monotonic : public node {
 	dest_t dest;
@@ -1211,6 +1529,53 @@ bool parallel_multiple_test() {
 	}
 }
 
+template <typename dest_t>
+class Repeater : public node {
+	dest_t dest;
+	size_t copies;
+public:
+	typedef size_t item_type;
+	Repeater(const dest_t & dest, size_t copies)
+		: dest(dest)
+		, copies(copies)
+	{
+		add_push_destination(dest);
+		set_name("Repeater");
+	}
+
+	void push(size_t item) {
+		for (size_t i = 0; i < copies; ++i) dest.push(item);
+	}
+};
+
+pipe_middle<factory_1<Repeater, size_t> >
+repeater(size_t copies) {
+	return factory_1<Repeater, size_t>(copies);
+}
+
+bool parallel_ordered_expand_test(size_t copies) {
+	// Each batch produces several output buffers, more than a reorder slot
+	// holds, so workers ahead of the front batch have to wait.
+	const size_t n = 20000;
+	std::vector<size_t> output;
+	pipeline p = make_pipe_begin_2<sequence_generator>(n, false)
+		| parallel(repeater(copies), maintain_order, 4, 16)
+		| output_vector(output);
+	progress_indicator_null pi;
+	p(n, pi);
+	if (output.size() != n * copies) {
+		log_error() << "Got " << output.size() << " items, expected " << n * copies << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < output.size(); ++i) {
+		if (output[i] != i / copies + 1) {
+			log_error() << "Bad item at " << i << ": " << output[i] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 template <typename dest_t>
 class buffering_accumulator_type : public node {
 	dest_t dest;
@@ -1596,6 +1961,229 @@ bool join_test() {
 	return true;
 }
 
+typedef std::pair<size_t, size_t> join_item_t;
+
+struct join_key : public std::unary_function<join_item_t, size_t> {
+	size_t operator()(const join_item_t & x) const {return x.first;}
+};
+
+// Build keys are 0, ..., keys-1, each with `duplicates` items, and probe
+// keys are 0, ..., 2*keys-1, so half of the probe items have no match.
+bool hash_join_test(size_t keys, size_t duplicates, memory_size_type memory) {
+	std::vector<join_item_t> build(keys * duplicates);
+	for (size_t i = 0; i < build.size(); ++i) build[i] = join_item_t((i * 7919) % keys, i);
+	std::vector<join_item_t> probe(2 * keys);
+	for (size_t i = 0; i < probe.size(); ++i) probe[i] = join_item_t(i, 3 * i);
+
+	typedef std::pair<join_item_t, join_item_t> output_t;
+	std::vector<output_t> output;
+	hash_join<join_item_t, join_item_t, join_key> j;
+	pipeline p1 = input_vector(build) | j.build();
+	pipeline p2 = input_vector(probe) | j.probe() | output_vector(output);
+	progress_indicator_null pi;
+	p2(probe.size(), pi, memory);
+
+	if (output.size() != build.size()) {
+		log_error() << "Got " << output.size() << " pairs, expected " << build.size() << std::endl;
+		return false;
+	}
+	std::vector<size_t> matches(keys);
+	for (size_t i = 0; i < output.size(); ++i) {
+		const output_t & o = output[i];
+		if (o.first.first != o.second.first || o.second.second != 3 * o.second.first
+			|| (o.first.second * 7919) % keys != o.first.first) {
+			log_error() << "Bad pair " << o.first.first << ", " << o.second.first << std::endl;
+			return false;
+		}
+		++matches[o.first.first];
+	}
+	for (size_t i = 0; i < keys; ++i) {
+		if (matches[i] != duplicates) {
+			log_error() << "Key " << i << " has " << matches[i] << " matches, expected "
+						<< duplicates << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool hash_join_memory_test() {
+	return hash_join_test(10000, 3, 50*1024*1024);
+}
+
+// The build side does not fit, so both sides are partitioned.
+bool hash_join_partition_test() {
+	return hash_join_test(200000, 3, 12*1024*1024);
+}
+
+// Two hot keys, so each partition holding one of them has more build items
+// than fit in memory and is joined in chunks.
+bool hash_join_skew_test() {
+	return hash_join_test(2, 400000, 12*1024*1024);
+}
+
+// The inputs of the join are sorted in independent phases. There is too
+// little memory to sort in memory, so both sorts create run files at the
+// same time.
+bool concurrent_phases_test() {
+	const size_t n = 1000000;
+	std::vector<join_item_t> build(n);
+	std::vector<join_item_t> probe(n);
+	for (size_t i = 0; i < n; ++i) {
+		build[i] = join_item_t((i * 7919) % n, i);
+		probe[i] = join_item_t((i * 104729) % n, i);
+	}
+	typedef std::pair<join_item_t, join_item_t> output_t;
+	std::vector<output_t> output;
+	hash_join<join_item_t, join_item_t, join_key> j;
+	pipeline p1 = input_vector(build) | pipesort() | j.build();
+	pipeline p2 = input_vector(probe) | pipesort() | j.probe() | output_vector(output);
+	p2.set_concurrent_phases(true);
+	progress_indicator_null pi;
+	stream_size_type writtenBefore = get_bytes_written();
+	p2(n, pi, 16*1024*1024);
+	if (get_bytes_written() - writtenBefore < 2 * n * sizeof(join_item_t)) {
+		log_error() << "The sorts did not spill" << std::endl;
+		return false;
+	}
+
+	if (output.size() != n) {
+		log_error() << "Got " << output.size() << " pairs, expected " << n << std::endl;
+		return false;
+	}
+	// The join spills as well, so the pairs come in partition order.
+	std::vector<bool> seen(n, false);
+	for (size_t i = 0; i < n; ++i) {
+		size_t key = output[i].first.first;
+		if (key >= n || output[i].second.first != key || seen[key]) {
+			log_error() << "Bad pair at " << i << std::endl;
+			return false;
+		}
+		seen[key] = true;
+	}
+	return true;
+}
+
+template <typename dest_t>
+struct fail_after_t : public node {
+	typedef typename dest_t::item_type item_type;
+
+	fail_after_t(const dest_t & dest, size_t items)
+		: dest(dest)
+		, items(items)
+	{
+		add_push_destination(dest);
+		set_name("Fail after");
+	}
+
+	void push(const item_type & item) {
+		if (items == 0) throw out_of_space_exception("Out of space");
+		--items;
+		dest.push(item);
+	}
+
+	dest_t dest;
+	size_t items;
+};
+
+pipe_middle<factory_1<fail_after_t, size_t> > fail_after(size_t items) {
+	return factory_1<fail_after_t, size_t>(items);
+}
+
+template <typename dest_t>
+struct record_end_t : public node {
+	typedef typename dest_t::item_type item_type;
+
+	record_end_t(const dest_t & dest, bool & ended)
+		: dest(dest)
+		, ended(ended)
+	{
+		add_push_destination(dest);
+		set_name("Record end");
+	}
+
+	void push(const item_type & item) {
+		dest.push(item);
+	}
+
+	virtual void end() override {
+		ended = true;
+	}
+
+	dest_t dest;
+	bool & ended;
+};
+
+pipe_middle<factory_1<record_end_t, bool &> > record_end(bool & ended) {
+	return factory_1<record_end_t, bool &>(ended);
+}
+
+bool concurrent_phases_error_test() {
+	const size_t n = 100000;
+	std::vector<join_item_t> build(n);
+	std::vector<join_item_t> probe(n);
+	for (size_t i = 0; i < n; ++i) {
+		build[i] = join_item_t(i, i);
+		probe[i] = join_item_t(i, i);
+	}
+	typedef std::pair<join_item_t, join_item_t> output_t;
+	std::vector<output_t> output;
+	bool ended = false;
+	hash_join<join_item_t, join_item_t, join_key> j;
+	pipeline p1 = input_vector(build) | record_end(ended) | pipesort() | j.build();
+	pipeline p2 = input_vector(probe) | fail_after(n / 2) | pipesort() | j.probe() | output_vector(output);
+	p2.set_concurrent_phases(true);
+	try {
+		p2();
+	} catch (out_of_space_exception &) {
+		if (!ended) {
+			log_error() << "The phase that succeeded was not ended" << std::endl;
+			return false;
+		}
+		return true;
+	}
+	log_error() << "out_of_space_exception was not rethrown" << std::endl;
+	return false;
+}
+
+bool node_stats_test() {
+	const size_t n = 10000;
+	std::vector<size_t> input(n);
+	for (size_t i = 0; i < n; ++i) input[i] = n - i;
+	std::vector<size_t> output;
+	std::stringstream report;
+	pipeline p = input_vector(input) | pipesort() | output_vector(output);
+	p.set_stats_output(&report);
+	p();
+
+	std::string line;
+	std::getline(report, line);
+	if (line != "digraph {") {
+		log_error() << "Bad plot header: " << line << std::endl;
+		return false;
+	}
+	const std::string key = "memory_assigned=\"";
+	size_t lines = 0;
+	memory_size_type assigned = 0;
+	while (std::getline(report, line)) {
+		size_t pos = line.find(key);
+		if (pos == std::string::npos) continue;
+		pos += key.size();
+		assigned += boost::lexical_cast<memory_size_type>(line.substr(pos, line.find('"', pos) - pos));
+		++lines;
+	}
+	// input, output and the three nodes of the sort
+	if (lines != 5) {
+		log_error() << "Got " << lines << " nodes, expected 5" << std::endl;
+		return false;
+	}
+	if (assigned == 0) {
+		log_error() << "No memory assigned" << std::endl;
+		return false;
+	}
+	return output.size() == n;
+}
+
 bool copy_ctor_test() {
 	std::vector<int> i(10);
 	std::vector<int> j;
@@ -1611,15 +2199,30 @@ int main(int argc, char ** argv) {
 	.setup(file_system_cleanup)
 	.test(vector_multiply_test, "vector")
 	.test(file_stream_test, "filestream")
+	.test(push_batch_test, "push_batch", "n", static_cast<size_t>(1000000))
+	.test(push_batch_fallback_test, "push_batch_fallback", "n", static_cast<size_t>(1000000))
 	.test(file_stream_pull_test, "fspull")
 	.test(file_stream_alt_push_test, "fsaltpush")
 	.test(merge_test, "merge")
 	.test(reverse_test, "reverse")
+	.test(reverse_memory_test, "reverse_memory",
+		  "n", static_cast<size_t>(100000), "memory", static_cast<memory_size_type>(16*1024*1024))
+	.test(reverse_spill_test, "reverse_spill",
+		  "n", static_cast<size_t>(1000000), "memory", static_cast<memory_size_type>(4*1024*1024))
+	.test(passive_reverser_test, "passive_reverser",
+		  "n", static_cast<size_t>(1000000), "memory", static_cast<memory_size_type>(4*1024*1024))
+	.test(delayed_buffer_test, "delayed_buffer",
+		  "n", static_cast<size_t>(1000000), "memory", static_cast<memory_size_type>(4*1024*1024))
+	.test(buffer_evacuate_test, "buffer_evacuate",
+		  "n", static_cast<size_t>(1000000), "memory", static_cast<memory_size_type>(4*1024*1024))
 	.test(sort_test_trivial, "sorttrivial")
 	.test(sort_test_small, "sort")
 	.test(sort_test_large, "sortbig")
+	.test(sort_by_key_test, "sort_by_key")
 	.test(operator_test, "operators")
 	.test(uniq_test, "uniq")
+	.test(hash_aggregate_memory_test, "hash_aggregate")
+	.test(hash_aggregate_spill_test, "hash_aggregate_spill")
 	.multi_test(memory_test_multi, "memory")
 	.test(fork_test, "fork")
 	.test(merger_memory_test, "merger_memory", "n", static_cast<size_t>(10))
@@ -1633,11 +2236,21 @@ int main(int argc, char ** argv) {
 	.test(push_iterator_test, "push_iterator")
 	.test(parallel_test, "parallel", "modulo", static_cast<size_t>(20011))
 	.test(parallel_ordered_test, "parallel_ordered", "modulo", static_cast<size_t>(20011))
+	.test(parallel_fine_grained_test, "parallel_fine_grained", "modulo", static_cast<size_t>(1009))
+	.test(parallel_adaptive_test, "parallel_adaptive", "modulo", static_cast<size_t>(20011))
+	.test(parallel_adaptive_ordered_test, "parallel_adaptive_ordered", "modulo", static_cast<size_t>(20011))
 	.test(parallel_step_test, "parallel_step")
 	.test(parallel_multiple_test, "parallel_multiple")
+	.test(parallel_ordered_expand_test, "parallel_ordered_expand", "copies", static_cast<size_t>(10))
 	.test(parallel_own_buffer_test, "parallel_own_buffer")
 	.test(parallel_push_in_end_test, "parallel_push_in_end")
 	.test(join_test, "join")
+	.test(hash_join_memory_test, "hash_join")
+	.test(hash_join_partition_test, "hash_join_partition")
+	.test(hash_join_skew_test, "hash_join_skew")
+	.test(concurrent_phases_test, "concurrent_phases")
+	.test(concurrent_phases_error_test, "concurrent_phases_error")
+	.test(node_stats_test, "node_stats")
 	.multi_test(node_map_multi_test, "node_map")
 	.test(copy_ctor_test, "copy_ctor")
 	;
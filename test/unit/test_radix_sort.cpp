@@ -0,0 +1,128 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include "common.h"
+#include <tpie/radix_sort.h>
+#include <tpie/parallel_sort.h>
+#include <boost/random.hpp>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
+using namespace tpie;
+
+template <typename T>
+struct identity_key : public std::unary_function<T, T> {
+	T operator()(T x) const {return x;}
+};
+
+struct record {
+	boost::uint32_t payload;
+	boost::int64_t key;
+};
+
+struct record_key : public std::unary_function<record, const boost::int64_t &> {
+	const boost::int64_t & operator()(const record & r) const {return r.key;}
+};
+
+struct record_less {
+	bool operator()(const record & a, const record & b) const {return a.key < b.key;}
+};
+
+template <typename T>
+bool sort_and_compare(std::vector<T> v) {
+	std::vector<T> expected(v);
+	std::sort(expected.begin(), expected.end());
+	radix_sort(v.begin(), v.end(), by_key(identity_key<T>()));
+	if (v != expected) {
+		log_error() << "radix_sort and std::sort disagree" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool unsigned_keys_test(size_t n) {
+	boost::mt19937 rng(42);
+	std::vector<boost::uint64_t> v(n);
+	for (size_t i = 0; i < n; ++i) v[i] = (static_cast<boost::uint64_t>(rng()) << 32) | rng();
+	std::vector<boost::uint8_t> w(n);
+	for (size_t i = 0; i < n; ++i) w[i] = static_cast<boost::uint8_t>(rng());
+	return sort_and_compare(v) && sort_and_compare(w);
+}
+
+bool signed_keys_test(size_t n) {
+	boost::mt19937 rng(42);
+	std::vector<int> v(n);
+	for (size_t i = 0; i < n; ++i) v[i] = static_cast<int>(rng());
+	v[0] = std::numeric_limits<int>::min();
+	v[n/2] = std::numeric_limits<int>::max();
+	return sort_and_compare(v);
+}
+
+bool few_keys_test(size_t n) {
+	boost::mt19937 rng(42);
+	std::vector<boost::uint32_t> v(n);
+	// Keys sharing their high digits exercise the digit skipping.
+	for (size_t i = 0; i < n; ++i) v[i] = 0x12345600 + rng() % 3;
+	return sort_and_compare(v);
+}
+
+bool struct_keys_test(size_t n) {
+	boost::mt19937 rng(42);
+	std::vector<record> v(n);
+	for (size_t i = 0; i < n; ++i) {
+		v[i].payload = static_cast<boost::uint32_t>(i);
+		v[i].key = static_cast<boost::int64_t>(rng() % 1000) - 500;
+	}
+	std::vector<boost::int64_t> expected(n);
+	for (size_t i = 0; i < n; ++i) expected[i] = v[i].key;
+	std::sort(expected.begin(), expected.end());
+	radix_sort(v.begin(), v.end(), by_key(record_key()));
+	for (size_t i = 0; i < n; ++i) {
+		if (v[i].key != expected[i]) {
+			log_error() << "Wrong key at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// parallel_sort given a key_less must sort by the key.
+bool dispatch_test(size_t n) {
+	boost::mt19937 rng(42);
+	std::vector<record> v(n);
+	for (size_t i = 0; i < n; ++i) v[i].key = rng();
+	parallel_sort(v.begin(), v.end(), by_key(record_key()));
+	for (size_t i = 1; i < n; ++i) {
+		if (record_less()(v[i], v[i-1])) {
+			log_error() << "Not sorted at " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(unsigned_keys_test, "unsigned_keys", "n", static_cast<size_t>(1000003))
+		.test(signed_keys_test, "signed_keys", "n", static_cast<size_t>(100003))
+		.test(struct_keys_test, "struct_keys", "n", static_cast<size_t>(100003))
+		.test(few_keys_test, "few_keys", "n", static_cast<size_t>(2*1024*1024))
+		.test(dispatch_test, "dispatch", "n", static_cast<size_t>(100003));
+}
@@ -37,9 +37,49 @@ public:
 	}
 };
 
+// Sort strings that often share their first eight characters, so both
+// prefix comparisons and full comparisons on ties are exercised.
+bool prefix_test(memory_size_type items, memory_size_type mb) {
+	boost::rand48 rng;
+	std::vector<std::string> expected(items);
+	const char * prefixes[] = {"", "a", "http://w", "http://www.tpie."};
+	for (memory_size_type i = 0; i < items; ++i) {
+		std::string & s = expected[i];
+		s = prefixes[rng() % 4];
+		memory_size_type length = rng() % 12;
+		for (memory_size_type j = 0; j < length; ++j) s += static_cast<char>('a' + rng() % 3);
+	}
+
+	serialization_sort<std::string, string_prefix_less> s;
+	s.set_available_memory(mb*1024*1024);
+	s.begin();
+	for (memory_size_type i = 0; i < items; ++i) s.push(expected[i]);
+	s.end();
+	s.merge_runs();
+	std::sort(expected.begin(), expected.end());
+	for (memory_size_type i = 0; i < items; ++i) {
+		if (!s.can_pull()) {
+			log_error() << "Got " << i << " items, expected " << items << std::endl;
+			return false;
+		}
+		std::string x = s.pull();
+		if (x != expected[i]) {
+			log_error() << "Got " << x << " at " << i << ", expected " << expected[i] << std::endl;
+			return false;
+		}
+	}
+	if (s.can_pull()) {
+		log_error() << "Got more items than expected" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	tests t(argc, argv);
 	return
 		sort_tester<use_serialization_sort>::add_all(t)
+		.test(prefix_test, "prefix_internal", "n", static_cast<memory_size_type>(10000), "mb", static_cast<memory_size_type>(16))
+		.test(prefix_test, "prefix_external", "n", static_cast<memory_size_type>(400000), "mb", static_cast<memory_size_type>(10))
 		;
 }
@@ -36,6 +36,8 @@
 #include <tpie/array.h>
 #include <tpie/file_stream.h>
 #include <tpie/util.h>
+#include <tpie/stream_header.h>
+#include <fstream>
 
 using tpie::uint64_t;
 
@@ -743,6 +745,69 @@ bool reopen() {
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Streams written before compression was added have version 3 headers
+/// without the compression field, with the user data right after them.
+///////////////////////////////////////////////////////////////////////////////
+bool reopen_v3() {
+	typedef int item_type;
+	const size_t items = 1000;
+	const uint64_t userData = 0x0123456789abcdefull;
+	const tpie::memory_size_type blockSize = tpie::file_stream<item_type>::block_size(1.0);
+	tpie::temp_file tf;
+	{
+		tpie::stream_header_t header;
+		header.magic = tpie::stream_header_t::magicConst;
+		header.version = 3;
+		header.itemSize = sizeof(item_type);
+		header.blockSize = blockSize;
+		header.userDataSize = sizeof(userData);
+		header.maxUserDataSize = sizeof(userData);
+		header.size = items;
+		header.cleanClose = 1;
+		std::vector<char> file(4096 + items*sizeof(item_type));
+		// Old layout: 64 byte header, user data, blocks at the next 4096 bytes.
+		memcpy(&file[0], &header, 64);
+		memcpy(&file[64], &userData, sizeof(userData));
+		for (size_t i = 0; i < items; ++i) {
+			item_type x = static_cast<item_type>(i*3);
+			memcpy(&file[4096 + i*sizeof(item_type)], &x, sizeof(x));
+		}
+		std::ofstream os(tf.path().c_str(), std::ios::binary);
+		os.write(&file[0], file.size());
+	}
+
+	tpie::file_stream<item_type> s;
+	s.open(tf, tpie::access_read, sizeof(userData));
+	TEST_ENSURE(s.size() == items, "size() wrong");
+	uint64_t readUserData = 0;
+	s.read_user_data(readUserData);
+	TEST_ENSURE(readUserData == userData, "user data wrong");
+	for (size_t i = 0; i < items; ++i)
+		TEST_ENSURE(s.read() == static_cast<item_type>(i*3), "read() wrong");
+	s.close();
+
+	// Uncompressed streams are still written with version 3 headers.
+	s.open(tf, tpie::access_read_write, sizeof(userData));
+	s.seek(0, tpie::file_stream<item_type>::end);
+	s.write(42);
+	s.close();
+	{
+		std::ifstream is(tf.path().c_str(), std::ios::binary);
+		tpie::stream_header_t header;
+		is.read(reinterpret_cast<char *>(&header), 64);
+		TEST_ENSURE(header.version == 3, "header version changed");
+		TEST_ENSURE(header.size == items + 1, "header size wrong");
+	}
+	s.open(tf, tpie::access_read, sizeof(userData));
+	readUserData = 0;
+	s.read_user_data(readUserData);
+	TEST_ENSURE(readUserData == userData, "user data wrong after rewrite");
+	s.seek(items);
+	TEST_ENSURE(s.read() == 42, "appended item wrong");
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.setup(remove_temp)
@@ -755,6 +820,7 @@ int main(int argc, char **argv) {
 		.test(stream_tester<file_stream>::truncate_test, "truncate")
 		.test(stream_tester<file_colon_colon_stream>::truncate_test, "truncate_file")
 		.test(reopen, "reopen")
+		.test(reopen_v3, "reopen_v3")
 		.test(stream_tester<file_stream>::extend_test, "extend")
 		.test(stream_tester<file_colon_colon_stream>::extend_test, "extend_file")
 		.test(stream_tester<file_stream>::backwards_test, "backwards")
@@ -0,0 +1,233 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_BUFFERED_QUEUE_H__
+#define __TPIE_BUFFERED_QUEUE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file buffered_queue.h
+/// \brief I/O efficient queue that keeps its ends in memory and releases
+/// consumed disk space.
+///////////////////////////////////////////////////////////////////////////////
+#include <tpie/array.h>
+#include <tpie/file_stream.h>
+#include <tpie/tempname.h>
+#include <tpie/memory.h>
+#include <tpie/tpie_assert.h>
+#include <deque>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Temporary FIFO queue that only spills the middle section to disk.
+///
+/// The oldest items are kept in a head buffer and the newest in a tail
+/// buffer, each holding one block of items. While the queue fits in the
+/// head buffer, no I/O is done. When the tail buffer is full, it is written
+/// to disk as a whole. The items on disk are stored in a chain of segment
+/// files of at most segmentBlocks blocks each. A segment file is deleted as
+/// soon as it has been read, so the disk space used is at most one segment
+/// more than the items on disk.
+///
+/// Unlike tpie::queue, the queue cannot be persisted.
+///
+/// \tparam T The type of items stored in the queue
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class buffered_queue {
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Construct an empty queue.
+	/// \param blockFactor The block factor of the buffers and segment files.
+	/// \param segmentBlocks The number of blocks in each segment file.
+	///////////////////////////////////////////////////////////////////////////
+	buffered_queue(double blockFactor=1.0, memory_size_type segmentBlocks=64)
+		: m_size(0)
+		, m_headPos(0)
+		, m_headEnd(0)
+		, m_tailSize(0)
+		, m_diskItems(0)
+		, m_writeOpen(false)
+		, m_readOpen(false)
+		, m_writeStream(blockFactor)
+		, m_readStream(blockFactor)
+	{
+		memory_size_type items = buffer_items(blockFactor);
+		m_head.resize(items);
+		m_tail.resize(items);
+		m_segmentItems = items * std::max(segmentBlocks, static_cast<memory_size_type>(1));
+	}
+
+	~buffered_queue() {
+		if (m_writeOpen) m_writeStream.close();
+		if (m_readOpen) m_readStream.close();
+		while (!m_segments.empty()) {
+			tpie_delete(m_segments.front());
+			m_segments.pop_front();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Check if the queue is empty
+	/// \return true if the queue is empty otherwize false
+	////////////////////////////////////////////////////////////////////
+	bool empty() const {return m_size == 0;}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Returns the number of items currently on the queue.
+	/// \return Number of itmes in the queue
+	////////////////////////////////////////////////////////////////////
+	stream_size_type size() const {return m_size;}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Enqueue an item
+	/// \param t The item to be enqueued
+	////////////////////////////////////////////////////////////////////
+	void push(const T & t) {
+		++m_size;
+		if (m_diskItems == 0 && m_tailSize == 0) {
+			// The queue is short; serve it from the head buffer.
+			if (m_headPos == m_headEnd) m_headPos = m_headEnd = 0;
+			if (m_headEnd < m_head.size()) {
+				m_head[m_headEnd++] = t;
+				return;
+			}
+		}
+		if (m_tailSize == m_tail.size()) spill_tail();
+		m_tail[m_tailSize++] = t;
+	}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Dequeues an item
+	/// \return The dequeued item, valid until the next call to push or pop
+	////////////////////////////////////////////////////////////////////
+	const T & pop() {
+		if (m_headPos == m_headEnd) refill_head();
+		--m_size;
+		return m_head[m_headPos++];
+	}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Returns at the frontmost item in the queue
+	/// \return The front most item in the queue
+	////////////////////////////////////////////////////////////////////
+	const T & front() {
+		if (m_headPos == m_headEnd) refill_head();
+		return m_head[m_headPos];
+	}
+
+	////////////////////////////////////////////////////////////////////
+	/// \brief Compute the memory used by the queue
+	////////////////////////////////////////////////////////////////////
+	static memory_size_type memory_usage(double blockFactor=1.0) {
+		return sizeof(buffered_queue<T>)
+			+ 2*array<T>::memory_usage(buffer_items(blockFactor))
+			- 2*sizeof(array<T>)
+			+ 2*file_stream<T>::memory_usage(blockFactor)
+			- 2*sizeof(file_stream<T>);
+	}
+
+private:
+	static memory_size_type buffer_items(double blockFactor) {
+		return std::max(file_stream<T>::block_size(blockFactor) / sizeof(T),
+						static_cast<memory_size_type>(1));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Append the tail buffer to the last segment file, starting a new
+	/// segment if the last one is full or is being read.
+	///////////////////////////////////////////////////////////////////////////
+	void spill_tail() {
+		if (m_writeOpen && m_writeStream.size() >= m_segmentItems) {
+			m_writeStream.close();
+			m_writeOpen = false;
+		}
+		if (!m_writeOpen) {
+			m_segments.push_back(tpie_new<temp_file>());
+			m_writeStream.open(*m_segments.back(), access_read_write);
+			m_writeOpen = true;
+		}
+		m_writeStream.write(m_tail.begin(), m_tail.begin() + m_tailSize);
+		m_diskItems += m_tailSize;
+		m_tailSize = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Fill the empty head buffer from the first segment file, or
+	/// take the tail buffer if nothing is on disk.
+	///////////////////////////////////////////////////////////////////////////
+	void refill_head() {
+		tp_assert(m_size > 0, "pop() on empty queue");
+		if (m_diskItems == 0) {
+			m_head.swap(m_tail);
+			m_headPos = 0;
+			m_headEnd = m_tailSize;
+			m_tailSize = 0;
+			return;
+		}
+		if (!m_readOpen) {
+			if (m_writeOpen && m_segments.size() == 1) {
+				// Finish the segment we are about to read; the next spill
+				// starts a new one.
+				m_writeStream.close();
+				m_writeOpen = false;
+			}
+			m_readStream.open(*m_segments.front(), access_read);
+			m_readOpen = true;
+		}
+		memory_size_type n = static_cast<memory_size_type>(
+			std::min(static_cast<stream_size_type>(m_head.size()),
+					 m_readStream.size() - m_readStream.offset()));
+		m_readStream.read(m_head.begin(), m_head.begin() + n);
+		m_headPos = 0;
+		m_headEnd = n;
+		m_diskItems -= n;
+		if (!m_readStream.can_read()) {
+			// Release the disk space of the consumed segment.
+			m_readStream.close();
+			m_readOpen = false;
+			tpie_delete(m_segments.front());
+			m_segments.pop_front();
+		}
+	}
+
+	stream_size_type m_size;
+	memory_size_type m_segmentItems;
+
+	/** Oldest items, from m_headPos to m_headEnd. */
+	array<T> m_head;
+	memory_size_type m_headPos;
+	memory_size_type m_headEnd;
+
+	/** Newest items, the first m_tailSize. */
+	array<T> m_tail;
+	memory_size_type m_tailSize;
+
+	/** Items between head and tail, in m_segments in order. */
+	stream_size_type m_diskItems;
+	std::deque<temp_file *> m_segments;
+	bool m_writeOpen;
+	bool m_readOpen;
+	file_stream<T> m_writeStream;
+	file_stream<T> m_readStream;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_BUFFERED_QUEUE_H__
@@ -37,7 +37,14 @@ enum cache_hint {
 
 	/** Random access is intended.
 	 * Corresponds to POSIX_FADV_RANDOM and FILE_FLAG_RANDOM_ACCESS (Win32). */
-	access_random
+	access_random,
+
+	/** Data is written once and read once sequentially, and should not
+	 * pollute the operating system's page cache. Corresponds to O_DIRECT
+	 * where supported and to access_sequential otherwise. Transfers that are
+	 * not aligned to file_base_crtp::block_alignment() go through the page
+	 * cache. */
+	access_direct
 };
 
 } // namespace tpie
@@ -0,0 +1,304 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include <tpie/compression.h>
+#include <tpie/exception.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+using namespace tpie;
+
+inline void throw_corrupt() {
+	throw io_exception("Corrupt compressed block");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// LZ4 block format: a sequence of (token, literals, match) triples where the
+/// token holds the literal length and the match length minus four in its two
+/// nibbles, either of which is continued in 255-bytes if it is 15. The last
+/// sequence has literals only.
+///////////////////////////////////////////////////////////////////////////////
+class lz4_codec: public block_codec {
+public:
+	virtual memory_size_type compress(const char * src, memory_size_type size,
+									  memory_size_type /*itemSize*/,
+									  char * dest, memory_size_type capacity) const {
+		if (size > std::numeric_limits<uint32_t>::max()) return 0;
+
+		const unsigned char * in = reinterpret_cast<const unsigned char *>(src);
+		unsigned char * out = reinterpret_cast<unsigned char *>(dest);
+		unsigned char * outEnd = out + capacity;
+
+		// Position plus one of the last occurrence of each hashed
+		// four-byte sequence.
+		uint32_t table[1 << hashBits];
+		std::memset(table, 0, sizeof(table));
+
+		memory_size_type anchor = 0;
+		memory_size_type i = 0;
+		// The format requires the last match to start at least 12 bytes and
+		// end at least 5 bytes before the end of the block.
+		if (size > 12) {
+			const memory_size_type matchLimit = size - 12;
+			const memory_size_type matchEnd = size - 5;
+			while (i < matchLimit) {
+				uint32_t sequence = read32(in + i);
+				uint32_t h = (sequence * 2654435761U) >> (32 - hashBits);
+				memory_size_type candidate = table[h];
+				table[h] = static_cast<uint32_t>(i + 1);
+				if (candidate == 0 || i + 1 - candidate > maxOffset
+					|| read32(in + candidate - 1) != sequence) {
+					// Skip faster through incompressible data.
+					i += 1 + ((i - anchor) >> 6);
+					continue;
+				}
+				--candidate;
+				memory_size_type length = 4;
+				while (i + length < matchEnd && in[candidate + length] == in[i + length])
+					++length;
+				out = write_sequence(out, outEnd, in + anchor, i - anchor, i - candidate, length);
+				if (out == 0) return 0;
+				i += length;
+				anchor = i;
+			}
+		}
+		out = write_sequence(out, outEnd, in + anchor, size - anchor, 0, 0);
+		if (out == 0) return 0;
+		return out - reinterpret_cast<unsigned char *>(dest);
+	}
+
+	virtual void decompress(const char * src, memory_size_type compressedSize,
+							memory_size_type /*itemSize*/,
+							char * dest, memory_size_type size) const {
+		const unsigned char * in = reinterpret_cast<const unsigned char *>(src);
+		const unsigned char * inEnd = in + compressedSize;
+		unsigned char * out = reinterpret_cast<unsigned char *>(dest);
+		unsigned char * outBegin = out;
+		unsigned char * outEnd = out + size;
+
+		for (;;) {
+			if (in == inEnd) throw_corrupt();
+			unsigned token = *in++;
+			memory_size_type literals = read_length(in, inEnd, token >> 4);
+			if (literals > static_cast<memory_size_type>(inEnd - in)
+				|| literals > static_cast<memory_size_type>(outEnd - out))
+				throw_corrupt();
+			std::memcpy(out, in, literals);
+			in += literals;
+			out += literals;
+			if (in == inEnd) break;
+
+			if (inEnd - in < 2) throw_corrupt();
+			memory_size_type offset = in[0] | (in[1] << 8);
+			in += 2;
+			if (offset == 0 || offset > static_cast<memory_size_type>(out - outBegin))
+				throw_corrupt();
+			memory_size_type length = read_length(in, inEnd, token & 15) + 4;
+			if (length > static_cast<memory_size_type>(outEnd - out))
+				throw_corrupt();
+			// The match may overlap the output, so copy byte by byte.
+			const unsigned char * match = out - offset;
+			for (memory_size_type j = 0; j < length; ++j) out[j] = match[j];
+			out += length;
+		}
+		if (out != outEnd) throw_corrupt();
+	}
+
+private:
+	static const unsigned hashBits = 14;
+	static const memory_size_type maxOffset = 65535;
+
+	static uint32_t read32(const unsigned char * p) {
+		uint32_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return x;
+	}
+
+	static unsigned char * write_length(unsigned char * out, memory_size_type length) {
+		while (length >= 255) {
+			*out++ = 255;
+			length -= 255;
+		}
+		*out++ = static_cast<unsigned char>(length);
+		return out;
+	}
+
+	static memory_size_type read_length(const unsigned char *& in, const unsigned char * inEnd, unsigned nibble) {
+		memory_size_type length = nibble;
+		if (nibble == 15) {
+			unsigned char b;
+			do {
+				if (in == inEnd) throw_corrupt();
+				b = *in++;
+				length += b;
+			} while (b == 255);
+		}
+		return length;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Write literals followed by a match, or only literals if length is
+	/// zero. Returns null if the output does not fit.
+	///////////////////////////////////////////////////////////////////////////
+	static unsigned char * write_sequence(unsigned char * out, unsigned char * outEnd,
+										  const unsigned char * literals, memory_size_type literalCount,
+										  memory_size_type offset, memory_size_type length) {
+		memory_size_type worst = 1 + literalCount / 255 + 1 + literalCount
+			+ 2 + length / 255 + 1;
+		if (worst > static_cast<memory_size_type>(outEnd - out)) return 0;
+
+		unsigned char * token = out++;
+		*token = static_cast<unsigned char>(std::min<memory_size_type>(literalCount, 15) << 4);
+		if (literalCount >= 15) out = write_length(out, literalCount - 15);
+		std::memcpy(out, literals, literalCount);
+		out += literalCount;
+		if (length == 0) return out;
+
+		*out++ = static_cast<unsigned char>(offset & 0xff);
+		*out++ = static_cast<unsigned char>(offset >> 8);
+		length -= 4;
+		*token |= static_cast<unsigned char>(std::min<memory_size_type>(length, 15));
+		if (length >= 15) out = write_length(out, length - 15);
+		return out;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Delta encoding of the words of consecutive items. Words are the largest of
+/// 8, 4, 2 and 1 bytes that divides the item size, and word j of item i is
+/// stored as the difference to word j of item i-1 in zigzag varint encoding.
+///////////////////////////////////////////////////////////////////////////////
+class delta_codec: public block_codec {
+public:
+	virtual memory_size_type compress(const char * src, memory_size_type size,
+									  memory_size_type itemSize,
+									  char * dest, memory_size_type capacity) const {
+		switch (word_size(itemSize)) {
+			case 8: return encode<uint64_t>(src, size, itemSize, dest, capacity);
+			case 4: return encode<uint32_t>(src, size, itemSize, dest, capacity);
+			case 2: return encode<uint16_t>(src, size, itemSize, dest, capacity);
+			default: return encode<uint8_t>(src, size, itemSize, dest, capacity);
+		}
+	}
+
+	virtual void decompress(const char * src, memory_size_type compressedSize,
+							memory_size_type itemSize,
+							char * dest, memory_size_type size) const {
+		switch (word_size(itemSize)) {
+			case 8: decode<uint64_t>(src, compressedSize, itemSize, dest, size); break;
+			case 4: decode<uint32_t>(src, compressedSize, itemSize, dest, size); break;
+			case 2: decode<uint16_t>(src, compressedSize, itemSize, dest, size); break;
+			default: decode<uint8_t>(src, compressedSize, itemSize, dest, size); break;
+		}
+	}
+
+private:
+	/** Maximum length of the varint encoding of a 64-bit integer. */
+	static const memory_size_type maxVarint = 10;
+
+	static memory_size_type word_size(memory_size_type itemSize) {
+		if (itemSize % 8 == 0) return 8;
+		if (itemSize % 4 == 0) return 4;
+		if (itemSize % 2 == 0) return 2;
+		return 1;
+	}
+
+	template <typename word_t>
+	static word_t word(const char * data, memory_size_type index) {
+		word_t x;
+		std::memcpy(&x, data + index * sizeof(word_t), sizeof(word_t));
+		return x;
+	}
+
+	template <typename word_t>
+	static memory_size_type encode(const char * src, memory_size_type size,
+								   memory_size_type itemSize,
+								   char * dest, memory_size_type capacity) {
+		const memory_size_type words = size / sizeof(word_t);
+		const memory_size_type stride = itemSize / sizeof(word_t);
+		const unsigned bits = 8 * sizeof(word_t);
+		unsigned char * out = reinterpret_cast<unsigned char *>(dest);
+		unsigned char * outEnd = out + capacity;
+		for (memory_size_type j = 0; j < words; ++j) {
+			if (static_cast<memory_size_type>(outEnd - out) < maxVarint) return 0;
+			word_t prev = (j >= stride) ? word<word_t>(src, j - stride) : 0;
+			uint64_t d = static_cast<word_t>(word<word_t>(src, j) - prev);
+			// Sign extend the difference to 64 bits and zigzag encode it.
+			if (bits < 64 && (d >> (bits - 1)) != 0)
+				d |= ~static_cast<uint64_t>(0) << (bits % 64);
+			uint64_t z = (d << 1) ^ (0 - (d >> 63));
+			while (z >= 0x80) {
+				*out++ = static_cast<unsigned char>(z | 0x80);
+				z >>= 7;
+			}
+			*out++ = static_cast<unsigned char>(z);
+		}
+		return out - reinterpret_cast<unsigned char *>(dest);
+	}
+
+	template <typename word_t>
+	static void decode(const char * src, memory_size_type compressedSize,
+					   memory_size_type itemSize,
+					   char * dest, memory_size_type size) {
+		const memory_size_type words = size / sizeof(word_t);
+		const memory_size_type stride = itemSize / sizeof(word_t);
+		const unsigned char * in = reinterpret_cast<const unsigned char *>(src);
+		const unsigned char * inEnd = in + compressedSize;
+		for (memory_size_type j = 0; j < words; ++j) {
+			uint64_t z = 0;
+			unsigned shift = 0;
+			for (;;) {
+				if (in == inEnd || shift >= 64) throw_corrupt();
+				unsigned char b = *in++;
+				z |= static_cast<uint64_t>(b & 0x7f) << shift;
+				shift += 7;
+				if (b < 0x80) break;
+			}
+			uint64_t d = (z >> 1) ^ (0 - (z & 1));
+			word_t prev = (j >= stride) ? word<word_t>(dest, j - stride) : 0;
+			word_t x = static_cast<word_t>(prev + static_cast<word_t>(d));
+			std::memcpy(dest + j * sizeof(word_t), &x, sizeof(word_t));
+		}
+		if (in != inEnd) throw_corrupt();
+	}
+};
+
+lz4_codec lz4;
+delta_codec delta;
+
+const block_codec * codecs[compression_max + 1] = {0, &lz4, &delta};
+
+} // unnamed namespace
+
+namespace tpie {
+
+const block_codec * get_block_codec(memory_size_type id) {
+	if (id > compression_max) return 0;
+	return codecs[id];
+}
+
+void register_block_codec(memory_size_type id, const block_codec * codec) {
+	if (id < compression_user_first || id > compression_max)
+		throw invalid_argument_exception("Block codec identifier is reserved or out of range");
+	codecs[id] = codec;
+}
+
+} // namespace tpie
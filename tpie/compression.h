@@ -0,0 +1,112 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file compression.h  Block codecs used by compressed streams
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_COMPRESSION_H__
+#define __TPIE_COMPRESSION_H__
+
+#include <tpie/types.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Identifiers of the built-in block codecs. The identifier is stored
+/// in the stream header, so the values must never change.
+///
+/// Identifiers from compression_user_first up to compression_max are free
+/// for codecs registered with register_block_codec.
+///////////////////////////////////////////////////////////////////////////////
+enum compression_scheme {
+	/** Blocks are stored as is. */
+	compression_none = 0,
+
+	/** Fast byte-oriented LZ77 compression in the LZ4 block format.
+	 * Suits items with repeated byte patterns, such as padded records. */
+	compression_lz4 = 1,
+
+	/** Each machine word of an item is stored as the zigzag varint encoded
+	 * difference to the same word of the previous item. Suits sorted
+	 * integer keys and slowly changing counters. */
+	compression_delta = 2,
+
+	compression_user_first = 16,
+	compression_max = 255
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Interface of a codec that compresses single stream blocks.
+///
+/// Codecs are stateless and shared between all streams, so the methods must
+/// be safe to call concurrently.
+///////////////////////////////////////////////////////////////////////////////
+class block_codec {
+public:
+	virtual ~block_codec() {}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Compress a block.
+	///
+	/// \param src The items of the block.
+	/// \param size Size of src in bytes, a multiple of itemSize.
+	/// \param itemSize Size of a single item in bytes.
+	/// \param dest Buffer receiving the compressed block.
+	/// \param capacity Size of dest in bytes.
+	/// \returns The size of the compressed block, or zero if it does not fit
+	/// in capacity bytes, in which case the block is stored uncompressed.
+	///////////////////////////////////////////////////////////////////////////
+	virtual memory_size_type compress(const char * src, memory_size_type size,
+									  memory_size_type itemSize,
+									  char * dest, memory_size_type capacity) const = 0;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Decompress a block produced by compress.
+	///
+	/// \param src The compressed block.
+	/// \param compressedSize Size of src in bytes.
+	/// \param itemSize Size of a single item in bytes.
+	/// \param dest Buffer receiving the items.
+	/// \param size The original size passed to compress.
+	/// \throws io_exception if src is not a valid compressed block of the
+	/// given size.
+	///////////////////////////////////////////////////////////////////////////
+	virtual void decompress(const char * src, memory_size_type compressedSize,
+							memory_size_type itemSize,
+							char * dest, memory_size_type size) const = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the codec registered under the given identifier.
+/// \returns The codec, or null for compression_none and unknown identifiers.
+///////////////////////////////////////////////////////////////////////////////
+const block_codec * get_block_codec(memory_size_type id);
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Register a codec under an identifier between
+/// compression_user_first and compression_max. The codec must outlive all
+/// streams using it, and must be registered under the same identifier
+/// whenever streams compressed with it are read.
+///////////////////////////////////////////////////////////////////////////////
+void register_block_codec(memory_size_type id, const block_codec * codec);
+
+} // namespace tpie
+
+#endif // __TPIE_COMPRESSION_H__
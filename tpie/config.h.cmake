@@ -5,6 +5,8 @@
 
 #cmakedefine TPIE_HAVE_UNISTD_H
 #cmakedefine TPIE_HAVE_SYS_UNISTD_H
+#cmakedefine TPIE_HAVE_LINUX_IO_URING_H
+#cmakedefine TPIE_USE_IO_URING
 
 #cmakedefine TPIE_DEPRECATED_WARNINGS
 #cmakedefine TPIE_PARALLEL_SORT
@@ -23,6 +23,7 @@
 /// \file file_accessor.h Declare default file accessor.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <tpie/config.h>
 #include <tpie/file_accessor/stream_accessor.h>
 
 #ifdef WIN32
@@ -35,6 +36,16 @@ typedef stream_accessor<win32> file_accessor;
 }
 }
 
+#elif defined(TPIE_USE_IO_URING)
+
+#include <tpie/file_accessor/uring.h>
+namespace tpie {
+namespace file_accessor {
+typedef uring raw_file_accessor;
+typedef stream_accessor<uring> file_accessor;
+}
+}
+
 #else // WIN32
 
 #include <tpie/file_accessor/posix.h>
@@ -25,6 +25,7 @@
 #define _TPIE_FILE_ACCESSOR_POSIX_H
 
 #include <tpie/file_accessor/stream_accessor.h>
+#include <tpie/file_accessor/posix_base.h>
 namespace tpie {
 namespace file_accessor {
 
@@ -32,14 +33,13 @@ namespace file_accessor {
 /// \brief POSIX-style file accessor.
 ///////////////////////////////////////////////////////////////////////////////
 
-class posix {
+class posix : public posix_base {
 private:
-	int m_fd;
-	cache_hint m_cacheHint;
+	// Whether O_DIRECT is currently set on m_fd.
+	bool m_direct;
 
 public:
 	inline posix();
-	inline ~posix() {close_i();}
 
 	inline void open_ro(const std::string & path);
 	inline void open_wo(const std::string & path);
@@ -49,20 +49,11 @@ public:
 	inline void read_i(void * data, memory_size_type size);
 	inline void write_i(const void * data, memory_size_type size);
 	inline void seek_i(stream_size_type offset);
-	inline void close_i();
-	inline void truncate_i(stream_size_type bytes);
-	inline bool is_open() const;
-
-	///////////////////////////////////////////////////////////////////////////
-	/// \brief Check the global errno variable and throw an exception that
-	/// matches its value.
-	///////////////////////////////////////////////////////////////////////////
-	static inline void throw_errno();
-
-	inline void set_cache_hint(cache_hint cacheHint);
 
 private:
-	inline void give_advice();
+	inline int open_file(const std::string & path, int flags);
+	inline void begin_transfer(const void * data, memory_size_type size);
+	inline void set_direct(bool direct);
 };
 
 }
@@ -20,10 +20,12 @@
 #include <string.h>
 #include <tpie/exception.h>
 #include <tpie/file_count.h>
+#include <tpie/util.h>
 #include <tpie/file_accessor/posix.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <iostream>
 #include <sstream>
@@ -31,74 +33,108 @@
 namespace tpie {
 namespace file_accessor {
 
-void posix::throw_errno() {
-	if (errno == ENOSPC) throw out_of_space_exception(strerror(errno));
-	else throw io_exception(strerror(errno));
-}
-
 posix::posix()
-	: m_fd(0)
-	, m_cacheHint(access_normal)
+	: m_direct(false)
 {
 }
 
-inline void posix::set_cache_hint(cache_hint cacheHint) {
-	m_cacheHint = cacheHint;
-}
-
-inline void posix::give_advice() {
-#ifndef __MACH__
-	int advice;
-	switch (m_cacheHint) {
-		case access_normal:
-			advice = POSIX_FADV_NORMAL;
-			break;
-		case access_sequential:
-			advice = POSIX_FADV_SEQUENTIAL;
-			break;
-		case access_random:
-			advice = POSIX_FADV_RANDOM;
-			break;
-		default:
-			advice = POSIX_FADV_NORMAL;
-			break;
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Open the given path, adding O_DIRECT to the flags if the cache hint
+/// asks for unbuffered I/O and the platform and file system support it.
+///////////////////////////////////////////////////////////////////////////////
+inline int posix::open_file(const std::string & path, int flags) {
+	m_offset = 0;
+	m_direct = false;
+#ifdef O_DIRECT
+	if (m_cacheHint == access_direct) {
+		int fd = ::open(path.c_str(), flags | O_DIRECT, S_IRUSR | S_IWUSR);
+		if (fd != -1) {
+			m_direct = true;
+			return fd;
+		}
+		if (errno != EINVAL) return fd;
+		// The file system does not support O_DIRECT, e.g. tmpfs.
+		m_cacheHint = access_sequential;
+	}
+#endif // O_DIRECT
+	return ::open(path.c_str(), flags, S_IRUSR | S_IWUSR);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Set or clear O_DIRECT on the open file descriptor.
+///
+/// If the file system rejects O_DIRECT, the file is left buffered.
+///////////////////////////////////////////////////////////////////////////////
+inline void posix::set_direct(bool direct) {
+#ifdef O_DIRECT
+	if (direct == m_direct) return;
+	int flags = ::fcntl(m_fd, F_GETFL);
+	if (flags == -1) throw_errno();
+	flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+	if (::fcntl(m_fd, F_SETFL, flags) == -1) {
+		if (!direct || errno != EINVAL) throw_errno();
+		m_cacheHint = access_sequential;
+		return;
 	}
-	::posix_fadvise(m_fd, 0, 0, advice);
-#endif // __MACH__
+	m_direct = direct;
+#else // O_DIRECT
+	unused(direct);
+#endif // O_DIRECT
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Prepare a transfer of size bytes at the current offset.
+///
+/// Unbuffered I/O requires the buffer address, the file offset and the size
+/// to be aligned, which holds for whole blocks but not for headers, user
+/// data and the final partial block. Those go through the page cache.
+///////////////////////////////////////////////////////////////////////////////
+inline void posix::begin_transfer(const void * data, memory_size_type size) {
+	if (m_cacheHint != access_direct) return;
+	const memory_size_type alignment = 4096;
+	bool aligned = reinterpret_cast<size_t>(data) % alignment == 0
+		&& m_offset % alignment == 0
+		&& size % alignment == 0;
+	set_direct(aligned);
 }
 
 inline void posix::read_i(void * data, memory_size_type size) {
+	begin_transfer(data, size);
 	memory_offset_type bytesRead = ::read(m_fd, data, size);
 	if (bytesRead == -1)
 		throw_errno();
 	if (bytesRead != static_cast<memory_offset_type>(size))
 		throw io_exception("Wrong number of bytes read");
+	m_offset += size;
 	increment_bytes_read(size);
 }
 
 inline void posix::write_i(const void * data, memory_size_type size) {
+	begin_transfer(data, size);
 	if (::write(m_fd, data, size) != (memory_offset_type)size) throw_errno();
+	m_offset += size;
 	increment_bytes_written(size);
 }
 
 inline void posix::seek_i(stream_size_type size) {
 	if (::lseek(m_fd, size, SEEK_SET) == -1) throw_errno();
+	m_offset = size;
 }
 
 void posix::open_wo(const std::string & path) {
-	m_fd = ::open(path.c_str(), O_RDWR | O_TRUNC | O_CREAT,  S_IRUSR | S_IWUSR);
+	m_fd = open_file(path, O_RDWR | O_TRUNC | O_CREAT);
 	if (m_fd == -1) throw_errno();
 	give_advice();
 }
 
 void posix::open_ro(const std::string & path) {
-	m_fd = ::open(path.c_str(), O_RDONLY);
+	m_fd = open_file(path, O_RDONLY);
 	if (m_fd == -1) throw_errno();
 	give_advice();
 }
 
 bool posix::try_open_rw(const std::string & path) {
-	m_fd = ::open(path.c_str(), O_RDWR);
+	m_fd = open_file(path, O_RDWR);
 	if (m_fd == -1) {
 		if (errno != ENOENT) throw_errno();
 		return false;
@@ -108,25 +144,10 @@ bool posix::try_open_rw(const std::string & path) {
 }
 
 void posix::open_rw_new(const std::string & path) {
-	m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	m_fd = open_file(path, O_RDWR | O_CREAT);
 	if (m_fd == -1) throw_errno();
 	give_advice();
 }
 
-bool posix::is_open() const {
-	return m_fd != 0;
-}
-
-void posix::close_i() {
-	if (m_fd != 0) {
-		::close(m_fd);
-	}
-	m_fd=0;
-}
-
-void posix::truncate_i(stream_size_type bytes) {
-	if (ftruncate(m_fd, bytes) == -1) throw_errno();
-}
-
 }
 }
@@ -0,0 +1,85 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2009, 2010, 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file posix_base.h  Common base of the file descriptor based accessors
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_FILE_ACCESSOR_POSIX_BASE_H
+#define _TPIE_FILE_ACCESSOR_POSIX_BASE_H
+
+#include <tpie/types.h>
+#include <tpie/cache_hint.h>
+namespace tpie {
+namespace file_accessor {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The parts of the posix and uring accessors that only depend on the
+/// file descriptor: closing, truncating, memory mapping and cache advice.
+/// The accessors differ in how they open files and transfer data.
+///////////////////////////////////////////////////////////////////////////////
+class posix_base {
+public:
+	inline void close_i();
+	inline void truncate_i(stream_size_type bytes);
+	inline bool is_open() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map the first bytes of the open file into memory read-only,
+	/// advising the kernel of the access pattern given by the cache hint.
+	/// \returns The mapping, or null if the file cannot be mapped.
+	///////////////////////////////////////////////////////////////////////////
+	inline const char * map_i(stream_size_type bytes);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Release a mapping returned by map_i.
+	///////////////////////////////////////////////////////////////////////////
+	inline void unmap_i(const char * data, stream_size_type bytes);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Check the global errno variable and throw an exception that
+	/// matches its value.
+	///////////////////////////////////////////////////////////////////////////
+	static inline void throw_errno();
+
+	inline void set_cache_hint(cache_hint cacheHint);
+
+protected:
+	inline posix_base();
+	inline ~posix_base() {close_i();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Advise the kernel of the access pattern of the whole file
+	/// given by the cache hint. Called after opening the file.
+	///////////////////////////////////////////////////////////////////////////
+	inline void give_advice();
+
+	int m_fd;
+	cache_hint m_cacheHint;
+
+	/** Current file offset, as set by seek_i and advanced by transfers. */
+	stream_size_type m_offset;
+};
+
+}
+}
+
+#include <tpie/file_accessor/posix_base.inl>
+
+#endif //_TPIE_FILE_ACCESSOR_POSIX_BASE_H
@@ -0,0 +1,114 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2009, 2010, 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include <tpie/config.h>
+#include <string.h>
+#include <tpie/exception.h>
+#include <tpie/file_accessor/posix_base.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace tpie {
+namespace file_accessor {
+
+void posix_base::throw_errno() {
+	if (errno == ENOSPC) throw out_of_space_exception(strerror(errno));
+	else throw io_exception(strerror(errno));
+}
+
+posix_base::posix_base()
+	: m_fd(0)
+	, m_cacheHint(access_normal)
+	, m_offset(0)
+{
+}
+
+inline void posix_base::set_cache_hint(cache_hint cacheHint) {
+	m_cacheHint = cacheHint;
+}
+
+inline void posix_base::give_advice() {
+#ifndef __MACH__
+	int advice;
+	switch (m_cacheHint) {
+		case access_normal:
+			advice = POSIX_FADV_NORMAL;
+			break;
+		case access_sequential:
+			advice = POSIX_FADV_SEQUENTIAL;
+			break;
+		case access_random:
+			advice = POSIX_FADV_RANDOM;
+			break;
+		case access_direct:
+			advice = POSIX_FADV_SEQUENTIAL;
+			break;
+		default:
+			advice = POSIX_FADV_NORMAL;
+			break;
+	}
+	::posix_fadvise(m_fd, 0, 0, advice);
+#endif // __MACH__
+}
+
+bool posix_base::is_open() const {
+	return m_fd != 0;
+}
+
+inline const char * posix_base::map_i(stream_size_type bytes) {
+	if (static_cast<stream_size_type>(static_cast<size_t>(bytes)) != bytes) return 0;
+	void * data = ::mmap(0, static_cast<size_t>(bytes), PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) return 0;
+	int advice;
+	switch (m_cacheHint) {
+		case access_sequential:
+		case access_direct:
+			advice = MADV_SEQUENTIAL;
+			break;
+		case access_random:
+			advice = MADV_RANDOM;
+			break;
+		default:
+			advice = MADV_NORMAL;
+			break;
+	}
+	::madvise(data, static_cast<size_t>(bytes), advice);
+	return static_cast<const char *>(data);
+}
+
+inline void posix_base::unmap_i(const char * data, stream_size_type bytes) {
+	::munmap(const_cast<char *>(data), static_cast<size_t>(bytes));
+}
+
+void posix_base::close_i() {
+	if (m_fd != 0) {
+		::close(m_fd);
+	}
+	m_fd=0;
+}
+
+void posix_base::truncate_i(stream_size_type bytes) {
+	if (ftruncate(m_fd, bytes) == -1) throw_errno();
+}
+
+}
+}
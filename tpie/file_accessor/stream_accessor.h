@@ -27,6 +27,9 @@
 #include <tpie/file_accessor/file_accessor.h>
 #include <tpie/stream_header.h>
 #include <tpie/cache_hint.h>
+#include <tpie/compression.h>
+#include <tpie/memory.h>
+#include <vector>
 
 namespace tpie {
 namespace file_accessor {
@@ -63,6 +66,43 @@ private:
 	/** Path of the file currently opened. */
 	std::string m_path;
 
+	/** Read-only mapping of the file made by map_blocks, or null. */
+	const char * m_mapping;
+
+	/** Size (in bytes) of m_mapping. */
+	stream_size_type m_mappingSize;
+
+	/** Block codec to use for files created by open (see set_compression). */
+	memory_size_type m_newCompression;
+
+	/** Block codec identifier of the file currently opened. */
+	memory_size_type m_compression;
+
+	/** Header version of the file currently opened. New files get version 3
+	 * unless they are compressed. */
+	uint64_t m_headerVersion;
+
+	/** Block codec of the file currently opened, or null if its blocks are
+	 * not compressed. */
+	const block_codec * m_codec;
+
+	struct block_index_entry {
+		/** Size (in bytes) of the block on disk. Equal to the uncompressed
+		 * size if the codec could not shrink the block. */
+		uint64_t compressedSize;
+
+		/** Number of items in the block. */
+		uint64_t itemCount;
+	};
+
+	/** Size and item count of every block of a compressed stream. Stored on
+	 * disk after the last block when the stream is closed. */
+	std::vector<block_index_entry, allocator<block_index_entry> > m_blockIndex;
+
+	/** Buffer of m_blockSize bytes holding one compressed block, or null if
+	 * the stream is not compressed. */
+	char * m_compressionBuffer;
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Read stream header into the file accessor properties and
 	/// validate the type of the stream.
@@ -74,6 +114,19 @@ private:
 	///////////////////////////////////////////////////////////////////////////
 	inline void write_header(bool clean);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set up the codec of the file currently opened from
+	/// m_compression and read the block index of an existing file.
+	///////////////////////////////////////////////////////////////////////////
+	inline void open_codec(bool existing);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Offset of the block index, which follows the last block.
+	///////////////////////////////////////////////////////////////////////////
+	inline stream_size_type block_index_offset() const {
+		return header_size() + (m_size + m_blockItems - 1)/m_blockItems * m_blockSize;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Returns the boundary on which we align blocks.
 	///////////////////////////////////////////////////////////////////////////
@@ -89,11 +142,24 @@ private:
 	/// \brief The size of header and user data with padding included. This is
 	/// the offset at which the first logical block begins.
 	///////////////////////////////////////////////////////////////////////////
-	inline memory_size_type header_size() const { return align_to_boundary(sizeof(stream_header_t)+m_maxUserDataSize); }
+	inline memory_size_type header_size() const { return align_to_boundary(header_bytes()+m_maxUserDataSize); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Size of the header without user data. This is the offset of
+	/// the user data.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type header_bytes() const { return stream_header_t::size_on_disk(m_headerVersion); }
 public:
 	inline stream_accessor()
 		: m_open(false)
 		, m_write(false)
+		, m_mapping(0)
+		, m_mappingSize(0)
+		, m_newCompression(compression_none)
+		, m_compression(compression_none)
+		, m_headerVersion(stream_header_t::uncompressedVersionConst)
+		, m_codec(0)
+		, m_compressionBuffer(0)
 	{
 	}
 
@@ -112,11 +178,35 @@ public:
 
 	inline void close();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the block codec (see compression_scheme) used for files
+	/// that are created by subsequent calls to open. Existing files are read
+	/// and written with the codec recorded in their header.
+	///
+	/// Compressed blocks keep their place in the file, so seeking is as cheap
+	/// as for uncompressed streams, but only the compressed bytes of each
+	/// block are transferred. The size and item count of each block are kept
+	/// in a block index that is stored after the last block.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_compression(memory_size_type codec) {m_newCompression = codec;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Block codec of the file currently opened.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type compression() const {return m_compression;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used in addition to memory_usage() by a compressed
+	/// stream with the given block size.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type compression_memory_usage(memory_size_type blockSize) {return blockSize;}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Read the given number of items from the given block into the
 	/// given buffer.
 	/// \param data Buffer in which to store data. Must be able to hold at
-	/// least sizeof(T)*itemCount bytes.
+	/// least sizeof(T)*itemCount bytes, or an entire block if the stream is
+	/// compressed.
 	/// \param blockNumber Number of block in which to begin reading.
 	/// \param itemCount Number of items to read from beginning of given block.
 	/// Must be less than m_blockItems.
@@ -134,6 +224,19 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline void write_block(const void * data, stream_size_type blockNumber, memory_size_type itemCount);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map the blocks of a stream that is open for reading only into
+	/// memory, so they can be read without copying.
+	///
+	/// The mapping honours the cache hint given to open and is released when
+	/// the stream is closed.
+	/// \returns Pointer to the first byte of block 0; block n begins
+	/// n*blockSize bytes later. Null if the stream is empty, writable or
+	/// compressed, or if the file cannot be mapped, in which case read_block
+	/// must be used.
+	///////////////////////////////////////////////////////////////////////////
+	inline const char * map_blocks();
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Read user data into the given buffer.
 	/// \param data Buffer in which to store user data.
@@ -35,11 +35,18 @@ template <typename file_accessor_t>
 void stream_accessor<file_accessor_t>::read_header() {
 	stream_header_t header;
 	m_fileAccessor.seek_i(0);
-	m_fileAccessor.read_i(&header, sizeof(header));
+	m_fileAccessor.read_i(&header, stream_header_t::size_on_disk(stream_header_t::uncompressedVersionConst));
 	validate_header(header);
+	if (header.version == stream_header_t::uncompressedVersionConst) {
+		header.compression = compression_none;
+	} else {
+		m_fileAccessor.read_i(&header.compression, sizeof(header.compression));
+	}
 	m_size = header.size;
 	m_userDataSize = (size_t)header.userDataSize;
 	m_maxUserDataSize = (size_t)header.maxUserDataSize;
+	m_compression = (size_t)header.compression;
+	m_headerVersion = header.version;
 }
 
 template <typename file_accessor_t>
@@ -47,9 +54,27 @@ void stream_accessor<file_accessor_t>::write_header(bool clean) {
 	stream_header_t header;
 	fill_header(header, clean);
 	m_fileAccessor.seek_i(0);
-	m_fileAccessor.write_i(&header, sizeof(header));
+	m_fileAccessor.write_i(&header, stream_header_t::size_on_disk(header.version));
 }
  
+template <typename file_accessor_t>
+void stream_accessor<file_accessor_t>::open_codec(bool existing) {
+	m_codec = get_block_codec(m_compression);
+	if (m_compression == compression_none) return;
+	if (m_codec == 0) {
+		if (existing) throw invalid_file_exception("Invalid file, unknown block codec");
+		throw invalid_argument_exception("Unknown block codec");
+	}
+	m_compressionBuffer = tpie_new_array<char>(m_blockSize);
+	if (!existing) return;
+
+	m_blockIndex.resize(static_cast<size_t>((m_size + m_blockItems - 1)/m_blockItems));
+	if (!m_blockIndex.empty()) {
+		m_fileAccessor.seek_i(block_index_offset());
+		m_fileAccessor.read_i(&m_blockIndex[0], m_blockIndex.size()*sizeof(block_index_entry));
+	}
+}
+
 template <typename file_accessor_t>
 memory_size_type stream_accessor<file_accessor_t>::read_block(void * data, stream_size_type blockNumber, memory_size_type itemCount) {
 	stream_size_type loc = header_size() + blockNumber*m_blockSize;
@@ -57,7 +82,26 @@ memory_size_type stream_accessor<file_accessor_t>::read_block(void * data, strea
 	stream_size_type offset = blockNumber*m_blockItems;
 	if (offset + itemCount > m_size) itemCount = static_cast<memory_size_type>(m_size - offset);
 	memory_size_type z=itemCount*m_itemSize;
-	m_fileAccessor.read_i(data, z);
+	if (m_codec == 0) {
+		m_fileAccessor.read_i(data, z);
+		return itemCount;
+	}
+
+	// Blocks that were never written, e.g. when seeking past the end before
+	// writing, read as zeroes as they would in an uncompressed stream.
+	block_index_entry entry = {0, 0};
+	if (blockNumber < m_blockIndex.size()) entry = m_blockIndex[static_cast<size_t>(blockNumber)];
+	if (entry.itemCount > m_blockItems || entry.compressedSize > m_blockSize)
+		throw io_exception("Corrupt block index");
+	memory_size_type stored = static_cast<memory_size_type>(entry.itemCount)*m_itemSize;
+	memory_size_type compressed = static_cast<memory_size_type>(entry.compressedSize);
+	if (compressed == stored) {
+		m_fileAccessor.read_i(data, stored);
+	} else {
+		m_fileAccessor.read_i(m_compressionBuffer, compressed);
+		m_codec->decompress(m_compressionBuffer, compressed, m_itemSize, static_cast<char *>(data), stored);
+	}
+	if (stored < z) memset(static_cast<char *>(data) + stored, 0, z - stored);
 	return itemCount;
 }
 
@@ -70,7 +114,25 @@ void stream_accessor<file_accessor_t>::write_block(const void * data, stream_siz
 	m_fileAccessor.seek_i(loc);
 	stream_size_type offset = blockNumber*m_blockItems;
 	memory_size_type z=itemCount*m_itemSize;
-	m_fileAccessor.write_i(data, z);
+	if (m_codec == 0) {
+		m_fileAccessor.write_i(data, z);
+	} else {
+		// Only store the block compressed if that saves space.
+		memory_size_type compressed = 0;
+		if (z > 0)
+			compressed = m_codec->compress(static_cast<const char *>(data), z, m_itemSize, m_compressionBuffer, z - 1);
+		if (compressed == 0) {
+			m_fileAccessor.write_i(data, z);
+			compressed = z;
+		} else {
+			m_fileAccessor.write_i(m_compressionBuffer, compressed);
+		}
+		if (blockNumber >= m_blockIndex.size())
+			m_blockIndex.resize(static_cast<size_t>(blockNumber+1));
+		block_index_entry & entry = m_blockIndex[static_cast<size_t>(blockNumber)];
+		entry.compressedSize = compressed;
+		entry.itemCount = itemCount;
+	}
 	if (offset+itemCount > m_size) m_size=offset+itemCount;
 }
 
@@ -78,7 +140,7 @@ template <typename file_accessor_t>
 memory_size_type stream_accessor<file_accessor_t>::read_user_data(void * data, memory_size_type count) {
 	if (count > m_userDataSize) count = m_userDataSize;
 	if (count) {
-		m_fileAccessor.seek_i(sizeof(stream_header_t));
+		m_fileAccessor.seek_i(header_bytes());
 		m_fileAccessor.read_i(data, count);
 	}
 	return count;
@@ -89,7 +151,7 @@ void stream_accessor<file_accessor_t>::write_user_data(const void * data, memory
 	if (count > m_maxUserDataSize)
 		throw stream_exception("Tried to write more user data than stream allows");
 	if (count) {
-		m_fileAccessor.seek_i(sizeof(stream_header_t));
+		m_fileAccessor.seek_i(header_bytes());
 		m_fileAccessor.write_i(data, count);
 	}
 	m_userDataSize = count;
@@ -100,7 +162,8 @@ void stream_accessor<file_accessor_t>::validate_header(const stream_header_t & h
 	if (header.magic != stream_header_t::magicConst)
 		throw invalid_file_exception("Invalid file, header magic wrong");
 
-	if (header.version != stream_header_t::versionConst)
+	if (header.version != stream_header_t::versionConst
+		&& header.version != stream_header_t::uncompressedVersionConst)
 		throw invalid_file_exception("Invalid file, header version wrong");
 
 	if (header.itemSize != m_itemSize)
@@ -119,13 +182,14 @@ void stream_accessor<file_accessor_t>::validate_header(const stream_header_t & h
 template <typename file_accessor_t>
 void stream_accessor<file_accessor_t>::fill_header(stream_header_t & header, bool clean) {
 	header.magic = stream_header_t::magicConst;
-	header.version = stream_header_t::versionConst;
+	header.version = m_headerVersion;
 	header.itemSize = m_itemSize;
 	header.blockSize = m_blockSize;
 	header.cleanClose = clean?1:0;
 	header.userDataSize = m_userDataSize;
 	header.maxUserDataSize = m_maxUserDataSize;
 	header.size = m_size;
+	header.compression = m_compression;
 }
 
 template <typename file_accessor_t>
@@ -145,13 +209,19 @@ void stream_accessor<file_accessor_t>::open(const std::string & path,
 	m_userDataSize=0;
 	m_maxUserDataSize=maxUserDataSize;
 	m_size=0;
+	m_compression=m_newCompression;
+	m_headerVersion = m_compression == compression_none
+		? stream_header_t::uncompressedVersionConst
+		: stream_header_t::versionConst;
 	m_fileAccessor.set_cache_hint(cacheHint);
 	if (!write && !read)
 		throw invalid_argument_exception("Either read or write must be specified");
+	bool existing = true;
 	if (write && !read) {
 		m_fileAccessor.open_wo(path);
 		write_header(false);
 		write_user_data(0, 0);
+		existing = false;
 	} else if (!write && read) {
 		m_fileAccessor.open_ro(path);
 		read_header();
@@ -160,6 +230,7 @@ void stream_accessor<file_accessor_t>::open(const std::string & path,
 			m_fileAccessor.open_rw_new(path);
 			write_header(false);
 			write_user_data(0, 0);
+			existing = false;
 		} else {
 			read_header();
 			write_header(false);
@@ -167,6 +238,12 @@ void stream_accessor<file_accessor_t>::open(const std::string & path,
 	}
 	increment_open_file_count();
 	m_open = true;
+	try {
+		open_codec(existing);
+	} catch (...) {
+		close();
+		throw;
+	}
 	if (write && m_maxUserDataSize < maxUserDataSize) {
 		close();
 		throw invalid_file_exception("Invalid file, max user data size not large enough");
@@ -177,18 +254,56 @@ template <typename file_accessor_t>
 void stream_accessor<file_accessor_t>::close() {
 	if (!m_open)
 		return;
+	if (m_write && m_codec != 0) {
+		m_blockIndex.resize(static_cast<size_t>((m_size + m_blockItems - 1)/m_blockItems));
+		if (!m_blockIndex.empty()) {
+			m_fileAccessor.seek_i(block_index_offset());
+			m_fileAccessor.write_i(&m_blockIndex[0], m_blockIndex.size()*sizeof(block_index_entry));
+		}
+	}
 	if (m_write)
 		write_header(true);
+	std::vector<block_index_entry, allocator<block_index_entry> >().swap(m_blockIndex);
+	tpie_delete_array(m_compressionBuffer, m_blockSize);
+	m_compressionBuffer = 0;
+	m_codec = 0;
+	if (m_mapping != 0) {
+		m_fileAccessor.unmap_i(m_mapping, m_mappingSize);
+		m_mapping = 0;
+	}
 	m_fileAccessor.close_i();
 	decrement_open_file_count();
 	m_open = false;
 }
 
+template <typename file_accessor_t>
+const char * stream_accessor<file_accessor_t>::map_blocks() {
+	if (m_mapping == 0) {
+		if (!m_open || m_write || m_size == 0 || m_codec != 0) return 0;
+		// The last block is not padded on disk, so only map what exists.
+		stream_size_type bytes = header_size()
+			+ m_size/m_blockItems*m_blockSize
+			+ (m_size%m_blockItems)*m_itemSize;
+		m_mapping = m_fileAccessor.map_i(bytes);
+		if (m_mapping == 0) return 0;
+		m_mappingSize = bytes;
+	}
+	return m_mapping + header_size();
+}
+
 template <typename file_accessor_t>
 void stream_accessor<file_accessor_t>::truncate(stream_size_type items) {
 	stream_size_type blocks = items/m_blockItems;
 	stream_size_type blockIndex = items%m_blockItems;
 	stream_size_type bytes = header_size() + blocks*m_blockSize + blockIndex*m_itemSize;
+	if (m_codec != 0) {
+		// A compressed block cannot be cut short, so keep the last block
+		// whole; read_block only returns the items that remain.
+		if (blockIndex > 0) ++blocks;
+		bytes = header_size() + blocks*m_blockSize;
+		if (m_blockIndex.size() > blocks)
+			m_blockIndex.resize(static_cast<size_t>(blocks));
+	}
 	m_fileAccessor.truncate_i(bytes);
 	m_size = items;
 }
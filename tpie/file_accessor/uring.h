@@ -0,0 +1,178 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file uring.h  Linux io_uring file accessor
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_FILE_ACCESSOR_URING_H
+#define _TPIE_FILE_ACCESSOR_URING_H
+
+#include <tpie/file_accessor/stream_accessor.h>
+#include <tpie/file_accessor/posix_base.h>
+#include <tpie/memory.h>
+#include <boost/thread/tss.hpp>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace tpie {
+namespace file_accessor {
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief A thread's io_uring submission and completion queues.
+///
+/// Every transfer submitted through a ring is completed before the submitting
+/// call returns, so all uring accessors used by a thread share the ring of
+/// that thread. This costs one file descriptor per thread instead of one per
+/// open stream, which matters for merges with a large fanout.
+///////////////////////////////////////////////////////////////////////////////
+class uring_queue {
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the ring of the calling thread, setting it up on first
+	/// use, or null if the kernel refuses to set up a ring.
+	///////////////////////////////////////////////////////////////////////////
+	static inline uring_queue * get();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Free the ring of the calling thread, if any.
+	///
+	/// The ring of a thread is freed with tpie_delete when the thread exits,
+	/// which for the main thread happens after the memory manager is gone,
+	/// so tpie_finish calls this first.
+	///////////////////////////////////////////////////////////////////////////
+	static inline void release();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor for tpie_new; use get() to obtain a ring.
+	///////////////////////////////////////////////////////////////////////////
+	inline uring_queue();
+
+	inline ~uring_queue();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Transfer size bytes between data and fd at the given offset,
+	/// split into chunks that are submitted as a batch.
+	///
+	/// \param opcode IORING_OP_READ or IORING_OP_WRITE.
+	/// \returns The number of bytes transferred, or a smaller number if a
+	/// chunk came up short or the kernel refused the submission. In either
+	/// case no request is in flight when transfer returns.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type transfer(int opcode, int fd, stream_size_type offset,
+									 char * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Maximum number of requests in flight for a single transfer.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type queue_depth() {return 32;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Smallest chunk a transfer is split into.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type min_chunk_size() {return 64*1024;}
+
+private:
+	static inline boost::thread_specific_ptr<uring_queue> & queues();
+	static inline void destroy(uring_queue * q) {tpie_delete(q);}
+
+	inline bool setup();
+	inline void teardown();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for and discard the completions of inFlight requests.
+	///
+	/// \returns false if the kernel failed to report the completions, in
+	/// which case the ring must not be used again.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool reap(unsigned inFlight);
+
+	int m_ringFd;
+
+	void * m_sqRing;
+	size_t m_sqRingSize;
+	void * m_cqRing;
+	size_t m_cqRingSize;
+	io_uring_sqe * m_sqes;
+	size_t m_sqesSize;
+
+	unsigned * m_sqTail;
+	unsigned * m_sqMask;
+	unsigned * m_sqArray;
+	unsigned * m_cqHead;
+	unsigned * m_cqTail;
+	unsigned * m_cqMask;
+	io_uring_cqe * m_cqes;
+
+	/** Set when completions could not be reaped after a failed submission. */
+	bool m_unusable;
+
+	uring_queue(const uring_queue &);
+	uring_queue & operator=(const uring_queue &);
+};
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Linux io_uring file accessor.
+///
+/// Every read_i and write_i is split into up to bits::uring_queue::queue_depth()
+/// chunks that are submitted to the kernel in a single io_uring_enter call and
+/// waited for together, so a single block transfer keeps several requests in
+/// flight on devices that benefit from a deep queue, such as NVMe drives.
+///
+/// If the kernel refuses to set up a ring (for instance because io_uring is
+/// disabled or the process is out of file descriptors), the accessor falls
+/// back to pread and pwrite.
+///////////////////////////////////////////////////////////////////////////////
+
+class uring : public posix_base {
+public:
+	inline void open_ro(const std::string & path);
+	inline void open_wo(const std::string & path);
+	inline bool try_open_rw(const std::string & path);
+	inline void open_rw_new(const std::string & path);
+
+	inline void read_i(void * data, memory_size_type size);
+	inline void write_i(const void * data, memory_size_type size);
+	inline void seek_i(stream_size_type offset);
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Transfer size bytes between data and the file at m_offset
+	/// through the ring of the calling thread, or with pread and pwrite if
+	/// there is no ring.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type transfer(int opcode, char * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief pread/pwrite replacement for transfer().
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type transfer_sync(bool write, char * data, memory_size_type size);
+};
+
+}
+}
+
+#include <tpie/file_accessor/uring.inl>
+
+#endif //_TPIE_FILE_ACCESSOR_URING_H
@@ -0,0 +1,304 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include <tpie/config.h>
+#include <string.h>
+#include <tpie/exception.h>
+#include <tpie/file_count.h>
+#include <tpie/file_accessor/uring.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace tpie {
+namespace file_accessor {
+
+namespace bits {
+
+boost::thread_specific_ptr<uring_queue> & uring_queue::queues() {
+	static boost::thread_specific_ptr<uring_queue> q(destroy);
+	return q;
+}
+
+uring_queue * uring_queue::get() {
+	uring_queue * q = queues().get();
+	if (q == 0) {
+		q = tpie_new<uring_queue>();
+		queues().reset(q);
+		// Remember failure so we do not retry the setup on every transfer.
+		q->setup();
+	}
+	return (q->m_ringFd == -1 || q->m_unusable) ? 0 : q;
+}
+
+void uring_queue::release() {
+	queues().reset();
+}
+
+uring_queue::uring_queue()
+	: m_ringFd(-1)
+	, m_sqRing(0)
+	, m_sqRingSize(0)
+	, m_cqRing(0)
+	, m_cqRingSize(0)
+	, m_sqes(0)
+	, m_sqesSize(0)
+	, m_unusable(false)
+{
+}
+
+uring_queue::~uring_queue() {
+	teardown();
+}
+
+bool uring_queue::setup() {
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(queue_depth()), &p));
+	if (ringFd < 0) return false;
+	m_ringFd = ringFd;
+
+	m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+	m_sqRing = ::mmap(0, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+	if (m_sqRing == MAP_FAILED) {
+		m_sqRing = 0;
+		teardown();
+		return false;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		m_cqRing = m_sqRing;
+	} else {
+		m_cqRing = ::mmap(0, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+		if (m_cqRing == MAP_FAILED) {
+			m_cqRing = 0;
+			teardown();
+			return false;
+		}
+	}
+	m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+	void * sqes = ::mmap(0, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		teardown();
+		return false;
+	}
+	m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+	char * sq = static_cast<char *>(m_sqRing);
+	m_sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+	m_sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+	char * cq = static_cast<char *>(m_cqRing);
+	m_cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+	m_cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+	m_cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+	return true;
+}
+
+void uring_queue::teardown() {
+	if (m_sqes) ::munmap(m_sqes, m_sqesSize);
+	if (m_cqRing && m_cqRing != m_sqRing) ::munmap(m_cqRing, m_cqRingSize);
+	if (m_sqRing) ::munmap(m_sqRing, m_sqRingSize);
+	if (m_ringFd != -1) ::close(m_ringFd);
+	m_sqes = 0;
+	m_cqRing = 0;
+	m_sqRing = 0;
+	m_ringFd = -1;
+}
+
+memory_size_type uring_queue::transfer(int opcode, int fd, stream_size_type fileOffset,
+									   char * data, memory_size_type size) {
+	memory_size_type chunk = std::max(min_chunk_size(), (size + queue_depth() - 1) / queue_depth());
+	unsigned chunks = static_cast<unsigned>((size + chunk - 1) / chunk);
+
+	// The previous transfer was reaped completely, so the queues are empty.
+	unsigned tail = *m_sqTail;
+	for (unsigned i = 0; i < chunks; ++i) {
+		unsigned idx = tail & *m_sqMask;
+		io_uring_sqe & sqe = m_sqes[idx];
+		memset(&sqe, 0, sizeof(sqe));
+		memory_size_type offset = i * chunk;
+		sqe.opcode = static_cast<__u8>(opcode);
+		sqe.fd = fd;
+		sqe.off = fileOffset + offset;
+		sqe.addr = reinterpret_cast<unsigned long>(data + offset);
+		sqe.len = static_cast<unsigned>(std::min(chunk, size - offset));
+		sqe.user_data = i;
+		m_sqArray[idx] = idx;
+		++tail;
+	}
+	__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+	memory_size_type done = 0;
+	bool shortTransfer = false;
+	int error = 0;
+	unsigned toSubmit = chunks;
+	unsigned completed = 0;
+	while (completed < chunks) {
+		int r = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, toSubmit, chunks - completed,
+										   IORING_ENTER_GETEVENTS, 0, 0));
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			// The kernel may still be transferring into or out of data, so
+			// we must not unwind. Take back the chunks it has not consumed
+			// (the kernel only consumes entries inside io_uring_enter), wait
+			// for the rest and let the caller redo the transfer synchronously.
+			if (toSubmit > 0) {
+				tail -= toSubmit;
+				__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+				chunks -= toSubmit;
+				toSubmit = 0;
+			}
+			if (!reap(chunks - completed)) m_unusable = true;
+			return 0;
+		}
+		toSubmit -= std::min(toSubmit, static_cast<unsigned>(r));
+
+		unsigned head = *m_cqHead;
+		unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+		while (head != cqTail) {
+			io_uring_cqe & cqe = m_cqes[head & *m_cqMask];
+			memory_size_type offset = static_cast<memory_size_type>(cqe.user_data) * chunk;
+			memory_size_type expected = std::min(chunk, size - offset);
+			if (cqe.res < 0) error = -cqe.res;
+			else if (static_cast<memory_size_type>(cqe.res) != expected) shortTransfer = true;
+			else done += expected;
+			++head;
+			++completed;
+		}
+		__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	if (error) {
+		errno = error;
+		uring::throw_errno();
+	}
+	return shortTransfer ? 0 : done;
+}
+
+bool uring_queue::reap(unsigned inFlight) {
+	while (inFlight > 0) {
+		int r = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, 0, inFlight,
+										   IORING_ENTER_GETEVENTS, 0, 0));
+		if (r < 0) {
+			// Waiting without submitting only fails transiently on a live ring.
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+			return false;
+		}
+		unsigned head = *m_cqHead;
+		unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+		unsigned ready = cqTail - head;
+		inFlight -= std::min(inFlight, ready);
+		__atomic_store_n(m_cqHead, cqTail, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+} // namespace bits
+
+inline memory_size_type uring::transfer_sync(bool write, char * data, memory_size_type size) {
+	memory_size_type done = 0;
+	while (done < size) {
+		ssize_t n = write
+			? ::pwrite(m_fd, data + done, size - done, m_offset + done)
+			: ::pread(m_fd, data + done, size - done, m_offset + done);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			throw_errno();
+		}
+		if (n == 0) break;
+		done += n;
+	}
+	return done;
+}
+
+inline memory_size_type uring::transfer(int opcode, char * data, memory_size_type size) {
+	if (size == 0) return 0;
+	bits::uring_queue * q = bits::uring_queue::get();
+	if (q != 0) {
+		memory_size_type done = q->transfer(opcode, m_fd, m_offset, data, size);
+		if (done == size) return done;
+		// A chunk hit end of file or came up short, or the kernel refused
+		// the submission. Redo the transfer synchronously so the caller
+		// gets the exact byte count or the error.
+	}
+	return transfer_sync(opcode == IORING_OP_WRITE, data, size);
+}
+
+inline void uring::read_i(void * data, memory_size_type size) {
+	memory_size_type bytesRead = transfer(IORING_OP_READ, static_cast<char *>(data), size);
+	if (bytesRead != size)
+		throw io_exception("Wrong number of bytes read");
+	m_offset += size;
+	increment_bytes_read(size);
+}
+
+inline void uring::write_i(const void * data, memory_size_type size) {
+	// The kernel only reads from the buffer when writing.
+	if (transfer(IORING_OP_WRITE, const_cast<char *>(static_cast<const char *>(data)), size) != size)
+		throw io_exception("Wrong number of bytes written");
+	m_offset += size;
+	increment_bytes_written(size);
+}
+
+inline void uring::seek_i(stream_size_type size) {
+	m_offset = size;
+}
+
+void uring::open_wo(const std::string & path) {
+	m_fd = ::open(path.c_str(), O_RDWR | O_TRUNC | O_CREAT,  S_IRUSR | S_IWUSR);
+	if (m_fd == -1) throw_errno();
+	m_offset = 0;
+	give_advice();
+}
+
+void uring::open_ro(const std::string & path) {
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if (m_fd == -1) throw_errno();
+	m_offset = 0;
+	give_advice();
+}
+
+bool uring::try_open_rw(const std::string & path) {
+	m_fd = ::open(path.c_str(), O_RDWR);
+	if (m_fd == -1) {
+		if (errno != ENOENT) throw_errno();
+		return false;
+	}
+	m_offset = 0;
+	give_advice();
+	return true;
+}
+
+void uring::open_rw_new(const std::string & path) {
+	m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (m_fd == -1) throw_errno();
+	m_offset = 0;
+	give_advice();
+}
+
+}
+}
@@ -59,6 +59,18 @@ public:
 	inline void truncate_i(stream_size_type bytes);
 	inline bool is_open() const;
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map the first bytes of the open file into memory read-only,
+	/// advising the kernel of the access pattern given by the cache hint.
+	/// \returns The mapping, or null if the file cannot be mapped.
+	///////////////////////////////////////////////////////////////////////////
+	inline const char * map_i(stream_size_type bytes);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Release a mapping returned by map_i.
+	///////////////////////////////////////////////////////////////////////////
+	inline void unmap_i(const char * data, stream_size_type bytes);
+
 	inline void set_cache_hint(cache_hint cacheHint);
 };
 
@@ -72,6 +72,9 @@ void win32::set_cache_hint(cache_hint cacheHint) {
 		case access_random:
 			m_creationFlag = FILE_FLAG_RANDOM_ACCESS;
 			break;
+		case access_direct:
+			m_creationFlag = FILE_FLAG_SEQUENTIAL_SCAN;
+			break;
 	}
 }
 
@@ -103,6 +106,21 @@ bool win32::is_open() const {
 	return m_fd != INVALID_HANDLE_VALUE;
 }
 
+inline const char * win32::map_i(stream_size_type bytes) {
+	if (static_cast<stream_size_type>(static_cast<SIZE_T>(bytes)) != bytes) return 0;
+	HANDLE mapping = CreateFileMapping(m_fd, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping == NULL) return 0;
+	// The view keeps the mapping object alive after its handle is closed.
+	void * data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(bytes));
+	CloseHandle(mapping);
+	return static_cast<const char *>(data);
+}
+
+inline void win32::unmap_i(const char * data, stream_size_type bytes) {
+	unused(bytes);
+	UnmapViewOfFile(data);
+}
+
 void win32::close_i() {
 	if (m_fd != INVALID_HANDLE_VALUE) {
 		CloseHandle(m_fd);
@@ -96,7 +96,17 @@ public:
 	/// \brief Amount of memory used by a single block given the block factor.
 	///////////////////////////////////////////////////////////////////////////
 	static inline memory_size_type block_memory_usage(double blockFactor) {
-		return block_size(blockFactor);
+		return block_size(blockFactor) + aligned_buffer_overhead(block_alignment());
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Alignment of the memory address of block buffers.
+	///
+	/// Block buffers are aligned so that transfers of whole blocks satisfy
+	/// the requirements of unbuffered I/O (see access_direct).
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type block_alignment() throw () {
+		return 4096;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -125,6 +135,7 @@ public:
 	void read_user_data(TT & data) throw(stream_exception) {
 		assert(m_open);
 		if (sizeof(TT) != user_data_size()) throw io_exception("Wrong user data size");
+		self().wait_for_io();
 		m_fileAccessor->read_user_data(reinterpret_cast<void*>(&data), sizeof(TT));
 	}
 
@@ -137,6 +148,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	memory_size_type read_user_data(void * data, memory_size_type count) {
 		assert(m_open);
+		self().wait_for_io();
 		return m_fileAccessor->read_user_data(data, count);
 	}
 
@@ -152,6 +164,7 @@ public:
 	void write_user_data(const TT & data) throw(stream_exception) {
 		assert(m_open);
 		if (sizeof(TT) > max_user_data_size()) throw io_exception("Wrong user data size");
+		self().wait_for_io();
 		m_fileAccessor->write_user_data(reinterpret_cast<const void*>(&data), sizeof(TT));
 	}
 
@@ -166,6 +179,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void write_user_data(const void * data, memory_size_type count) {
 		assert(m_open);
+		self().wait_for_io();
 		m_fileAccessor->write_user_data(data, count);
 	}
 
@@ -196,6 +210,26 @@ public:
 		return m_fileAccessor->path();
 	}
 
+	/////////////////////////////////////////////////////////////////////////
+	/// \brief Set the block codec (see compression_scheme) used when open
+	/// creates a new file. Existing files are always accessed with the codec
+	/// they were created with.
+	///
+	/// A compressed stream needs an extra block of memory; see the
+	/// compressed parameter of file_stream::memory_usage.
+	/////////////////////////////////////////////////////////////////////////
+	void set_compression(memory_size_type codec) {
+		m_fileAccessor->set_compression(codec);
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+	/// \brief Block codec of the open file.
+	/////////////////////////////////////////////////////////////////////////
+	memory_size_type compression() const {
+		assert(m_open);
+		return m_fileAccessor->compression();
+	}
+
 	/////////////////////////////////////////////////////////////////////////
 	/// \brief Open a file.
 	///
@@ -285,6 +319,16 @@ protected:
 	file_base_crtp(memory_size_type itemSize, double blockFactor,
 				   file_accessor::file_accessor * fileAccessor);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for outstanding background I/O on the file accessor.
+	///
+	/// Called before the file accessor is used directly. Inheriting classes
+	/// that issue asynchronous block reads or writes must hide this method.
+	///////////////////////////////////////////////////////////////////////////
+	void wait_for_io() {
+		// Do nothing.
+	}
+
 
 	template <typename BT>
 	void read_block(BT & b, stream_size_type block);
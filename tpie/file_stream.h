@@ -22,6 +22,7 @@
 #include <tpie/file.h>
 #include <tpie/memory.h>
 #include <tpie/file_stream_base.h>
+#include <tpie/array_view.h>
 ///////////////////////////////////////////////////////////////////////////////
 /// \file tpie/file_stream.h
 /// \brief Simple class acting both as a tpie::file and a
@@ -131,6 +132,30 @@ public:
 		return reinterpret_cast<item_type*>(m_block.data)[m_index];
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Read the items remaining in the current block without copying
+	/// them.
+	///
+	/// Advances the stream position past the returned items. The view is
+	/// valid until the stream is used again.
+	///
+	/// \returns  At least one item; throws end_of_stream_exception at the end
+	/// of the stream.
+	///////////////////////////////////////////////////////////////////////////
+	array_view<const item_type> read_in_place() {
+		assert(m_open);
+		if (m_index >= m_block.size) {
+			update_block();
+			if (offset() >= size()) {
+				throw end_of_stream_exception();
+			}
+		}
+		const item_type * first = reinterpret_cast<item_type*>(m_block.data) + m_index;
+		memory_size_type items = m_block.size - m_index;
+		m_index = m_block.size;
+		return array_view<const item_type>(first, items);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Advance the stream position to the next item.
 	///////////////////////////////////////////////////////////////////////////
@@ -151,16 +176,26 @@ public:
 	/// \param blockFactor The block factor you pass to open.
 	/// \param includeDefaultFileAccessor Unless you are supplying your own
 	/// file accessor to open, leave this to be true.
+	/// \param asyncIO Whether the stream will use asynchronous block I/O (see
+	/// file_stream_base::set_async_io).
+	/// \param compressed Whether the stream will be compressed (see
+	/// set_compression).
 	/// \returns The amount of memory maximally used by the count file_streams.
 	///////////////////////////////////////////////////////////////////////////
 	inline static memory_size_type memory_usage(
 		float blockFactor=1.0,
-		bool includeDefaultFileAccessor=true) throw() {
+		bool includeDefaultFileAccessor=true,
+		bool asyncIO=false,
+		bool compressed=false) throw() {
 		// TODO
 		memory_size_type x = sizeof(file_stream);
 		x += block_memory_usage(blockFactor); // allocated in constructor
 		if (includeDefaultFileAccessor)
 			x += default_file_accessor::memory_usage();
+		if (asyncIO)
+			x += async_io_memory_usage(blockFactor);
+		if (compressed)
+			x += default_file_accessor::compression_memory_usage(block_size(blockFactor));
 		return x;
 	}
 
@@ -20,9 +20,149 @@
 #include <tpie/file_stream_base.h>
 #include <tpie/file_base_crtp.inl>
 #include <tpie/stream_crtp.inl>
+#include <tpie/tpie_log.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Background I/O thread and spare block buffers of a file_stream_base
+/// in asynchronous I/O mode.
+///
+/// A request consists of an optional block write followed by an optional
+/// block read, and the thread services one request at a time. The owning
+/// stream only touches the file accessor and the spare buffers while the
+/// thread is idle.
+///////////////////////////////////////////////////////////////////////////////
+class file_stream_base::async_io_t {
+public:
+	async_io_t(memory_size_type bufferSize)
+		: m_bufferSize(bufferSize)
+		, m_busy(false)
+		, m_kill(false)
+		, m_failed(false)
+		, m_outOfSpace(false)
+		, m_writePending(false)
+	{
+		readBuffer = tpie_new_aligned_buffer(m_bufferSize, block_alignment());
+		writeBuffer = tpie_new_aligned_buffer(m_bufferSize, block_alignment());
+		readBlock = std::numeric_limits<stream_size_type>::max();
+		readItems = 0;
+		boost::thread t(boost::bind(&async_io_t::worker, this));
+		m_thread.swap(t);
+	}
+
+	~async_io_t() {
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_kill = true;
+		m_cond.notify_all();
+		lock.unlock();
+		m_thread.join();
+		tpie_delete_aligned_buffer(readBuffer, m_bufferSize, block_alignment());
+		tpie_delete_aligned_buffer(writeBuffer, m_bufferSize, block_alignment());
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Hand a request to the background thread. The thread must be
+	/// idle.
+	///
+	/// \param accessor The file accessor to use.
+	/// \param writeItems Number of items in writeBuffer to write to
+	/// writeBlock, or zero to skip the write.
+	/// \param prefetch True if readItems items of readBlock should be read
+	/// into readBuffer.
+	///////////////////////////////////////////////////////////////////////////
+	void issue(file_accessor::file_accessor * accessor,
+			   stream_size_type writeBlock, memory_size_type writeItems,
+			   bool prefetch) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		assert(!m_busy);
+		m_accessor = accessor;
+		m_writeBlock = writeBlock;
+		m_writeItems = writeItems;
+		m_writePending = writeItems > 0;
+		m_prefetch = prefetch;
+		m_busy = true;
+		m_cond.notify_all();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait until the background thread is idle.
+	///
+	/// \returns True if the request that just finished contained a write.
+	///////////////////////////////////////////////////////////////////////////
+	bool wait() {
+		boost::mutex::scoped_lock lock(m_mutex);
+		while (m_busy) m_cond.wait(lock);
+		bool wrote = m_writePending;
+		m_writePending = false;
+		if (m_failed) {
+			m_failed = false;
+			readBlock = std::numeric_limits<stream_size_type>::max();
+			if (m_outOfSpace) throw out_of_space_exception(m_error);
+			throw io_exception(m_error);
+		}
+		return wrote;
+	}
+
+	/** Buffer holding the block read ahead. */
+	char * readBuffer;
+	/** Block number read ahead, or maxint if readBuffer holds no block. */
+	stream_size_type readBlock;
+	/** Number of items read ahead. */
+	memory_size_type readItems;
+	/** Buffer holding the block being written behind. */
+	char * writeBuffer;
+
+private:
+	void worker() {
+		boost::mutex::scoped_lock lock(m_mutex);
+		for (;;) {
+			while (!m_busy && !m_kill) m_cond.wait(lock);
+			if (m_kill) break;
+			lock.unlock();
+			try {
+				if (m_writeItems > 0)
+					m_accessor->write_block(writeBuffer, m_writeBlock, m_writeItems);
+				if (m_prefetch &&
+					m_accessor->read_block(readBuffer, readBlock, readItems) != readItems)
+					throw io_exception("Incorrect number of items read");
+			} catch (out_of_space_exception & e) {
+				lock.lock();
+				m_failed = m_outOfSpace = true;
+				m_error = e.what();
+				lock.unlock();
+			} catch (std::exception & e) {
+				lock.lock();
+				m_failed = true;
+				m_outOfSpace = false;
+				m_error = e.what();
+				lock.unlock();
+			}
+			lock.lock();
+			m_busy = false;
+			m_cond.notify_all();
+		}
+	}
+
+	memory_size_type m_bufferSize;
+	boost::thread m_thread;
+	boost::mutex m_mutex;
+	boost::condition_variable m_cond;
+	bool m_busy;
+	bool m_kill;
+	bool m_failed;
+	bool m_outOfSpace;
+	std::string m_error;
+
+	file_accessor::file_accessor * m_accessor;
+	stream_size_type m_writeBlock;
+	memory_size_type m_writeItems;
+	bool m_writePending;
+	bool m_prefetch;
+};
+
 file_stream_base::file_stream_base(memory_size_type itemSize,
 								   double blockFactor,
 								   file_accessor::file_accessor * fileAccessor):
@@ -33,18 +173,121 @@ file_stream_base::file_stream_base(memory_size_type itemSize,
 	m_nextIndex = std::numeric_limits<memory_size_type>::max();
 	m_index = std::numeric_limits<memory_size_type>::max();
 	m_block.data = 0;
+	m_asyncIO = 0;
+	m_mmapEnabled = false;
+	m_mapped = 0;
+}
+
+void file_stream_base::set_async_io(bool enabled) {
+	if (enabled == (m_asyncIO != 0)) return;
+	if (enabled) {
+		m_asyncIO = tpie_new<async_io_t>(m_itemSize * m_blockItems);
+	} else {
+		try {
+			wait_for_async_io();
+		} catch (...) {
+			tpie_delete(m_asyncIO);
+			m_asyncIO = 0;
+			throw;
+		}
+		tpie_delete(m_asyncIO);
+		m_asyncIO = 0;
+	}
+}
+
+void file_stream_base::end_async_io() throw() {
+	if (m_asyncIO == 0) return;
+	try {
+		wait_for_async_io();
+	} catch (std::exception & e) {
+		log_error() << "Asynchronous I/O of a stream failed before it was closed: "
+					<< e.what() << std::endl;
+	}
+	tpie_delete(m_asyncIO);
+	m_asyncIO = 0;
+}
+
+memory_size_type file_stream_base::async_io_memory_usage(double blockFactor) {
+	return sizeof(async_io_t) + 2 * block_memory_usage(blockFactor);
+}
+
+void file_stream_base::wait_for_async_io() {
+	if (m_asyncIO->wait() && m_tempFile)
+		m_tempFile->update_recorded_size(m_fileAccessor->byte_size());
+}
+
+void file_stream_base::discard_read_ahead() {
+	wait_for_async_io();
+	m_asyncIO->readBlock = std::numeric_limits<stream_size_type>::max();
 }
 
 void file_stream_base::get_block(stream_size_type block) {
 	get_block_check(block);
+	if (m_mapped != 0) {
+		m_block.dirty = false;
+		m_block.number = block;
+		m_block.size = static_cast<memory_size_type>(
+			std::min<stream_size_type>(m_blockItems, m_size - block * m_blockItems));
+		// The stream is read-only, so the block is never written through.
+		m_block.data = const_cast<char *>(m_mapped) + block * m_blockSize;
+		return;
+	}
 	read_block(m_block, block);
 }
 
 void file_stream_base::update_block_core() {
+	if (m_asyncIO && m_mapped == 0) {
+		update_block_async();
+		return;
+	}
 	flush_block();
 	get_block(m_nextBlock);
 }
 
+void file_stream_base::update_block_async() {
+	async_io_t & a = *m_asyncIO;
+	wait_for_async_io();
+	update_vars();
+
+	stream_size_type block = m_nextBlock;
+	stream_size_type blockStart = block * m_blockItems;
+	memory_size_type items = 0;
+	if (blockStart < m_size)
+		items = static_cast<memory_size_type>(
+			std::min<stream_size_type>(m_blockItems, m_size - blockStart));
+
+	bool readAhead = a.readBlock == block && a.readItems == items;
+	stream_size_type writeBlock = 0;
+	memory_size_type writeItems = 0;
+	if (readAhead || blockStart == m_size) {
+		// The new block is either in the read-ahead buffer or past the end of
+		// the file, so the evicted block can be written in the background.
+		if (m_block.dirty) {
+			std::swap(m_block.data, a.writeBuffer);
+			writeBlock = m_block.number;
+			writeItems = m_block.size;
+			m_block.dirty = false;
+		}
+		if (readAhead) std::swap(m_block.data, a.readBuffer);
+		m_block.number = block;
+		m_block.size = items;
+	} else {
+		flush_block();
+		get_block(block);
+	}
+	a.readBlock = std::numeric_limits<stream_size_type>::max();
+
+	bool prefetch = false;
+	if (m_canRead && blockStart + m_blockItems < m_size) {
+		a.readBlock = block + 1;
+		a.readItems = static_cast<memory_size_type>(
+			std::min<stream_size_type>(m_blockItems, m_size - blockStart - m_blockItems));
+		prefetch = true;
+	}
+	if (prefetch || writeItems > 0)
+		a.issue(m_fileAccessor, writeBlock, writeItems, prefetch);
+}
+
 template class stream_crtp<file_stream_base>;
 template class file_base_crtp<file_stream_base>;
 
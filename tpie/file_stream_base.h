@@ -47,14 +47,68 @@ public:
 	/// \brief Close the file and release resources.
 	///
 	/// This will close the file and resources used by buffers and such.
+	/// With asynchronous I/O, an error of the last background read or write
+	/// is rethrown here.
 	/////////////////////////////////////////////////////////////////////////
 	inline void close() throw(stream_exception) {
 		if (m_open) flush_block();
-		tpie_delete_array(m_block.data, m_itemSize * m_blockItems);
+		if (m_asyncIO) discard_read_ahead();
+		if (m_mapped == 0)
+			tpie_delete_aligned_buffer(m_block.data, m_itemSize * m_blockItems, block_alignment());
 		m_block.data = 0;
+		m_mapped = 0;
 		p_t::close();
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable memory-mapped reading. Takes effect the next
+	/// time the stream is opened.
+	///
+	/// When enabled and the stream is opened with access_read, the file is
+	/// mapped into memory and blocks are read directly from the mapping
+	/// instead of being copied into a block buffer. The cache hint passed to
+	/// open is forwarded to the kernel through madvise. If the file is empty
+	/// or cannot be mapped, the stream silently falls back to ordinary reads.
+	///////////////////////////////////////////////////////////////////////////
+	void set_memory_mapped(bool enabled) {
+		m_mmapEnabled = enabled;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether the open stream reads its blocks from a memory mapping.
+	///////////////////////////////////////////////////////////////////////////
+	bool memory_mapped() const {
+		return m_mapped != 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable asynchronous block I/O.
+	///
+	/// When enabled, the stream owns a background I/O thread and two extra
+	/// block buffers. Whenever the stream moves on to block n, block n+1 is
+	/// read into a spare buffer by the background thread, and the dirty block
+	/// being evicted is written out by the background thread as well, so
+	/// sequential scans overlap computation with I/O. Random access patterns
+	/// still work but gain nothing.
+	///
+	/// The extra memory is accounted for by file_stream::memory_usage when
+	/// asyncIO is passed as true.
+	///////////////////////////////////////////////////////////////////////////
+	void set_async_io(bool enabled);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether asynchronous block I/O is enabled.
+	///////////////////////////////////////////////////////////////////////////
+	bool async_io() const {
+		return m_asyncIO != 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by the asynchronous block I/O state of a stream
+	/// with the given block factor.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type async_io_memory_usage(double blockFactor);
+
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \copydoc file_base::truncate()
@@ -66,6 +120,7 @@ public:
 	inline void truncate(stream_size_type size) {
 		stream_size_type o=offset();
 		flush_block();
+		if (m_asyncIO) discard_read_ahead();
 		m_block.number = std::numeric_limits<stream_size_type>::max();
 		m_nextBlock = std::numeric_limits<stream_size_type>::max();
 		m_nextIndex = std::numeric_limits<memory_size_type>::max();
@@ -83,11 +138,16 @@ protected:
 					 file_accessor::file_accessor * fileAccessor);
 
 	inline ~file_stream_base() {
+		// An error of the background I/O cannot be thrown from here. Call
+		// close() before destroying the stream to have it reported.
+		end_async_io();
 		close();
 	}
 
 	void swap(file_stream_base & other) {
 		using std::swap;
+		wait_for_io();
+		other.wait_for_io();
 		swap(m_index,           other.m_index);
 		swap(m_nextBlock,       other.m_nextBlock);
 		swap(m_nextIndex,       other.m_nextIndex);
@@ -106,6 +166,9 @@ protected:
 		swap(m_block.data,      other.m_block.data);
 		swap(m_ownedTempFile,   other.m_ownedTempFile);
 		swap(m_tempFile,        other.m_tempFile);
+		swap(m_asyncIO,         other.m_asyncIO);
+		swap(m_mmapEnabled,     other.m_mmapEnabled);
+		swap(m_mapped,          other.m_mapped);
 	}
 
 	inline void open_inner(const std::string & path,
@@ -122,7 +185,13 @@ protected:
 		m_block.size = 0;
 		m_block.number = std::numeric_limits<stream_size_type>::max();
 		m_block.dirty = false;
-		m_block.data = tpie_new_array<char>(m_blockItems * m_itemSize);
+		m_block.data = 0;
+
+		// Items are read in place, so every block must start suitably aligned.
+		if (m_mmapEnabled && accessType == access_read && m_blockSize % 16 == 0)
+			m_mapped = m_fileAccessor->map_blocks();
+		if (m_mapped == 0)
+			m_block.data = tpie_new_aligned_buffer(m_blockItems * m_itemSize, block_alignment());
 
 		initialize();
 		seek(0);
@@ -137,6 +206,7 @@ protected:
 	/// \brief Write block to disk.
 	///////////////////////////////////////////////////////////////////////////
 	inline void flush_block() {
+		wait_for_io();
 		if (m_block.dirty) {
 			assert(m_canWrite);
 			update_vars();
@@ -165,9 +235,41 @@ protected:
 	}
 
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the background I/O thread to finish its current
+	/// request, if asynchronous I/O is enabled.
+	///
+	/// Rethrows any exception raised by the background read or write.
+	///////////////////////////////////////////////////////////////////////////
+	inline void wait_for_io() {
+		if (m_asyncIO) wait_for_async_io();
+	}
+
 	block_t m_block;
 
 private:
+	class async_io_t;
+
+	/** Background I/O state, or null when asynchronous I/O is disabled. */
+	async_io_t * m_asyncIO;
+
+	/** Whether set_memory_mapped was enabled. */
+	bool m_mmapEnabled;
+
+	/** Start of block 0 in the memory mapping of the file, or null when the
+	 * stream is not memory mapped. */
+	const char * m_mapped;
+
+	void wait_for_async_io();
+	void discard_read_ahead();
+	void update_block_async();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Stop the background I/O thread, logging rather than throwing
+	/// an error of the last request.
+	///////////////////////////////////////////////////////////////////////////
+	void end_async_io() throw();
+
 	friend class stream_crtp<file_stream_base>;
 	file_stream_base & __file() {return *this;}
 	const file_stream_base & __file() const {return *this;}
@@ -174,6 +174,7 @@ public:
 		}
 		for (typename array<index_t>::iterator i=list.begin(); i != list.end(); ++i)
 			*i = std::numeric_limits<index_t>::max();
+		size = 0;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -322,6 +323,7 @@ public:
 	void clear() {
 		for (typename array<value_t>::iterator i=elements.begin(); i != elements.end(); ++i)
 			*i = unused;
+		size = 0;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -332,6 +334,7 @@ public:
 		size_t x=(99+static_cast<size_t>(static_cast<float>(element_count)*sc))|1;
 		while (!is_prime(x)) x -= 2;
 		elements.resize(x, unused);
+		size = 0;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -658,7 +661,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Clear hash map.
 	///////////////////////////////////////////////////////////////////////////
-	inline void clear() const {tbl.clear();}
+	inline void clear() {tbl.clear();}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -842,7 +845,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Clear hash set.
 	///////////////////////////////////////////////////////////////////////////
-	inline void clear() const {tbl.clear();}
+	inline void clear() {tbl.clear();}
 };
 
 
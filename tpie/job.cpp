@@ -23,8 +23,10 @@
 
 #include <tpie/job.h>
 #include <tpie/array.h>
-#include <tpie/internal_queue.h>
 #include <tpie/exception.h>
+#include <boost/thread/tss.hpp>
+#include <boost/bind.hpp>
+#include <deque>
 
 namespace tpie {
  
@@ -33,22 +35,50 @@ namespace tpie {
 ///////////////////////////////////////////////////////////////////////////////
 class job_manager * the_job_manager = 0;
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Work stealing job manager.
+///
+/// Each worker thread has a deque of its own to which it pushes the jobs it
+/// enqueues and from which it takes jobs from the back, so a worker mostly
+/// touches its own deque and the cache-warm jobs it has just spawned. Idle
+/// workers steal the oldest job from the front of another deque. Jobs
+/// enqueued by other threads go to a shared deque that the workers steal
+/// from as well.
+///////////////////////////////////////////////////////////////////////////////
 class job_manager {
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief A deque of enqueued jobs and the mutex that guards it.
+	///////////////////////////////////////////////////////////////////////////
+	struct job_deque {
+		boost::mutex mutex;
+		std::deque<job *, allocator<job *> > jobs;
+		size_t index;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief When a deque holds this many jobs, enqueue runs the job
+	/// directly instead.
+	///////////////////////////////////////////////////////////////////////////
+	static const size_t max_queued_jobs = 128;
+
 public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Default constructor.
 	///////////////////////////////////////////////////////////////////////////
-	job_manager() : m_jobs(128), m_kill_job_pool(false) {}
+	job_manager() : m_kill_job_pool(false), m_sleepers(0) {}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Initialize the thread pool.
 	///////////////////////////////////////////////////////////////////////////
 	void init_pool(size_t threads) {
+		// The last deque is shared by threads outside the pool.
+		m_deques.resize(threads + 1);
+		for (size_t i = 0; i < m_deques.size(); ++i) m_deques[i].index = i;
 		m_thread_pool.resize(threads);
 		for (size_t i = 0; i < threads; ++i) {
-			boost::function<void()> f(worker);
+			boost::function<void()> f(boost::bind(worker, &m_deques[i]));
 			boost::thread t(f);
 			// thread is move-constructible
 			m_thread_pool[i].swap(t);
@@ -59,7 +89,7 @@ public:
 	/// \brief Notify all waiting workers, wait for them to quit.
 	///////////////////////////////////////////////////////////////////////////
 	void shutdown_pool() {
-		boost::mutex::scoped_lock lock(jobs_mutex);
+		boost::mutex::scoped_lock lock(m_sleep_mutex);
 		m_kill_job_pool = true;
 		m_has_data.notify_all();
 		lock.unlock();
@@ -70,42 +100,152 @@ public:
 
 private:
 
-	tpie::internal_queue<tpie::job *> m_jobs;
+	tpie::array<job_deque> m_deques;
 	tpie::array<boost::thread> m_thread_pool;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief The only mutex we will ever need.
+	/// \brief The deque of the calling worker thread, or null outside the
+	/// pool.
+	///////////////////////////////////////////////////////////////////////////
+	static boost::thread_specific_ptr<job_deque> current_deque;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Guards m_sleepers and m_kill_job_pool.
 	///////////////////////////////////////////////////////////////////////////
-	boost::mutex jobs_mutex;
+	boost::mutex m_sleep_mutex;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Notified when a job is added to the queue.
+	/// \brief Notified when a job is added while workers are sleeping.
 	///////////////////////////////////////////////////////////////////////////
 	boost::condition_variable m_has_data;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief True when the workers should quit ASAP.
 	///////////////////////////////////////////////////////////////////////////
-	bool m_kill_job_pool;
+	volatile bool m_kill_job_pool;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of workers waiting for m_has_data.
+	///////////////////////////////////////////////////////////////////////////
+	size_t m_sleepers;
+
+	static void no_cleanup(job_deque *) {}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The deque that jobs enqueued by the calling thread go to.
+	///////////////////////////////////////////////////////////////////////////
+	job_deque & own_deque() {
+		job_deque * d = current_deque.get();
+		return d ? *d : m_deques[m_deques.size() - 1];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Add a job to the deque of the calling thread.
+	/// \returns False if the deque is full.
+	///////////////////////////////////////////////////////////////////////////
+	bool push(job * j) {
+		job_deque & d = own_deque();
+		boost::mutex::scoped_lock lock(d.mutex);
+		if (d.jobs.size() >= max_queued_jobs) return false;
+		d.jobs.push_back(j);
+		lock.unlock();
+		// A worker looks for jobs under m_sleep_mutex before it goes to
+		// sleep, so it either sees this job or is counted in m_sleepers.
+		boost::mutex::scoped_lock sleepLock(m_sleep_mutex);
+		if (m_sleepers) m_has_data.notify_one();
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take any job. The newest job of the calling thread's own deque
+	/// is preferred; otherwise the oldest job of another deque is stolen.
+	///////////////////////////////////////////////////////////////////////////
+	job * take() {
+		job_deque * own = current_deque.get();
+		if (own) {
+			boost::mutex::scoped_lock lock(own->mutex);
+			if (!own->jobs.empty()) {
+				job * j = own->jobs.back();
+				own->jobs.pop_back();
+				return j;
+			}
+		}
+		size_t n = m_deques.size();
+		size_t first = own ? own->index + 1 : 0;
+		for (size_t i = 0; i < n; ++i) {
+			job_deque & d = m_deques[(first + i) % n];
+			if (&d == own) continue;
+			boost::mutex::scoped_lock lock(d.mutex);
+			if (!d.jobs.empty()) {
+				job * j = d.jobs.front();
+				d.jobs.pop_front();
+				return j;
+			}
+		}
+		return 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take a job that descends from the given ancestor, searching
+	/// the calling thread's own deque from the newest job first and the
+	/// other deques from the oldest job first.
+	///
+	/// Searching entire deques rather than just their ends ensures that a
+	/// thread joining a job never waits for a subjob that is not running.
+	///////////////////////////////////////////////////////////////////////////
+	job * take_descendant(job * ancestor) {
+		job_deque * own = current_deque.get();
+		if (own) {
+			boost::mutex::scoped_lock lock(own->mutex);
+			for (size_t i = own->jobs.size(); i > 0; --i) {
+				job * j = own->jobs[i-1];
+				if (!j->descends_from(ancestor)) continue;
+				own->jobs.erase(own->jobs.begin() + (i-1));
+				return j;
+			}
+		}
+		size_t n = m_deques.size();
+		size_t first = own ? own->index + 1 : 0;
+		for (size_t i = 0; i < n; ++i) {
+			job_deque & d = m_deques[(first + i) % n];
+			if (&d == own) continue;
+			boost::mutex::scoped_lock lock(d.mutex);
+			for (size_t k = 0; k < d.jobs.size(); ++k) {
+				job * j = d.jobs[k];
+				if (!j->descends_from(ancestor)) continue;
+				d.jobs.erase(d.jobs.begin() + k);
+				return j;
+			}
+		}
+		return 0;
+	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Worker thread entry point.
 	///////////////////////////////////////////////////////////////////////////
-	static void worker() {
-		for (;;) {
-			boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-			while (the_job_manager->m_jobs.empty() && !the_job_manager->m_kill_job_pool) the_job_manager->m_has_data.wait(lock);
-			if (the_job_manager->m_kill_job_pool) break;
-			tpie::job * j = the_job_manager->m_jobs.front();
-			the_job_manager->m_jobs.pop();
-			lock.unlock();
-			j->run();
+	static void worker(job_deque * d) {
+		job_manager * m = the_job_manager;
+		current_deque.reset(d);
+		while (!m->m_kill_job_pool) {
+			tpie::job * j = m->take();
+			if (j == 0) {
+				boost::mutex::scoped_lock lock(m->m_sleep_mutex);
+				if (m->m_kill_job_pool) break;
+				++m->m_sleepers;
+				while ((j = m->take()) == 0 && !m->m_kill_job_pool)
+					m->m_has_data.wait(lock);
+				--m->m_sleepers;
+			}
+			if (j) j->run();
 		}
+		current_deque.release();
 	};
 
 	friend class tpie::job;
 };
 
+boost::thread_specific_ptr<job_manager::job_deque> job_manager::current_deque(job_manager::no_cleanup);
+
 memory_size_type default_worker_count() {
 	memory_size_type workers = boost::thread::hardware_concurrency();
 	if (workers > 3) --workers; // spare a CPU for the UI
@@ -132,49 +272,60 @@ job::job()
 }
 
 void job::join() {
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-	while (m_dependencies) {
-		m_done.wait(lock);
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (!m_dependencies) return;
+		}
+		job * j = the_job_manager->take_descendant(this);
+		if (!j) break;
+		j->run();
 	}
+	// The remaining subjobs are running on other threads. A subjob they
+	// enqueue is taken by the thread that enqueued it, when it joins or
+	// returns to its worker loop, or by a worker woken by the enqueue,
+	// so it is safe to sleep until done() notifies us.
+	boost::mutex::scoped_lock lock(m_mutex);
+	while (m_dependencies) m_done.wait(lock);
 }
 
 bool job::is_done() {
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
+	boost::mutex::scoped_lock lock(m_mutex);
 	return !m_dependencies;
 }
 
 void job::enqueue(job * parent) {
+	boost::mutex::scoped_lock lock(m_mutex);
 	if (m_state != job_idle)
 		throw tpie::exception("Bad job state");
 
 	m_state = job_enqueued;
 
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
 	if (the_job_manager->m_kill_job_pool) throw job_manager_exception();
 	m_parent = parent;
 	m_dependencies = 1;
-	if (m_parent) ++m_parent->m_dependencies;
-	if (the_job_manager->m_jobs.full()) {
-		lock.unlock();
-		run();
-		return;
+	lock.unlock();
+	if (m_parent) {
+		boost::mutex::scoped_lock parentLock(m_parent->m_mutex);
+		++m_parent->m_dependencies;
 	}
-	the_job_manager->m_jobs.push(this);
-	the_job_manager->m_has_data.notify_one();
+	if (!the_job_manager->push(this)) run();
 }
 
 void job::run() {
+	boost::mutex::scoped_lock lock(m_mutex);
 	if (m_state != job_enqueued)
 		throw tpie::exception("Bad job state");
 
 	m_state = job_running;
+	lock.unlock();
 
 	(*this)();
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
 	done();
 }
 
 void job::done() {
+	boost::mutex::scoped_lock lock(m_mutex);
 	if (m_state != job_running)
 		throw tpie::exception("Bad job state");
 
@@ -183,10 +334,21 @@ void job::done() {
 
 	m_state = job_idle;
 
-	if (m_parent) m_parent->done();
-	m_done.notify_all();
 	on_done();
+	m_done.notify_all();
+	job * parent = m_parent;
+	lock.unlock();
+	// A joining thread may delete this job now, but not the parent, which
+	// is not done until we say so.
+	if (parent) parent->done();
 }
 
-} // namespace tpie
+bool job::descends_from(job * ancestor) {
+	// m_parent is constant while a job is enqueued, and the parent cannot
+	// finish before its subjobs.
+	for (job * j = this; j; j = j->m_parent)
+		if (j == ancestor) return true;
+	return false;
+}
 
+} // namespace tpie
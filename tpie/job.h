@@ -53,6 +53,10 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Wait for this job and its subjobs to complete.
+	///
+	/// While waiting, the calling thread runs this job and its subjobs if
+	/// they have not yet been picked up by a worker, so jobs may join their
+	/// subjobs without tying up a worker thread.
 	///////////////////////////////////////////////////////////////////////////
 	void join();
 
@@ -88,6 +92,11 @@ private:
 	job * m_parent;
 	job_state m_state;
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Guards m_dependencies, m_state and m_done.
+	///////////////////////////////////////////////////////////////////////////
+	boost::mutex m_mutex;
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Notified when this job and subjobs are done.
 	///////////////////////////////////////////////////////////////////////////
@@ -101,6 +110,12 @@ private:
 	///////////////////////////////////////////////////////////////////////////
 	void done();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return true if this job is the given job or one of its
+	/// subjobs.
+	///////////////////////////////////////////////////////////////////////////
+	bool descends_from(job * ancestor);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// The job manager needs to invoke run() on us.
 	///////////////////////////////////////////////////////////////////////////
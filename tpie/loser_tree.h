@@ -0,0 +1,224 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_LOSER_TREE_H__
+#define __TPIE_LOSER_TREE_H__
+#include <tpie/array.h>
+#include <tpie/util.h>
+#include <tpie/tpie_assert.h>
+#include <algorithm>
+#include <functional>
+namespace tpie {
+///////////////////////////////////////////////////////////////////////////////
+/// \file loser_tree.h
+/// \brief Tournament tree for k-way merging.
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class loser_tree
+/// \brief Tournament tree of losers over k sources, each holding its current
+/// item.
+///
+/// The internal nodes store the index of the source that lost the match at
+/// that node, and the winner of the entire tournament is the minimum. When
+/// the minimum is replaced by the next item from the same source, only the
+/// matches on the path from its leaf to the root are replayed, so this
+/// takes exactly ceil(log k) comparisons where a binary heap needs up to
+/// 2 log k. Items are never moved within the tree.
+///
+/// Sources that have no more items are exhausted, and lose every match.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename comp_t = std::less<T> >
+class loser_tree: public linear_memory_base< loser_tree<T, comp_t> > {
+public:
+	typedef memory_size_type size_type;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Construct a tree over k sources, which are all exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	loser_tree(size_type k = 0, comp_t c = comp_t())
+		: m_items(k)
+		, m_exhausted(k, 1)
+		, m_tree(k)
+		, m_winner(0)
+		, m_size(0)
+		, m_comp(c)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Change the number of sources. All sources become exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void resize(size_type k) {
+		m_items.resize(k);
+		m_exhausted.resize(k, 1);
+		m_tree.resize(k);
+		m_winner = 0;
+		m_size = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Mark all sources exhausted without changing their number.
+	///////////////////////////////////////////////////////////////////////////
+	void clear() {
+		std::fill(m_exhausted.begin(), m_exhausted.end(), 1);
+		m_winner = 0;
+		m_size = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the current item of source i, possibly destroying the
+	/// tournament. Call make_safe before using the tree.
+	///////////////////////////////////////////////////////////////////////////
+	void unsafe_set(size_type i, const T & item) {
+		tp_assert(i < m_items.size(), "Source index out of range");
+		m_items[i] = item;
+		if (m_exhausted[i]) {
+			m_exhausted[i] = 0;
+			++m_size;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the tournament after a sequence of calls to unsafe_set.
+	///////////////////////////////////////////////////////////////////////////
+	void make_safe() {
+		if (m_items.size() == 0) return;
+		m_winner = play(1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return true if all sources are exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() const {return m_size == 0;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the number of sources that are not exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	size_type size() const {return m_size;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the minimum item.
+	///////////////////////////////////////////////////////////////////////////
+	const T & top() const {
+		tp_assert(!empty(), "top() on empty loser_tree");
+		return m_items[m_winner];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the source of the minimum item.
+	///////////////////////////////////////////////////////////////////////////
+	size_type top_index() const {
+		tp_assert(!empty(), "top_index() on empty loser_tree");
+		return m_winner;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Replace the minimum item by the next item of the same source.
+	///////////////////////////////////////////////////////////////////////////
+	void pop_and_push(const T & item) {
+		tp_assert(!empty(), "pop_and_push() on empty loser_tree");
+		m_items[m_winner] = item;
+		replay();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the minimum item and mark its source exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		tp_assert(!empty(), "pop() on empty loser_tree");
+		m_exhausted[m_winner] = 1;
+		--m_size;
+		replay();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_coefficient()
+	/// \copydetails linear_memory_structure_doc::memory_coefficient()
+	///////////////////////////////////////////////////////////////////////////
+	inline static double memory_coefficient() {
+		return tpie::array<T>::memory_coefficient()
+			+ tpie::array<char>::memory_coefficient()
+			+ tpie::array<size_type>::memory_coefficient();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_overhead()
+	/// \copydetails linear_memory_structure_doc::memory_overhead()
+	///////////////////////////////////////////////////////////////////////////
+	inline static double memory_overhead() {
+		return tpie::array<T>::memory_overhead() - sizeof(tpie::array<T>)
+			+ tpie::array<char>::memory_overhead() - sizeof(tpie::array<char>)
+			+ tpie::array<size_type>::memory_overhead() - sizeof(tpie::array<size_type>)
+			+ sizeof(loser_tree);
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return true if source a wins the match against source b. Ties
+	/// are won by a.
+	///////////////////////////////////////////////////////////////////////////
+	bool wins(size_type a, size_type b) {
+		if (m_exhausted[b]) return true;
+		if (m_exhausted[a]) return false;
+		return !m_comp(m_items[b], m_items[a]);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the matches in the subtree of the given node, storing the
+	/// losers, and return the winner.
+	///
+	/// The tree is laid out as an implicit binary tree with internal nodes
+	/// 1 to k-1 and the leaf of source i at node k+i.
+	///////////////////////////////////////////////////////////////////////////
+	size_type play(size_type node) {
+		const size_type k = m_items.size();
+		if (node >= k) return node - k;
+		size_type a = play(2*node);
+		size_type b = play(2*node+1);
+		if (wins(a, b)) {
+			m_tree[node] = b;
+			return a;
+		}
+		m_tree[node] = a;
+		return b;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Replay the matches on the path from the leaf of the winner to
+	/// the root after its item has changed.
+	///////////////////////////////////////////////////////////////////////////
+	void replay() {
+		size_type winner = m_winner;
+		for (size_type node = (winner + m_items.size()) / 2; node > 0; node /= 2) {
+			if (wins(m_tree[node], winner)) std::swap(m_tree[node], winner);
+		}
+		m_winner = winner;
+	}
+
+	array<T> m_items;
+	array<char> m_exhausted;
+	array<size_type> m_tree;
+	size_type m_winner;
+	size_type m_size;
+	comp_t m_comp;
+};
+
+} // namespace tpie
+#endif // __TPIE_LOSER_TREE_H__
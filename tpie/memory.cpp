@@ -24,6 +24,8 @@
 #include "tpie_log.h"
 #include <cstring>
 #include <cstdlib>
+#include <cstddef>
+#include <boost/thread/tss.hpp>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -105,6 +107,19 @@ public:
 };
 #endif // !_WIN32
 
+///////////////////////////////////////////////////////////////////////////////
+/// \internal \brief The allocations of one thread that have not yet been
+/// added to the shared counter of the memory manager.
+///////////////////////////////////////////////////////////////////////////////
+struct memory_bucket {
+	memory_bucket() : manager(0), generation(0), pending(0) {}
+
+	memory_manager * manager;
+	size_t generation;
+	/** Bytes allocated minus bytes freed since the last flush. */
+	std::ptrdiff_t pending;
+};
+
 } // namespace bits
 
 inline void segfault() {
@@ -113,14 +128,76 @@ inline void segfault() {
 
 memory_manager * mm = 0;
 
-memory_manager::memory_manager(): m_used(new bits::atomic_int()), m_limit(0), m_maxExceeded(0), m_enforce(ENFORCE_WARN) {}
+#ifdef _WIN32
+#define TPIE_THREAD_LOCAL __declspec(thread)
+#else
+#define TPIE_THREAD_LOCAL __thread
+#endif
+
+namespace {
+
+// Fast access to the bucket of the calling thread. The bucket is owned by
+// bucket_owner, which flushes it when the thread exits.
+TPIE_THREAD_LOCAL bits::memory_bucket * thread_bucket = 0;
+
+// Distinguishes buckets of a finished memory manager from buckets of a new
+// one allocated at the same address.
+size_t manager_generation = 0;
+
+void flush_thread_bucket(bits::memory_bucket * bucket) {
+	if (mm != 0 && bucket->manager == mm) mm->flush(*bucket);
+	thread_bucket = 0;
+	delete bucket;
+}
+
+boost::thread_specific_ptr<bits::memory_bucket> bucket_owner(flush_thread_bucket);
+
+} // unnamed namespace
+
+const size_t memory_manager::bucket_size;
+
+memory_manager::memory_manager(): m_used(new bits::atomic_int()), m_generation(++manager_generation), m_limit(0), m_maxExceeded(0), m_enforce(ENFORCE_WARN) {}
+
+bits::memory_bucket & memory_manager::bucket() {
+	bits::memory_bucket * b = thread_bucket;
+	if (b == 0) {
+		b = new bits::memory_bucket();
+		bucket_owner.reset(b);
+		thread_bucket = b;
+	}
+	if (b->manager != this || b->generation != m_generation) {
+		b->manager = this;
+		b->generation = m_generation;
+		b->pending = 0;
+	}
+	return *b;
+}
+
+bits::memory_bucket * memory_manager::find_bucket() const {
+	bits::memory_bucket * b = thread_bucket;
+	if (b == 0 || b->manager != this || b->generation != m_generation) return 0;
+	return b;
+}
+
+void memory_manager::flush(bits::memory_bucket & bucket) {
+	if (bucket.manager != this || bucket.generation != m_generation) return;
+	std::ptrdiff_t pending = bucket.pending;
+	bucket.pending = 0;
+	if (pending > 0) m_used->add(static_cast<size_t>(pending));
+	else if (pending < 0) m_used->sub(static_cast<size_t>(-pending));
+}
 
 size_t memory_manager::used() const throw() {
-	return m_used->fetch();
+	// Other threads may have freed memory that this thread allocated and has
+	// not flushed yet, in which case the shared counter is below zero.
+	std::ptrdiff_t used = static_cast<std::ptrdiff_t>(m_used->fetch());
+	const bits::memory_bucket * b = find_bucket();
+	if (b != 0) used += b->pending;
+	return used > 0 ? static_cast<size_t>(used) : 0;
 }
 
 size_t memory_manager::available() const throw() {
-	size_t used = m_used->fetch();
+	size_t used = this->used();
 	size_t limit = m_limit;
 	if (used < limit) return limit-used;
 	return 0;
@@ -139,12 +216,24 @@ namespace {
 namespace tpie {
 
 void memory_manager::register_allocation(size_t bytes) {
+	bits::memory_bucket & b = bucket();
+	b.pending += static_cast<std::ptrdiff_t>(bytes);
+	if (b.pending < static_cast<std::ptrdiff_t>(bucket_size)) return;
+	size_t total = static_cast<size_t>(b.pending);
+	b.pending = 0;
+	add_usage(total, bytes);
+}
+
+void memory_manager::add_usage(size_t total, size_t bytes) {
 	switch(m_enforce) {
 	case ENFORCE_IGNORE:
-		m_used->add(bytes);
+		m_used->add(total);
 		break;
 	case ENFORCE_THROW: {
-		size_t usage = m_used->add_and_fetch(bytes);
+		// As in used(), the shared counter may be below zero.
+		std::ptrdiff_t fetched = static_cast<std::ptrdiff_t>(m_used->add_and_fetch(total));
+		if (fetched <= 0) break;
+		size_t usage = static_cast<size_t>(fetched);
 		if (usage > m_limit && m_limit > 0) {
 			std::stringstream ss;
 			print_memory_complaint(ss, bytes, usage, m_limit);
@@ -153,7 +242,9 @@ void memory_manager::register_allocation(size_t bytes) {
 		break; }
 	case ENFORCE_DEBUG:
 	case ENFORCE_WARN: {
-		size_t usage = m_used->add_and_fetch(bytes);
+		std::ptrdiff_t fetched = static_cast<std::ptrdiff_t>(m_used->add_and_fetch(total));
+		if (fetched <= 0) break;
+		size_t usage = static_cast<size_t>(fetched);
 		if (usage > m_limit && usage - m_limit > m_maxExceeded && m_limit > 0) {
 			m_maxExceeded = usage - m_limit;
 			if (m_maxExceeded >= m_nextWarning) {
@@ -168,16 +259,15 @@ void memory_manager::register_allocation(size_t bytes) {
 }
 
 void memory_manager::register_deallocation(size_t bytes) {
-#ifndef TPIE_NDEBUG
-	size_t usage = m_used->fetch_and_sub(bytes);
-	if (bytes > usage) {
-		log_error() << "Error in deallocation, trying to deallocate " << bytes << " bytes, while only " <<
-			usage << " were allocated" << std::endl;
-		segfault();
-	}
-#else
-	m_used->sub(bytes);
-#endif
+	// Mismatched frees are caught by unregister_pointer in debug builds. The
+	// shared counter cannot be checked here, since the memory may have been
+	// allocated by a thread that has not flushed its bucket yet.
+	bits::memory_bucket & b = bucket();
+	b.pending -= static_cast<std::ptrdiff_t>(bytes);
+	if (b.pending > -static_cast<std::ptrdiff_t>(bucket_size)) return;
+	size_t total = static_cast<size_t>(-b.pending);
+	b.pending = 0;
+	m_used->sub(total);
 }
 
 
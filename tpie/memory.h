@@ -37,6 +37,7 @@ namespace tpie {
 
 namespace bits {
 	class atomic_int;
+	struct memory_bucket;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -75,6 +76,11 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// Return the current amount of memory used.
+	///
+	/// Allocations are counted per thread and added to the shared counter in
+	/// batches of up to bucket_size bytes. The result is exact with respect
+	/// to the calling thread, and off by less than bucket_size for each
+	/// other thread that allocates or frees memory.
 	///////////////////////////////////////////////////////////////////////////
 	size_t used() const throw();
    
@@ -121,6 +127,21 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void register_deallocation(size_t bytes);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \internal
+	/// Add the allocations counted by a thread to the shared counter.
+	/// Called when the thread exits.
+	///////////////////////////////////////////////////////////////////////////
+	void flush(bits::memory_bucket & bucket);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// The number of bytes a thread may allocate or free before it updates
+	/// the shared counter. Allocations that reach this size update the
+	/// counter immediately, so the memory limit is enforced exactly for large
+	/// allocations, and within bucket_size per thread for small ones.
+	///////////////////////////////////////////////////////////////////////////
+	static const size_t bucket_size = 64*1024;
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \internal
 	/// Construct the memory manager object.
@@ -145,11 +166,16 @@ public:
 
 private:
 	std::auto_ptr<bits::atomic_int> m_used;
+	size_t m_generation;
 	size_t m_limit;
 	size_t m_maxExceeded;
 	size_t m_nextWarning;
 	enforce_t m_enforce;
 
+	bits::memory_bucket & bucket();
+	bits::memory_bucket * find_bucket() const;
+	void add_usage(size_t total, size_t bytes);
+
 #ifndef TPIE_NDEBUG
 	boost::mutex m_mutex;
 
@@ -389,6 +415,17 @@ inline void tpie_delete(T * p) throw() {
 		delete[] (pp - sizeof(size_t));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Deleter for smart pointers, such as boost::shared_ptr, that own an
+/// object allocated with tpie_new.
+///////////////////////////////////////////////////////////////////////////////
+struct tpie_deleter {
+	template <typename T>
+	void operator()(T * p) const throw() {
+		tpie_delete(p);
+	}
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Delete an array allocated with tpie_new_array.
 /// \param a The array to delete.
@@ -402,6 +439,43 @@ inline void tpie_delete_array(T * a, size_t size) throw() {
 	delete[] a;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Number of bytes allocated in addition to the requested size by
+/// tpie_new_aligned_buffer.
+///////////////////////////////////////////////////////////////////////////////
+inline size_t aligned_buffer_overhead(size_t alignment) {
+	return alignment + sizeof(char *);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Allocate an uninitialized buffer whose address is a multiple of
+/// the given alignment, and register the allocation with the memory manager.
+///
+/// \param size The number of bytes in the buffer.
+/// \param alignment The alignment, which must be a power of two of at least
+/// sizeof(char *).
+/// \returns The buffer, which must be freed with tpie_delete_aligned_buffer.
+///////////////////////////////////////////////////////////////////////////////
+inline char * tpie_new_aligned_buffer(size_t size, size_t alignment) {
+	char * raw = tpie_new_array<char>(size + aligned_buffer_overhead(alignment));
+	size_t addr = reinterpret_cast<size_t>(raw) + sizeof(char *);
+	char * buffer = reinterpret_cast<char *>((addr + alignment - 1) & ~(alignment - 1));
+	reinterpret_cast<char **>(buffer)[-1] = raw;
+	return buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Free a buffer allocated with tpie_new_aligned_buffer.
+///
+/// \param p The buffer, or null.
+/// \param size The size passed to tpie_new_aligned_buffer.
+/// \param alignment The alignment passed to tpie_new_aligned_buffer.
+///////////////////////////////////////////////////////////////////////////////
+inline void tpie_delete_aligned_buffer(char * p, size_t size, size_t alignment) throw() {
+	if (p == 0) return;
+	tpie_delete_array(reinterpret_cast<char **>(p)[-1], size + aligned_buffer_overhead(alignment));
+}
+
 template <typename T>
 struct auto_ptr_ref {
 	T * m_ptr;
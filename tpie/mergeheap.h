@@ -33,6 +33,7 @@
 #include <tpie/portability.h>
 #include <tpie/memory.h>
 #include <tpie/internal_priority_queue.h>
+#include <tpie/loser_tree.h>
 
 namespace tpie {
 	namespace ami {
@@ -252,6 +253,93 @@ namespace tpie {
 				merge_heap_op<REC, Compare>(cmp) {}
 		};
 
+		///////////////////////////////////////////////////////////////////////////
+		/// A merge heap replacement based on a loser tree, which needs a
+		/// single comparison per level of the tree in delete_min_and_insert().
+		/// Also serves as the full implementation for objects with a <
+		/// comparison operator.
+		///////////////////////////////////////////////////////////////////////////
+		template<class REC, class comp_t=std::less<REC> >
+		class merge_loser_tree_op {
+		private:
+			loser_tree<REC, comp_t> lt;
+
+		public:
+			merge_loser_tree_op(comp_t c=comp_t()): lt(0, c) {}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Reports the number of runs that are not exhausted.
+			///////////////////////////////////////////////////////////////////////////
+			size_t sizeofheap() {return lt.size();}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the run with the minimum key.
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t get_min_run_id() {return lt.top_index();}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Allocates space for the given number of runs.
+			///////////////////////////////////////////////////////////////////////////
+			void allocate(size_t size) {lt.resize(size);}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Copies the (initial) element of a run into the tree.
+			///////////////////////////////////////////////////////////////////////////
+			void insert(const REC *ptr, size_t run_id) {lt.unsafe_set(run_id, *ptr);}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Extracts the minimum element, exhausting its run.
+			/// If you follow this with an immediate insert, consider using
+			/// delete_min_and_insert().
+			///////////////////////////////////////////////////////////////////////////
+			void extract_min(REC& el, size_t& run_id) {
+				el=lt.top();
+				run_id=lt.top_index();
+				lt.pop();
+			}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Deallocates the space used by the tree.
+			///////////////////////////////////////////////////////////////////////////
+			void deallocate() {lt.resize(0);}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Plays the tournament of the initial elements.
+			///////////////////////////////////////////////////////////////////////////
+			void initialize(void) {lt.make_safe();}
+
+			///////////////////////////////////////////////////////////////////////////
+			// Deletes the current minimum and inserts the new item from the same
+			// source / run.
+			///////////////////////////////////////////////////////////////////////////
+			inline void delete_min_and_insert(const REC *nextelement_same_run) {
+				if (nextelement_same_run)
+					lt.pop_and_push(*nextelement_same_run);
+				else
+					lt.pop();
+			}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the  main memory space usage per item
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t space_per_item(void) {return static_cast<size_t>(lt.memory_coefficient());}
+
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the  fixed main memory space overhead, regardless of item count.
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t space_overhead(void) {return static_cast<size_t>(lt.memory_overhead());}
+		};
+
+		// ********************************************************************
+		// * A loser tree merge heap that uses a comparison object            *
+		// ********************************************************************
+		template<class REC, class Compare>
+		class merge_loser_tree_obj: public merge_loser_tree_op<REC, Compare> {
+		public:
+			merge_loser_tree_obj(Compare cmp):
+				merge_loser_tree_op<REC, Compare>(cmp) {}
+		};
+
 	}   //  ami namespace
 }  //  tpie namespace 
 
@@ -33,21 +33,27 @@
 #include <boost/thread/thread.hpp>
 #include <cmath>
 #include <functional>
+#include <vector>
 #include <tpie/progress_indicator_base.h>
 #include <tpie/dummy_progress.h>
 #include <tpie/internal_queue.h>
+#include <tpie/array.h>
 #include <tpie/job.h>
 #include <tpie/config.h>
+#include <tpie/radix_sort.h>
 
 namespace tpie {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief A simple parallel sort implementation with progress tracking.
-/// The partition step is sequential, as a parallel partition only speeds up
-/// the top layer, which does not warrant the hassle of implementation.
 /// Uses the TPIE job manager to transparently distribute work across the
 /// machine cores.
 /// Uses the pseudo median of nine as pivot.
+///
+/// Ranges large enough to keep several workers busy are partitioned in
+/// parallel, so the top layers of the recursion, which would otherwise be a
+/// sequential pass over the entire input, scale with the number of workers
+/// as well. Smaller ranges are partitioned sequentially.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename iterator_type, typename comp_type, bool Progress,
 		  size_t min_size=1024*1024*8/sizeof(typename boost::iterator_value<iterator_type>::type)>
@@ -148,6 +154,194 @@ private:
 					  median(a+step*6, a+step*7, b-1, comp), comp);
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predicate that is true for items less than the pivot.
+	///////////////////////////////////////////////////////////////////////////
+	struct less_than_pivot {
+		less_than_pivot(const value_type & pivot, comp_type comp) : pivot(pivot), comp(comp) {}
+		bool operator()(const value_type & x) {return comp(x, pivot);}
+		value_type pivot;
+		comp_type comp;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predicate that is true for items not greater than the pivot.
+	///////////////////////////////////////////////////////////////////////////
+	struct not_greater_than_pivot {
+		not_greater_than_pivot(const value_type & pivot, comp_type comp) : pivot(pivot), comp(comp) {}
+		bool operator()(const value_type & x) {return !comp(pivot, x);}
+		value_type pivot;
+		comp_type comp;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Partition one chunk of a range that is partitioned in
+	/// parallel.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename pred_t>
+	class chunk_partition_job : public job {
+	public:
+		void set(iterator_type a, iterator_type b, const pred_t & p) {
+			first = a;
+			last = b;
+			pred = &p;
+		}
+
+		virtual void operator()() {
+			pred_t p = *pred;
+			middle = std::partition(first, last, p);
+		}
+
+		iterator_type first;
+		iterator_type last;
+		iterator_type middle;
+		const pred_t * pred;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief A sequence of disjoint intervals of a range, given by their
+	/// offsets from the beginning of the range.
+	///////////////////////////////////////////////////////////////////////////
+	struct interval_list {
+		std::vector<std::pair<size_t, size_t> > intervals;
+		size_t total;
+
+		interval_list() : total(0) {}
+
+		void add(size_t a, size_t b) {
+			if (a >= b) return;
+			intervals.push_back(std::make_pair(a, b));
+			total += b - a;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Find the interval containing the i'th offset of the
+		/// sequence, and the offset itself.
+		///////////////////////////////////////////////////////////////////////
+		void locate(size_t i, size_t & interval, size_t & offset) const {
+			interval = 0;
+			while (i >= intervals[interval].second - intervals[interval].first) {
+				i -= intervals[interval].second - intervals[interval].first;
+				++interval;
+			}
+			offset = intervals[interval].first + i;
+		}
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Swap a part of the items that are on the wrong side of the
+	/// boundary after the chunks of a range have been partitioned.
+	///////////////////////////////////////////////////////////////////////////
+	class swap_job : public job {
+	public:
+		void set(iterator_type base, const interval_list & left, const interval_list & right,
+				 size_t begin, size_t end) {
+			this->base = base;
+			this->left = &left;
+			this->right = &right;
+			this->begin = begin;
+			this->end = end;
+		}
+
+		virtual void operator()() {
+			if (begin == end) return;
+			size_t li, lo, ri, ro;
+			left->locate(begin, li, lo);
+			right->locate(begin, ri, ro);
+			for (size_t n = end - begin; n > 0; --n) {
+				std::iter_swap(base + lo, base + ro);
+				if (++lo == left->intervals[li].second && n > 1) lo = left->intervals[++li].first;
+				if (++ro == right->intervals[ri].second && n > 1) ro = right->intervals[++ri].first;
+			}
+		}
+
+	private:
+		iterator_type base;
+		const interval_list * left;
+		const interval_list * right;
+		size_t begin;
+		size_t end;
+	};
+
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Partition [a,b) in parallel on the given number of chunks such
+	/// that the items for which pred is true come first.
+	///
+	/// Each chunk is partitioned by a job of its own. The items on the wrong
+	/// side of the final boundary then form a few intervals on each side,
+	/// and equally many are swapped across by each job.
+	///
+	/// \returns The boundary.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename pred_t>
+	static iterator_type parallel_partition(iterator_type a, iterator_type b, const pred_t & pred, size_t chunks) {
+		const size_t n = b - a;
+		array<chunk_partition_job<pred_t> > partitionJobs(chunks);
+		for (size_t i = 0; i < chunks; ++i) {
+			partitionJobs[i].set(a + n*i/chunks, a + n*(i+1)/chunks, pred);
+			partitionJobs[i].enqueue();
+		}
+		size_t boundary = 0;
+		for (size_t i = 0; i < chunks; ++i) {
+			partitionJobs[i].join();
+			boundary += partitionJobs[i].middle - partitionJobs[i].first;
+		}
+
+		// Items of the right part below the boundary, and items of the left
+		// part above it.
+		interval_list left;
+		interval_list right;
+		for (size_t i = 0; i < chunks; ++i) {
+			size_t first = partitionJobs[i].first - a;
+			size_t middle = partitionJobs[i].middle - a;
+			size_t last = partitionJobs[i].last - a;
+			left.add(middle, std::min(last, boundary));
+			right.add(std::max(first, boundary), middle);
+		}
+
+		array<swap_job> swapJobs(chunks);
+		for (size_t i = 0; i < chunks; ++i) {
+			swapJobs[i].set(a, left, right, left.total*i/chunks, left.total*(i+1)/chunks);
+			swapJobs[i].enqueue();
+		}
+		for (size_t i = 0; i < chunks; ++i) swapJobs[i].join();
+		return a + boundary;
+	}
+
+private:
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of chunks to partition [a,b) in parallel, or 1 if the
+	/// range should be partitioned sequentially.
+	///////////////////////////////////////////////////////////////////////////
+	static size_t partition_chunks(iterator_type a, iterator_type b) {
+		const size_t n = b - a;
+		const size_t minChunk = std::max(min_size, static_cast<size_t>(parallel_partition_min_chunk));
+		if (n < 2*minChunk) return 1;
+		return std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(default_worker_count()), n / minChunk));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Partition [a,b) in parallel into the items less than, equal to
+	/// and greater than a pivot returned by pick_pivot.
+	///
+	/// If the items less than the pivot are few, the items equal to it are
+	/// separated in a second pass, so that ranges of many equal items do not
+	/// degrade to quadratic running time.
+	///
+	/// \returns The range of items that are known to be equal to the pivot.
+	/// It is nonempty unless both sides are nonempty.
+	///////////////////////////////////////////////////////////////////////////
+	static inline std::pair<iterator_type, iterator_type> partition(iterator_type a, iterator_type b, comp_type & comp, size_t chunks) {
+		const value_type pivot = *pick_pivot(a, b, comp);
+		iterator_type l = parallel_partition(a, b, less_than_pivot(pivot, comp), chunks);
+		if (static_cast<size_t>(l - a) >= static_cast<size_t>(b - a) / 16)
+			return std::make_pair(l, l);
+		iterator_type h = parallel_partition(l, b, not_greater_than_pivot(pivot, comp), chunks);
+		return std::make_pair(l, h);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Partition using pivot returned by pick_pivot.
 	/// \param a Iterator to left boundary.
@@ -196,13 +390,20 @@ public:
 			assert(a <= b);
 			assert(&*a != 0);
 			while (static_cast<size_t>(b - a) >= min_size) {
-				iterator_type pivot = partition(a, b, comp);
+				std::pair<iterator_type, iterator_type> pivot;
+				size_t chunks = partition_chunks(a, b);
+				if (chunks > 1) {
+					pivot = partition(a, b, comp, chunks);
+				} else {
+					pivot.first = partition(a, b, comp);
+					pivot.second = pivot.first + 1;
+				}
 				add_progress(b - a);
 				//qsort_job * j = tpie_new<qsort_job>(a, pivot, comp, this);
-				qsort_job * j = new qsort_job(a, pivot, comp, this, progress);
+				qsort_job * j = new qsort_job(a, pivot.first, comp, this, progress);
 				j->enqueue(this);
 				children.push_back(j);
-				a = pivot+1;
+				a = pivot.second;
 			}
 			std::sort(a, b, comp);
 			add_progress(sortWork(b - a));
@@ -275,6 +476,8 @@ public:
 	}
 private:
 	static const size_t max_job_count=256;
+	// Smallest chunk of a range partitioned in parallel.
+	static const size_t parallel_partition_min_chunk=1024*256;
 	progress_t progress;
 	bool kill;
 	size_t working;
@@ -325,6 +528,38 @@ void parallel_sort(iterator_type a,
 #endif
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort items in the range [a,b) by an integer key using radix_sort.
+///
+/// Selected over the comparison sort when the predicate is a key_less, as
+/// returned by by_key().
+/// \param a Iterator to left boundary.
+/// \param b Iterator to right boundary.
+/// \param pi Progress tracker. No thread-safety required.
+/// \param comp Key predicate.
+///////////////////////////////////////////////////////////////////////////////
+template <bool Progress, typename iterator_type, typename key_fn_t>
+void parallel_sort(iterator_type a,
+				   iterator_type b,
+				   typename tpie::progress_types<Progress>::base & pi,
+				   key_less<key_fn_t> comp) {
+	pi.init(1);
+	radix_sort(a, b, comp);
+	pi.done();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort items in the range [a,b) by an integer key using radix_sort.
+/// \param a Iterator to left boundary.
+/// \param b Iterator to right boundary.
+/// \param comp Key predicate.
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_fn_t>
+void parallel_sort(iterator_type a,
+				   iterator_type b,
+				   key_less<key_fn_t> comp) {
+	radix_sort(a, b, comp);
+}
 
 }
 #endif //__TPIE_PARALLEL_SORT_H__
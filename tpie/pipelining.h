@@ -34,11 +34,13 @@
 #include <tpie/pipelining/pair_factory.h>
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/push_batch.h>
 #include <tpie/pipelining/virtual.h>
 
 // Library
 #include <tpie/pipelining/buffer.h>
 #include <tpie/pipelining/file_stream.h>
+#include <tpie/pipelining/hash_aggregate.h>
 #include <tpie/pipelining/helpers.h>
 #include <tpie/pipelining/join.h>
 #include <tpie/pipelining/merge.h>
@@ -18,7 +18,8 @@
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \file pipelining/buffer.h  Plain old file_stream buffer.
+/// \file pipelining/buffer.h  Buffers that store items in memory and spill
+/// them to a file_stream when the memory is used up.
 ///////////////////////////////////////////////////////////////////////////////
 
 #ifndef __TPIE_PIPELINING_BUFFER_H__
@@ -27,6 +28,8 @@
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/factory_helpers.h>
 #include <tpie/file_stream.h>
+#include <tpie/array.h>
+#include <boost/shared_ptr.hpp>
 
 namespace tpie {
 
@@ -34,6 +37,207 @@ namespace pipelining {
 
 namespace bits {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Stores items in an array and spills the items that do not fit to
+/// a file_stream. Shared by the input and output nodes of a buffer, which run
+/// in different phases.
+///
+/// The array is sized by the smaller of the memory assigned to the input
+/// and the output node, since it is held through both phases, unless the
+/// phases in between evacuate the input node. Evacuating appends the array
+/// to the file, so the file holds up to three segments: the items spilled
+/// before the evacuation, the items of the array, and the items pushed after
+/// the evacuation. The items can be read back in the order they were
+/// written, with read(), or in reverse, with read_back().
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class spill_buffer {
+public:
+	typedef boost::shared_ptr<spill_buffer> ptr;
+
+	spill_buffer()
+		: m_inputMemory(0)
+		, m_outputMemory(0)
+		, m_size(0)
+		, m_index(0)
+		, m_file(0)
+		, m_evacuatedBegin(0)
+		, m_evacuatedEnd(0)
+		, m_segment(0)
+	{
+	}
+
+	~spill_buffer() {
+		free();
+	}
+
+	static memory_size_type minimum_memory() {
+		return file_stream<T>::memory_usage();
+	}
+
+	void set_input_memory(memory_size_type memory) {
+		m_inputMemory = memory;
+	}
+
+	void set_output_memory(memory_size_type memory) {
+		m_outputMemory = memory;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Allocate the array. Called in begin() of the input node.
+	///////////////////////////////////////////////////////////////////////////
+	void begin() {
+		free();
+		memory_size_type memory = std::min(m_inputMemory, m_outputMemory);
+		memory_size_type reserved = minimum_memory() + sizeof(*this);
+		memory_size_type capacity = memory > reserved ? (memory - reserved) / sizeof(T) : 0;
+		m_items.resize(capacity);
+	}
+
+	void push(const T & item) {
+		if (m_size < m_items.size()) {
+			m_items[m_size++] = item;
+			return;
+		}
+		if (m_file == 0) {
+			m_file = tpie_new<file_stream<T> >();
+			m_file->open();
+		}
+		m_file->write(item);
+	}
+
+	stream_size_type size() const {
+		return m_size + (m_file != 0 ? m_file->size() : 0);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Prepare to read the items in the order they were written.
+	///////////////////////////////////////////////////////////////////////////
+	void rewind() {
+		m_index = 0;
+		m_segment = 0;
+		if (m_file != 0) m_file->seek(segment_begin(0));
+	}
+
+	bool can_read() const {
+		if (m_index < m_size) return true;
+		if (m_file == 0) return false;
+		if (m_file->offset() < segment_end(m_segment)) return true;
+		for (memory_size_type k = m_segment + 1; k < segments; ++k)
+			if (segment_begin(k) < segment_end(k)) return true;
+		return false;
+	}
+
+	const T & read() {
+		if (m_index < m_size) return m_items[m_index++];
+		while (m_file->offset() == segment_end(m_segment))
+			m_file->seek(segment_begin(++m_segment));
+		return m_file->read();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Prepare to read the items in reverse order.
+	///////////////////////////////////////////////////////////////////////////
+	void rewind_back() {
+		m_index = m_size;
+		m_segment = segments - 1;
+		if (m_file != 0) m_file->seek(segment_end(m_segment));
+	}
+
+	bool can_read_back() const {
+		return m_index > 0 || file_can_read_back();
+	}
+
+	const T & read_back() {
+		if (file_can_read_back()) {
+			while (m_file->offset() == segment_begin(m_segment))
+				m_file->seek(segment_end(--m_segment));
+			return m_file->read_back();
+		}
+		return m_items[--m_index];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Append the items in the array to the file and release the
+	/// array. Called when the phases between the input and the output node
+	/// need the memory.
+	///////////////////////////////////////////////////////////////////////////
+	void evacuate() {
+		if (m_size > 0) {
+			if (m_file == 0) {
+				m_file = tpie_new<file_stream<T> >();
+				m_file->open();
+			}
+			m_evacuatedBegin = m_file->size();
+			m_file->seek(0, file_stream<T>::end);
+			for (memory_size_type i = 0; i < m_size; ++i) m_file->write(m_items[i]);
+			m_evacuatedEnd = m_file->size();
+		}
+		m_items.resize(0);
+		m_size = m_index = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Release the array and the file. Called in end() of the output
+	/// node.
+	///////////////////////////////////////////////////////////////////////////
+	void free() {
+		m_items.resize(0);
+		m_size = m_index = 0;
+		m_evacuatedBegin = m_evacuatedEnd = 0;
+		if (m_file != 0) {
+			tpie_delete(m_file);
+			m_file = 0;
+		}
+	}
+
+private:
+	static const memory_size_type segments = 3;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Start of the k'th segment of the file in the order the items
+	/// were pushed: the evacuated items, then the items spilled before the
+	/// evacuation, then the items pushed after it. Without an evacuation,
+	/// the first two segments are empty.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type segment_begin(memory_size_type k) const {
+		switch (k) {
+			case 0: return m_evacuatedBegin;
+			case 1: return 0;
+			default: return m_evacuatedEnd;
+		}
+	}
+
+	stream_size_type segment_end(memory_size_type k) const {
+		switch (k) {
+			case 0: return m_evacuatedEnd;
+			case 1: return m_evacuatedBegin;
+			default: return m_file->size();
+		}
+	}
+
+	bool file_can_read_back() const {
+		if (m_file == 0) return false;
+		if (m_file->offset() > segment_begin(m_segment)) return true;
+		for (memory_size_type k = m_segment; k > 0; --k)
+			if (segment_begin(k-1) < segment_end(k-1)) return true;
+		return false;
+	}
+
+	memory_size_type m_inputMemory;
+	memory_size_type m_outputMemory;
+	array<T> m_items;
+	memory_size_type m_size;
+	memory_size_type m_index;
+	file_stream<T> * m_file;
+	stream_size_type m_evacuatedBegin;
+	stream_size_type m_evacuatedEnd;
+	memory_size_type m_segment;
+
+	spill_buffer(const spill_buffer &);
+	spill_buffer & operator=(const spill_buffer &);
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Input node for buffer.
 ///////////////////////////////////////////////////////////////////////////////
@@ -41,47 +245,63 @@ template <typename T>
 class buffer_input_t: public node {
 public:
 	typedef T item_type;
-	buffer_input_t(file_stream<T> & queue, const node_token & token)
+	buffer_input_t(spill_buffer<T> & queue, const node_token & token)
 		: node(token)
 		, queue(queue)
 	{
 		set_name("Storing items", PRIORITY_SIGNIFICANT);
-		set_minimum_memory(queue.memory_usage());
+		set_minimum_memory(queue.minimum_memory());
+		set_memory_fraction(1.0);
 	}
 
 	virtual void begin() override {
 		node::begin();
-		queue.open();
+		queue.begin();
 	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \copydoc node::push
 	///////////////////////////////////////////////////////////////////////////
 	void push(const item_type & item) {
-		queue.write(item);
+		queue.push(item);
+	}
+
+	virtual bool can_evacuate() override {
+		return true;
+	}
+
+	virtual void evacuate() override {
+		queue.evacuate();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		queue.set_input_memory(availableMemory);
 	}
 
 private:
-	file_stream<T> & queue;
+	spill_buffer<T> & queue;
 };
 
 template <typename T>
 class buffer_pull_output_t: public node {
-	file_stream<T> & queue;
+	spill_buffer<T> & queue;
 
 public:
 	typedef T item_type;
 
-	buffer_pull_output_t(file_stream<T> & queue, const node_token & input_token)
+	buffer_pull_output_t(spill_buffer<T> & queue, const node_token & input_token)
 		: queue(queue)
 	{
 		add_dependency(input_token);
 		set_name("Fetching items", PRIORITY_SIGNIFICANT);
-		set_minimum_memory(queue.memory_usage());
+		set_minimum_memory(queue.minimum_memory());
+		set_memory_fraction(1.0);
 	}
 
 	virtual void propagate() override {
-		queue.seek(0);
+		queue.rewind();
 		forward("items", queue.size());
 	}
 
@@ -94,7 +314,13 @@ public:
 	}
 
 	virtual void end() override {
-		queue.close();
+		queue.free();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		queue.set_output_memory(availableMemory);
 	}
 };
 
@@ -105,26 +331,46 @@ template <typename T>
 class delayed_buffer_input_t: public node {
 public:
 	typedef T item_type;
+	typedef typename spill_buffer<T>::ptr bufferptr;
 
-	delayed_buffer_input_t(const node_token & token)
+	delayed_buffer_input_t(const node_token & token, bufferptr buffer)
 		: node(token)
+		, m_buffer(buffer)
 	{
 		set_name("Storing items", PRIORITY_INSIGNIFICANT);
-		set_minimum_memory(tpie::file_stream<item_type>::memory_usage());
+		set_minimum_memory(spill_buffer<T>::minimum_memory());
+		set_memory_fraction(1.0);
 	}
 
-	virtual void propagate() override {
-		m_queue = tpie::tpie_new<tpie::file_stream<item_type> >();
-		m_queue->open();
-		forward("queue", m_queue);
+	virtual void begin() override {
+		node::begin();
+		m_buffer->begin();
 	}
 
 	void push(const T & item) {
-		m_queue->write(item);
+		m_buffer->push(item);
+	}
+
+	bufferptr get_buffer() const {
+		return m_buffer;
+	}
+
+	virtual bool can_evacuate() override {
+		return true;
+	}
+
+	virtual void evacuate() override {
+		m_buffer->evacuate();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_buffer->set_input_memory(availableMemory);
 	}
 
 private:
-	tpie::file_stream<T> * m_queue;
+	bufferptr m_buffer;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -134,37 +380,45 @@ template <typename dest_t>
 class delayed_buffer_output_t: public node {
 public:
 	typedef typename dest_t::item_type item_type;
+	typedef typename spill_buffer<item_type>::ptr bufferptr;
 
-	delayed_buffer_output_t(const dest_t &dest, const node_token & input_token)
+	delayed_buffer_output_t(const dest_t &dest, const node_token & input_token, bufferptr buffer)
 		: dest(dest)
+		, m_buffer(buffer)
 	{
 		add_dependency(input_token);
 		add_push_destination(dest);
-		set_minimum_memory(tpie::file_stream<item_type>::memory_usage());
+		set_minimum_memory(spill_buffer<item_type>::minimum_memory());
+		set_memory_fraction(1.0);
 		set_name("Fetching items", PRIORITY_INSIGNIFICANT);
 	}
 
 	virtual void propagate() override {
-		m_queue = fetch<tpie::file_stream<item_type> *>("queue");
-		forward("items", m_queue->size());
-		set_steps(m_queue->size());
+		forward("items", m_buffer->size());
+		set_steps(m_buffer->size());
 	}
 
 	virtual void go() override {
-		m_queue->seek(0);
-		while (m_queue->can_read()) {
-			dest.push(m_queue->read());
+		m_buffer->rewind();
+		while (m_buffer->can_read()) {
+			dest.push(m_buffer->read());
 			step();
 		}
 	}
 
 	virtual void end() override {
-		tpie::tpie_delete(m_queue);
+		m_buffer->free();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_buffer->set_output_memory(availableMemory);
 	}
 
 private:
 	dest_t dest;
-	file_stream<item_type> * m_queue;
+	bufferptr m_buffer;
 };
 
 
@@ -172,8 +426,9 @@ private:
 } // namespace bits
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Plain old file_stream buffer. Does nothing to the item stream, but
-/// it inserts a phase boundary.
+/// \brief Buffer that does nothing to the item stream, but inserts a phase
+/// boundary. The items are kept in memory if they fit, and otherwise spilled
+/// to a file_stream.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
 class passive_buffer {
@@ -182,8 +437,8 @@ public:
 	typedef bits::buffer_input_t<T> input_t;
 	typedef bits::buffer_pull_output_t<T> output_t;
 private:
-	typedef termfactory_2<input_t,  file_stream<T> &, const node_token &> inputfact_t;
-	typedef termfactory_2<output_t, file_stream<T> &, const node_token &> outputfact_t;
+	typedef termfactory_2<input_t,  bits::spill_buffer<T> &, const node_token &> inputfact_t;
+	typedef termfactory_2<output_t, bits::spill_buffer<T> &, const node_token &> outputfact_t;
 	typedef pipe_end      <inputfact_t>  inputpipe_t;
 	typedef pullpipe_begin<outputfact_t> outputpipe_t;
 
@@ -208,7 +463,7 @@ public:
 
 private:
 	node_token input_token;
-	file_stream<T> queue;
+	bits::spill_buffer<T> queue;
 
 	passive_buffer(const passive_buffer &);
 	passive_buffer & operator=(const passive_buffer &);
@@ -223,8 +478,8 @@ public:
 
 	delayed_buffer_t(const dest_t & dest)
 		: input_token()
-		, input(input_token)
-		, output(dest, input_token)
+		, input(input_token, typename input_t::bufferptr(new bits::spill_buffer<item_type>()))
+		, output(dest, input_token, input.get_buffer())
 	{
 		add_push_destination(input);
 		set_name("Delayed buffer", PRIORITY_INSIGNIFICANT);
@@ -24,6 +24,7 @@
 
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/push_batch.h>
 
 namespace tpie {
 
@@ -34,7 +35,7 @@ namespace bits {
 ///////////////////////////////////////////////////////////////////////////////
 /// \class input_t
 ///
-/// file_stream input generator.
+/// file_stream input generator. Pushes the items of each block as a batch.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename dest_t>
 class input_t : public node {
@@ -59,8 +60,9 @@ public:
 	virtual void go() override {
 		if (fs.is_open()) {
 			while (fs.can_read()) {
-				dest.push(fs.read());
-				step();
+				array_view<const item_type> items = fs.read_in_place();
+				push_items(dest, items);
+				step(items.size());
 			}
 		}
 	}
@@ -120,6 +122,10 @@ public:
 	inline void push(const T & item) {
 		fs.write(item);
 	}
+
+	void push_batch(array_view<const T> items) {
+		fs.write(items.begin(), items.end());
+	}
 private:
 	file_stream<T> & fs;
 };
@@ -168,6 +174,11 @@ public:
 			fs.write(i);
 			dest.push(i);
 		}
+
+		void push_batch(array_view<const item_type> items) {
+			fs.write(items.begin(), items.end());
+			push_items(dest, items);
+		}
 	private:
 		file_stream<item_type> & fs;
 		dest_t dest;
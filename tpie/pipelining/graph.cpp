@@ -20,6 +20,11 @@
 #include <tpie/pipelining/graph.h>
 #include <tpie/pipelining/tokens.h>
 #include <tpie/pipelining/node.h>
+#include <tpie/job.h>
+#include <tpie/memory.h>
+#include <tpie/stats.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace {
 
@@ -123,6 +128,208 @@ tpie::memory_size_type clamp(tpie::memory_size_type lo, tpie::memory_size_type h
 	return static_cast<tpie::memory_size_type>(v);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Progress indicator of one of several concurrent phases. Counts
+/// steps on its own and passes them on to the phase's subindicator with a
+/// lock shared by the phases, since the subindicators update the same
+/// fractional progress indicator.
+///////////////////////////////////////////////////////////////////////////////
+class locked_progress_indicator : public tpie::progress_indicator_base {
+public:
+	locked_progress_indicator()
+		: tpie::progress_indicator_base(0)
+		, m_target(0)
+		, m_mutex(0)
+		, m_reported(0)
+	{
+	}
+
+	void set(tpie::progress_indicator_base & target, boost::mutex & mutex) {
+		m_target = &target;
+		m_mutex = &mutex;
+	}
+
+	virtual void init(tpie::stream_size_type range) override {
+		{
+			boost::mutex::scoped_lock lock(*m_mutex);
+			m_target->init(range);
+			m_reported = 0;
+		}
+		tpie::progress_indicator_base::init(range);
+	}
+
+	virtual void done() override {
+		boost::mutex::scoped_lock lock(*m_mutex);
+		report();
+		m_target->done();
+	}
+
+	virtual void refresh() override {
+		boost::mutex::scoped_lock lock(*m_mutex);
+		report();
+	}
+
+	virtual void push_breadcrumb(const char * crumb, tpie::description_importance importance) override {
+		boost::mutex::scoped_lock lock(*m_mutex);
+		m_target->push_breadcrumb(crumb, importance);
+	}
+
+	virtual void pop_breadcrumb() override {
+		boost::mutex::scoped_lock lock(*m_mutex);
+		m_target->pop_breadcrumb();
+	}
+
+private:
+	void report() {
+		if (m_current <= m_reported) return;
+		m_target->step(m_current - m_reported);
+		m_reported = m_current;
+	}
+
+	tpie::progress_indicator_base * m_target;
+	boost::mutex * m_mutex;
+	tpie::stream_size_type m_reported;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs the initiators of a phase on the job pool.
+///////////////////////////////////////////////////////////////////////////////
+class phase_job : public tpie::job {
+public:
+	phase_job() : m_phase(0), m_initiators(0), m_failed(false), m_kind(other_error) {}
+
+	void set(tpie::pipelining::bits::phase & p) {
+		m_phase = &p;
+	}
+
+	virtual void operator()() override {
+		// Exceptions must not escape into the worker thread. Remember the
+		// kind of the error so that rethrow() raises the same type.
+		try {
+			m_initiators = m_phase->run_initiators();
+		} catch (const tpie::out_of_space_exception & e) {
+			fail(out_of_space_error, e.what());
+		} catch (const tpie::end_of_stream_exception & e) {
+			fail(end_of_stream_error, e.what());
+		} catch (const tpie::invalid_file_exception & e) {
+			fail(invalid_file_error, e.what());
+		} catch (const tpie::io_exception & e) {
+			fail(io_error, e.what());
+		} catch (const tpie::stream_exception & e) {
+			fail(stream_error, e.what());
+		} catch (const tpie::invalid_argument_exception & e) {
+			fail(invalid_argument_error, e.what());
+		} catch (const tpie::out_of_memory_error & e) {
+			fail(out_of_memory, e.what());
+		} catch (const std::bad_alloc & e) {
+			fail(bad_alloc_error, e.what());
+		} catch (const std::exception & e) {
+			fail(other_error, e.what());
+		} catch (...) {
+			fail(other_error, "Unknown exception");
+		}
+	}
+
+	locked_progress_indicator & progress() {
+		return m_progress;
+	}
+
+	size_t initiators() const {
+		return m_initiators;
+	}
+
+	bool failed() const {
+		return m_failed;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Rethrow the error raised by the phase, if any, in the calling
+	/// thread.
+	///////////////////////////////////////////////////////////////////////////
+	void rethrow() const {
+		if (!m_failed) return;
+		switch (m_kind) {
+			case out_of_space_error: throw tpie::out_of_space_exception(m_error);
+			case end_of_stream_error: throw tpie::end_of_stream_exception();
+			case invalid_file_error: throw tpie::invalid_file_exception(m_error);
+			case io_error: throw tpie::io_exception(m_error);
+			case stream_error: throw tpie::stream_exception(m_error);
+			case invalid_argument_error: throw tpie::invalid_argument_exception(m_error);
+			// out_of_memory_error does not copy its message.
+			case out_of_memory: throw tpie::out_of_memory_error("Memory limit exceeded in a concurrent phase");
+			case bad_alloc_error: throw std::bad_alloc();
+			case other_error: break;
+		}
+		throw tpie::exception(m_error);
+	}
+
+private:
+	enum error_kind {
+		out_of_space_error,
+		end_of_stream_error,
+		invalid_file_error,
+		io_error,
+		stream_error,
+		invalid_argument_error,
+		out_of_memory,
+		bad_alloc_error,
+		other_error
+	};
+
+	void fail(error_kind kind, const char * error) {
+		m_failed = true;
+		m_kind = kind;
+		m_error = error;
+	}
+
+	tpie::pipelining::bits::phase * m_phase;
+	locked_progress_indicator m_progress;
+	size_t m_initiators;
+	bool m_failed;
+	error_kind m_kind;
+	std::string m_error;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Samples the clock, the I/O counters and the memory usage, for
+/// measuring the cost of one call to a node.
+///////////////////////////////////////////////////////////////////////////////
+class stats_sample {
+public:
+	stats_sample()
+		: m_time(boost::posix_time::microsec_clock::universal_time())
+		, m_bytesRead(tpie::get_bytes_read())
+		, m_bytesWritten(tpie::get_bytes_written())
+		, m_memoryUsed(tpie::get_memory_manager().used())
+	{
+	}
+
+	double seconds() const {
+		boost::posix_time::time_duration d =
+			boost::posix_time::microsec_clock::universal_time() - m_time;
+		return static_cast<double>(d.total_microseconds()) / 1000000.0;
+	}
+
+	tpie::stream_size_type bytes_read() const {
+		return tpie::get_bytes_read() - m_bytesRead;
+	}
+
+	tpie::stream_size_type bytes_written() const {
+		return tpie::get_bytes_written() - m_bytesWritten;
+	}
+
+	tpie::memory_size_type memory_allocated() const {
+		tpie::memory_size_type used = tpie::get_memory_manager().used();
+		return used > m_memoryUsed ? used - m_memoryUsed : 0;
+	}
+
+private:
+	boost::posix_time::ptime m_time;
+	tpie::stream_size_type m_bytesRead;
+	tpie::stream_size_type m_bytesWritten;
+	tpie::memory_size_type m_memoryUsed;
+};
+
 } // default namespace
 
 namespace tpie {
@@ -155,6 +362,7 @@ phase::phase(const phase & other)
 	: itemFlowGraph(new node_graph(*other.itemFlowGraph))
 	, actorGraph(new node_graph(*other.actorGraph))
 	, m_nodes(other.m_nodes)
+	, m_initiators(other.m_initiators)
 {
 }
 
@@ -162,6 +370,7 @@ phase & phase::operator=(const phase & other) {
 	itemFlowGraph.reset(new node_graph(*other.itemFlowGraph));
 	actorGraph.reset(new node_graph(*other.actorGraph));
 	m_nodes = other.m_nodes;
+	m_initiators = other.m_initiators;
 	return *this;
 }
 
@@ -372,10 +581,14 @@ graph_traits::graph_traits(const node_map & map)
 }
 
 memory_size_type graph_traits::memory_usage(size_t phases) {
-	return phases * (sizeof(auto_ptr<Progress::sub>) + sizeof(Progress::sub));
+	return phases * (sizeof(auto_ptr<Progress::sub>) + sizeof(Progress::sub) + sizeof(phase_job));
 }
 
-void graph_traits::go_all(stream_size_type n, Progress::base & pi) {
+size_t graph_traits::concurrency(size_t phase) const {
+	return static_cast<size_t>(std::count(m_levels.begin(), m_levels.end(), m_levels[phase]));
+}
+
+void graph_traits::go_all(stream_size_type n, Progress::base & pi, bool concurrent) {
 	map.assert_authoritative();
 	Progress::fp fp(&pi);
 	array<auto_ptr<Progress::sub> > subindicators(m_phases.size());
@@ -388,9 +601,64 @@ void graph_traits::go_all(stream_size_type n, Progress::base & pi) {
 	}
 
 	fp.init();
-	for (size_t i = 0; i < m_phases.size(); ++i) {
-		if (m_evacuatePrevious[i]) m_phases[i-1].evacuate_all();
-		m_phases[i].go(*subindicators[i]);
+	if (!concurrent) {
+		for (size_t i = 0; i < m_phases.size(); ++i) {
+			if (m_evacuatePrevious[i]) m_phases[i-1].evacuate_all();
+			m_phases[i].go(*subindicators[i]);
+		}
+		fp.done();
+		return;
+	}
+
+	const size_t levels = m_phases.empty() ? 0
+		: *std::max_element(m_levels.begin(), m_levels.end()) + 1;
+	std::vector<size_t> previous;
+	for (size_t level = 0; level < levels; ++level) {
+		std::vector<size_t> current;
+		for (size_t i = 0; i < m_phases.size(); ++i) {
+			if (m_levels[i] == level) current.push_back(i);
+		}
+
+		// Evacuate the phases of the previous level that are not needed now.
+		for (size_t i = 0; i < previous.size(); ++i) {
+			bool needed = false;
+			for (size_t j = 0; j < current.size(); ++j) {
+				const std::vector<size_t> & deps = m_dependencies[current[j]];
+				if (std::find(deps.begin(), deps.end(), previous[i]) != deps.end()) needed = true;
+			}
+			if (!needed) m_phases[previous[i]].evacuate_all();
+		}
+		previous = current;
+
+		if (current.size() == 1) {
+			m_phases[current[0]].go(*subindicators[current[0]]);
+			continue;
+		}
+
+		log_debug() << "Run " << current.size() << " phases concurrently" << std::endl;
+		boost::mutex progressMutex;
+		array<phase_job> jobs(current.size());
+		for (size_t j = 0; j < current.size(); ++j) {
+			jobs[j].set(m_phases[current[j]]);
+			jobs[j].progress().set(*subindicators[current[j]], progressMutex);
+			m_phases[current[j]].begin_all(jobs[j].progress());
+		}
+		for (size_t j = 0; j < current.size(); ++j) jobs[j].enqueue();
+		for (size_t j = 0; j < current.size(); ++j) jobs[j].join();
+		// End the phases that succeeded before reporting the first error,
+		// so that their nodes clean up.
+		size_t failed = current.size();
+		for (size_t j = 0; j < current.size(); ++j) {
+			if (jobs[j].failed()) {
+				if (failed == current.size()) failed = j;
+				continue;
+			}
+			m_phases[current[j]].end_all(jobs[j].progress());
+		}
+		if (failed != current.size()) jobs[failed].rethrow();
+		for (size_t j = 0; j < current.size(); ++j) {
+			if (jobs[j].initiators() == 0) throw no_initiator_node();
+		}
 	}
 	fp.done();
 }
@@ -432,6 +700,8 @@ void graph_traits::calc_phases() {
 		std::vector<size_t> internalexec = g.execution_order();
 		m_phases.resize(internalexec.size());
 		m_evacuatePrevious.resize(internalexec.size(), false);
+		m_levels.resize(internalexec.size(), 0);
+		m_dependencies.resize(internalexec.size());
 
 		std::vector<bool>::iterator j = m_evacuatePrevious.begin();
 		for (size_t i = 0; i < internalexec.size(); ++i, ++j) {
@@ -440,6 +710,12 @@ void graph_traits::calc_phases() {
 			// first, insert phase representatives
 			m_phases[i].add(map.get(ids_inv[internalexec[i]]));
 			*j = i > 0 && !g.is_depending(internalexec[i], internalexec[i-1]);
+
+			for (size_t k = 0; k < i; ++k) {
+				if (!g.is_depending(internalexec[i], internalexec[k])) continue;
+				m_dependencies[i].push_back(k);
+				m_levels[i] = std::max(m_levels[i], m_levels[k] + 1);
+			}
 		}
 	}
 
@@ -489,9 +765,17 @@ void graph_traits::calc_phases() {
 }
 
 void phase::go(progress_indicator_base & pi) {
+	begin_all(pi);
+	size_t initiators = run_initiators();
+	end_all(pi);
+
+	if (initiators == 0)
+		throw no_initiator_node();
+}
+
+void phase::begin_all(progress_indicator_base & pi) {
 	std::vector<node *> propagateOrder;
 	std::vector<node *> beginOrder;
-	std::vector<node *> endOrder;
 	{
 		dfs_traversal<phase::node_graph> dfs(*itemFlowGraph);
 		dfs.dfs();
@@ -503,11 +787,6 @@ void phase::go(progress_indicator_base & pi) {
 		beginOrder = dfs.toposort();
 		std::reverse(beginOrder.begin(), beginOrder.end());
 	}
-	{
-		dfs_traversal<phase::node_graph> dfs(*actorGraph);
-		dfs.dfs();
-		endOrder = dfs.toposort();
-	}
 	stream_size_type totalSteps = 0;
 	for (size_t i = 0; i < propagateOrder.size(); ++i) {
 		if (propagateOrder[i]->get_state() != node::STATE_AFTER_PREPARE) {
@@ -525,33 +804,64 @@ void phase::go(progress_indicator_base & pi) {
 		if (beginOrder[i]->get_state() != node::STATE_AFTER_PROPAGATE) {
 			throw call_order_exception("Invalid state for begin");
 		}
+		node_stats & stats = beginOrder[i]->m_stats;
+		stats = node_stats();
+		stats.memoryAssigned = beginOrder[i]->get_available_memory();
 		beginOrder[i]->set_state(node::STATE_IN_BEGIN);
+		stats_sample sample;
 		beginOrder[i]->begin();
+		stats.beginTime = sample.seconds();
+		stats.bytesRead += sample.bytes_read();
+		stats.bytesWritten += sample.bytes_written();
+		stats.memoryUsed = sample.memory_allocated();
 		beginOrder[i]->set_state(node::STATE_AFTER_BEGIN);
 	}
 
-	size_t initiators = 0;
+	// Find the initiators here, since run_initiators may run in another
+	// thread, and is_initiator looks up the shared node map.
+	m_initiators.clear();
 	for (size_t i = 0; i < beginOrder.size(); ++i) {
 		if (!is_initiator(beginOrder[i])) continue;
 		log_debug() << "Execute initiator " << beginOrder[i]->get_name()
 			<< " (" << beginOrder[i]->get_id() << ")" << std::endl;
-		beginOrder[i]->go();
-		initiators++;
+		m_initiators.push_back(beginOrder[i]);
 	}
+}
 
+size_t phase::run_initiators() {
+	for (size_t i = 0; i < m_initiators.size(); ++i) {
+		node_stats & stats = m_initiators[i]->m_stats;
+		stats_sample sample;
+		m_initiators[i]->go();
+		stats.goTime = sample.seconds();
+		stats.bytesRead += sample.bytes_read();
+		stats.bytesWritten += sample.bytes_written();
+	}
+	return m_initiators.size();
+}
+
+void phase::end_all(progress_indicator_base & pi) {
+	std::vector<node *> endOrder;
+	{
+		dfs_traversal<phase::node_graph> dfs(*actorGraph);
+		dfs.dfs();
+		endOrder = dfs.toposort();
+	}
 	for (size_t i = 0; i < endOrder.size(); ++i) {
 		if (endOrder[i]->get_state() != node::STATE_AFTER_BEGIN) {
 			throw call_order_exception("Invalid state for end");
 		}
+		node_stats & stats = endOrder[i]->m_stats;
 		endOrder[i]->set_state(node::STATE_IN_END);
+		stats_sample sample;
 		endOrder[i]->end();
+		stats.endTime = sample.seconds();
+		stats.bytesRead += sample.bytes_read();
+		stats.bytesWritten += sample.bytes_written();
+		stats.steps = endOrder[i]->m_stepsTotal - endOrder[i]->m_stepsLeft;
 		endOrder[i]->set_state(node::STATE_AFTER_END);
 	}
 	pi.done();
-
-	if (initiators == 0)
-		throw no_initiator_node();
-
 }
 
 } // namespace bits
@@ -66,6 +66,24 @@ public:
 
 	void go(progress_indicator_base & pi);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Propagate and begin all nodes. The first part of go().
+	///////////////////////////////////////////////////////////////////////////
+	void begin_all(progress_indicator_base & pi);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Call go() on the initiators. The second part of go(), which
+	/// may run in a different thread than the other parts.
+	///
+	/// \returns  The number of initiators.
+	///////////////////////////////////////////////////////////////////////////
+	size_t run_initiators();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  End all nodes. The last part of go().
+	///////////////////////////////////////////////////////////////////////////
+	void end_all(progress_indicator_base & pi);
+
 	void evacuate_all() const;
 
 	void assign_memory(memory_size_type m) const;
@@ -88,6 +106,9 @@ private:
 	/** a pointer is a weak reference to something that isn't reference counted. */
 	std::vector<node *> m_nodes;
 
+	/** Initiators in the order they are run. Found by begin_all. */
+	std::vector<node *> m_initiators;
+
 	void assign_minimum_memory() const;
 
 	///////////////////////////////////////////////////////////////////////////
@@ -107,6 +128,10 @@ private:
 ///
 /// Given the entire pipelining actor graph via a `node_map`, toposorts the
 /// phases and runs them in the right order.
+///
+/// Phases are grouped in levels: the level of a phase is one more than the
+/// highest level of the phases it depends on. Phases of the same level are
+/// independent, and go_all may run them concurrently.
 ///////////////////////////////////////////////////////////////////////////////
 class graph_traits {
 public:
@@ -118,6 +143,13 @@ public:
 
 	static memory_size_type memory_usage(size_t phases);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  The number of phases in the level of the given phase, that
+	/// is, the number of phases it runs concurrently with in concurrent
+	/// go_all().
+	///////////////////////////////////////////////////////////////////////////
+	size_t concurrency(size_t phase) const;
+
 	graph_traits(const node_map & map);
 
 	const phases_t & phases() {
@@ -132,12 +164,24 @@ public:
 		return m_itemSinks;
 	}
 
-	void go_all(stream_size_type n, Progress::base & pi);
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Run all phases.
+	///
+	/// \param concurrent  If true, the initiators of the phases of each level
+	/// are run concurrently on the job pool. Their propagate, begin and end
+	/// are called in the calling thread. The memory assigned to the phases
+	/// must have been divided by their concurrency().
+	///////////////////////////////////////////////////////////////////////////
+	void go_all(stream_size_type n, Progress::base & pi, bool concurrent = false);
 
 private:
 	const node_map & map;
 	phases_t m_phases;
 	std::vector<bool> m_evacuatePrevious;
+	/** Level of each phase. */
+	std::vector<size_t> m_levels;
+	/** The phases each phase directly depends on. */
+	std::vector<std::vector<size_t> > m_dependencies;
 	nodes_t m_itemSources;
 	nodes_t m_itemSinks;
 
@@ -0,0 +1,405 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file hash_aggregate.h  Group and aggregate items by key using hashing.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_PIPELINING_HASH_AGGREGATE_H__
+#define __TPIE_PIPELINING_HASH_AGGREGATE_H__
+
+#include <tpie/pipelining/node.h>
+#include <tpie/pipelining/pipe_base.h>
+#include <tpie/pipelining/factory_base.h>
+#include <tpie/hash_map.h>
+#include <tpie/file_stream.h>
+#include <tpie/tempname.h>
+#include <tpie/exception.h>
+#include <boost/shared_ptr.hpp>
+#include <functional>
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Aggregates (key, value) pairs in a hash table, spilling the pairs
+/// of keys that do not fit to hash partitioned temporary files.
+///
+/// Once the table is full, no more keys are added to it, but values of keys
+/// already in it are still combined. A pair with a new key is written to the
+/// partition given by its hash. After the table is output, each partition is
+/// aggregated the same way, with a different partitioning hash on each level
+/// of recursion.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_t, typename value_t, typename combine_t, typename hash_t>
+class hash_aggregator {
+public:
+	typedef std::pair<key_t, value_t> item_type;
+	typedef boost::shared_ptr<hash_aggregator> ptr;
+
+	hash_aggregator(const combine_t & combine, const hash_t & hash)
+		: m_combine(combine)
+		, m_hash(hash)
+		, m_table(0, hash)
+		, m_inputMemory(0)
+		, m_outputMemory(0)
+		, m_capacity(0)
+		, m_fanout(0)
+	{
+	}
+
+	static memory_size_type minimum_memory() {
+		return table_t::memory_usage(minimum_capacity)
+			+ (minimum_fanout + 1) * stream_memory_usage();
+	}
+
+	void set_input_memory(memory_size_type memory) {
+		m_inputMemory = memory;
+	}
+
+	void set_output_memory(memory_size_type memory) {
+		m_outputMemory = memory;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Allocate the table. It is output in the next phase, so it is
+	/// bounded by the memory of both phases.
+	///////////////////////////////////////////////////////////////////////////
+	void begin() {
+		use_memory(std::min(m_inputMemory, m_outputMemory));
+	}
+
+	void push(const item_type & item) {
+		if (add(item)) return;
+		if (m_out.size() == 0) {
+			log_debug() << "hash_aggregate: " << m_capacity << " keys in table; spilling to "
+						<< m_fanout << " partitions" << std::endl;
+			m_partitions.resize(m_fanout);
+			open_partitions(m_partitions);
+		}
+		m_out[partition(item.first, 0, m_out.size())].write(item);
+	}
+
+	void end() {
+		m_out.resize(0);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Push the aggregated pairs to dest: first the contents of the
+	/// table, and then those of the spilled partitions.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename dest_t>
+	void output(dest_t & dest) {
+		output_table(dest);
+		if (m_partitions.size() == 0) return;
+		use_memory(m_outputMemory);
+		process_partitions(m_partitions, 1, dest);
+		m_partitions.resize(0);
+	}
+
+	void free() {
+		m_table.resize(0);
+		m_out.resize(0);
+		m_partitions.resize(0);
+	}
+
+private:
+	typedef hash_map<key_t, value_t, hash_t, std::equal_to<key_t>, size_t,
+					 linear_probing_hash_table> table_t;
+
+	static const memory_size_type minimum_capacity = 1024;
+	static const memory_size_type minimum_fanout = 2;
+	static const memory_size_type maximum_fanout = 64;
+	// Beyond this depth, the keys that are left must have colliding hashes.
+	static const memory_size_type maximum_level = 32;
+
+	static memory_size_type stream_memory_usage() {
+		return file_stream<item_type>::memory_usage();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Divide the memory of the current phase between the table and
+	/// the partition streams, and allocate the table.
+	///////////////////////////////////////////////////////////////////////////
+	void use_memory(memory_size_type memory) {
+		const memory_size_type streamMemory = stream_memory_usage();
+		m_fanout = std::max(minimum_fanout,
+							std::min(maximum_fanout, memory / 2 / streamMemory));
+		const memory_size_type reserved = (m_fanout + 1) * streamMemory;
+		const memory_size_type tableMemory = (memory > reserved) ? memory - reserved : 0;
+		m_capacity = std::max(minimum_capacity, table_t::memory_fits(tableMemory));
+		m_table.resize(m_capacity);
+		m_table.clear();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Combine the item into the table. Returns false if its key is
+	/// new and the table is full.
+	///////////////////////////////////////////////////////////////////////////
+	bool add(const item_type & item) {
+		typename table_t::iterator i = m_table.find(item.first);
+		if (i != m_table.end()) {
+			i->second = m_combine(i->second, item.second);
+			return true;
+		}
+		if (m_table.size() >= m_capacity) return false;
+		m_table.insert(item.first, item.second);
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Partition of the key on the given level of recursion. The hash
+	/// value is remixed with the level, such that keys of one partition are
+	/// spread over the partitions of the next level.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type partition(const key_t & key, memory_size_type level, memory_size_type fanout) const {
+		uint64_t h = static_cast<uint64_t>(m_hash(key)) + level * 0x9e3779b97f4a7c15ull;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return static_cast<memory_size_type>(h % fanout);
+	}
+
+	void open_partitions(array<temp_file> & files) {
+		m_out.resize(files.size());
+		for (memory_size_type i = 0; i < files.size(); ++i)
+			m_out[i].open(files[i], access_write);
+	}
+
+	template <typename dest_t>
+	void output_table(dest_t & dest) {
+		for (typename table_t::iterator i = m_table.begin(); i != m_table.end(); ++i)
+			dest.push(*i);
+	}
+
+	template <typename dest_t>
+	void process_partitions(array<temp_file> & files, memory_size_type level, dest_t & dest) {
+		if (level > maximum_level)
+			throw exception("hash_aggregate: too many distinct keys with equal hash values");
+		for (memory_size_type p = 0; p < files.size(); ++p) {
+			array<temp_file> children;
+			{
+				file_stream<item_type> in;
+				in.open(files[p], access_read);
+				while (in.can_read()) {
+					const item_type & item = in.read();
+					if (add(item)) continue;
+					if (m_out.size() == 0) {
+						children.resize(m_fanout);
+						open_partitions(children);
+					}
+					m_out[partition(item.first, level, m_out.size())].write(item);
+				}
+			}
+			m_out.resize(0);
+			files[p].free();
+
+			output_table(dest);
+			m_table.clear();
+			if (children.size() > 0) process_partitions(children, level + 1, dest);
+		}
+	}
+
+	combine_t m_combine;
+	hash_t m_hash;
+	table_t m_table;
+	memory_size_type m_inputMemory;
+	memory_size_type m_outputMemory;
+	memory_size_type m_capacity;
+	memory_size_type m_fanout;
+	array<temp_file> m_partitions;
+	array<file_stream<item_type> > m_out;
+};
+
+template <typename key_t, typename value_t, typename combine_t, typename hash_t>
+const memory_size_type hash_aggregator<key_t, value_t, combine_t, hash_t>::minimum_capacity;
+template <typename key_t, typename value_t, typename combine_t, typename hash_t>
+const memory_size_type hash_aggregator<key_t, value_t, combine_t, hash_t>::minimum_fanout;
+template <typename key_t, typename value_t, typename combine_t, typename hash_t>
+const memory_size_type hash_aggregator<key_t, value_t, combine_t, hash_t>::maximum_fanout;
+template <typename key_t, typename value_t, typename combine_t, typename hash_t>
+const memory_size_type hash_aggregator<key_t, value_t, combine_t, hash_t>::maximum_level;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Hash aggregate output node. Pushes the aggregated pairs in the
+/// phase after the input.
+///////////////////////////////////////////////////////////////////////////////
+template <typename combine_t, typename hash_t, typename dest_t>
+class hash_aggregate_output_t : public node {
+public:
+	typedef typename dest_t::item_type item_type;
+	typedef typename item_type::first_type key_type;
+	typedef typename item_type::second_type value_type;
+	typedef hash_aggregator<key_type, value_type, combine_t, hash_t> aggregator_t;
+	typedef typename aggregator_t::ptr aggregatorptr;
+
+	hash_aggregate_output_t(const dest_t & dest, const combine_t & combine, const hash_t & hash)
+		: m_aggregator(tpie_new<aggregator_t>(combine, hash), tpie_deleter())
+		, dest(dest)
+	{
+		add_push_destination(dest);
+		set_minimum_memory(aggregator_t::minimum_memory());
+		set_name("Output aggregated items", PRIORITY_INSIGNIFICANT);
+		set_memory_fraction(1.0);
+	}
+
+	virtual void go() override {
+		m_aggregator->output(dest);
+	}
+
+	virtual void end() override {
+		node::end();
+		m_aggregator->free();
+	}
+
+	aggregatorptr get_aggregator() const {
+		return m_aggregator;
+	}
+
+	void set_input_node(node & input) {
+		add_dependency(input);
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_aggregator->set_output_memory(availableMemory);
+	}
+
+private:
+	aggregatorptr m_aggregator;
+	dest_t dest;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Hash aggregate input node. Aggregates the pushed pairs in memory
+/// and spills the rest.
+///////////////////////////////////////////////////////////////////////////////
+template <typename output_t>
+class hash_aggregate_input_t : public node {
+public:
+	typedef typename output_t::item_type item_type;
+	typedef typename output_t::aggregator_t aggregator_t;
+	typedef typename output_t::aggregatorptr aggregatorptr;
+
+	hash_aggregate_input_t(const output_t & output)
+		: m_aggregator(output.get_aggregator())
+		, m_output(output)
+	{
+		m_output.set_input_node(*this);
+		set_minimum_memory(aggregator_t::minimum_memory());
+		set_name("Aggregate items", PRIORITY_SIGNIFICANT);
+		set_memory_fraction(1.0);
+	}
+
+	virtual void begin() override {
+		node::begin();
+		m_aggregator->begin();
+	}
+
+	inline void push(const item_type & item) {
+		m_aggregator->push(item);
+	}
+
+	virtual void end() override {
+		node::end();
+		m_aggregator->end();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_aggregator->set_input_memory(availableMemory);
+	}
+
+private:
+	aggregatorptr m_aggregator;
+	output_t m_output;
+};
+
+template <typename combine_t, typename hash_t>
+class hash_aggregate_factory : public factory_base {
+public:
+	template <typename dest_t>
+	struct constructed {
+		typedef hash_aggregate_input_t<hash_aggregate_output_t<combine_t, hash_t, dest_t> > type;
+	};
+
+	hash_aggregate_factory(const combine_t & combine, const hash_t & hash)
+		: m_combine(combine)
+		, m_hash(hash)
+	{
+	}
+
+	template <typename dest_t>
+	typename constructed<dest_t>::type construct(const dest_t & dest) const {
+		hash_aggregate_output_t<combine_t, hash_t, dest_t> output(dest, m_combine, m_hash);
+		this->init_sub_node(output);
+		typename constructed<dest_t>::type input(output);
+		this->init_sub_node(input);
+		return input;
+	}
+
+private:
+	combine_t m_combine;
+	hash_t m_hash;
+};
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Group (key, value) pairs by key, combining the values of each key
+/// with combine(a, b), e.g. std::plus<value_t>().
+///
+/// Unlike pipesort() followed by grouping, this needs no sorting: the groups
+/// are aggregated in a hash table of the assigned memory, so when the groups
+/// fit in memory, it is a single pass. Otherwise the pairs of the groups that
+/// do not fit are partitioned by hash to temporary files, which are
+/// aggregated recursively. The output is in no particular order.
+///
+/// The pair default_unused<std::pair<key_t, value_t> >::v() is reserved by
+/// the hash table and must not occur as an aggregated pair.
+///////////////////////////////////////////////////////////////////////////////
+template <typename combine_t, typename hash_t>
+inline pipe_middle<bits::hash_aggregate_factory<combine_t, hash_t> >
+hash_aggregate(const combine_t & combine, const hash_t & hash) {
+	typedef bits::hash_aggregate_factory<combine_t, hash_t> fact;
+	return pipe_middle<fact>(fact(combine, hash)).name("Hash aggregate");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Group (key, value) pairs by key using tpie::hash for the key type.
+/// \sa hash_aggregate(const combine_t &, const hash_t &)
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_t, typename combine_t>
+inline pipe_middle<bits::hash_aggregate_factory<combine_t, tpie::hash<key_t> > >
+hash_aggregate(const combine_t & combine) {
+	return hash_aggregate(combine, tpie::hash<key_t>());
+}
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_HASH_AGGREGATE_H__
@@ -24,6 +24,7 @@
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/push_batch.h>
 #include <tpie/memory.h>
 
 namespace tpie {
@@ -81,6 +82,10 @@ public:
 	inline void push(const item_type & item) {
 		dest.push(item);
 	}
+
+	void push_batch(array_view<const item_type> items) {
+		push_items(dest, items);
+	}
 private:
 	dest_t dest;
 };
@@ -194,6 +199,9 @@ public:
 
 	inline void push(const T &) {
 	}
+
+	void push_batch(array_view<const T>) {
+	}
 };
 
 template <typename fact2_t>
@@ -217,6 +225,11 @@ public:
 			dest2.push(item);
 		}
 
+		void push_batch(array_view<const item_type> items) {
+			push_items(dest, items);
+			push_items(dest2, items);
+		}
+
 	private:
 		dest_t dest;
 		dest2_t dest2;
@@ -228,6 +241,7 @@ class null_sink_t: public node {
 public:
 	typedef T item_type;
 	void push(const T &) {}
+	void push_batch(array_view<const T>) {}
 };
 
 template <typename IT>
@@ -22,6 +22,12 @@
 
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/hash_map.h>
+#include <tpie/file_stream.h>
+#include <tpie/tempname.h>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+#include <functional>
 
 namespace tpie {
 namespace pipelining {
@@ -119,6 +125,367 @@ private:
 	node_token source_token;
 };
 
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Build side table of hash_join.
+///
+/// The build items are stored in an array and chained by the hash of their
+/// keys. If they do not fit in the memory of the build node, the build and
+/// probe items are partitioned by key hash to temporary files, and each
+/// partition is joined after the probe input has ended. A build partition
+/// that still does not fit is joined in chunks, reading its probe partition
+/// once per chunk.
+///////////////////////////////////////////////////////////////////////////////
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t>
+class hash_join_table {
+public:
+	typedef typename boost::remove_cv<
+		typename boost::remove_reference<typename build_key_t::result_type>::type
+		>::type key_type;
+	typedef std::pair<build_t, probe_t> item_type;
+
+	hash_join_table(const build_key_t & buildKey, const probe_key_t & probeKey)
+		: m_buildKey(buildKey)
+		, m_probeKey(probeKey)
+		, m_buildMemory(0)
+		, m_probeMemory(0)
+		, m_fanout(0)
+		, m_count(0)
+		, m_spilled(false)
+	{
+	}
+
+	static memory_size_type minimum_memory() {
+		return minimum_capacity * item_memory_usage()
+			+ (minimum_fanout + 1) * stream_memory_usage();
+	}
+
+	void set_build_memory(memory_size_type memory) {
+		m_buildMemory = memory;
+	}
+
+	void set_probe_memory(memory_size_type memory) {
+		m_probeMemory = memory;
+	}
+
+	void begin_build() {
+		// Both sides are partitioned the same way, so the number of
+		// partitions is bounded by the memory of both phases. The table is
+		// kept through the probe phase when nothing spills, so it is bounded
+		// by both as well.
+		const memory_size_type memory = std::min(m_buildMemory, m_probeMemory);
+		m_fanout = std::max(minimum_fanout,
+							std::min(maximum_fanout, memory / 2 / stream_memory_usage()));
+		allocate(memory);
+		m_spilled = false;
+	}
+
+	void push_build(const build_t & item) {
+		if (m_spilled) {
+			m_buildOut[partition(m_buildKey(item))].write(item);
+		} else if (m_count < m_items.size()) {
+			m_items[m_count++] = item;
+		} else {
+			spill();
+			m_buildOut[partition(m_buildKey(item))].write(item);
+		}
+	}
+
+	void end_build() {
+		if (m_spilled)
+			m_buildOut.resize(0);
+		else
+			index();
+	}
+
+	void begin_probe() {
+		if (!m_spilled) return;
+		m_probeFiles.resize(m_fanout);
+		m_probeOut.resize(m_fanout);
+		for (memory_size_type i = 0; i < m_fanout; ++i)
+			m_probeOut[i].open(m_probeFiles[i], access_write);
+	}
+
+	template <typename dest_t>
+	void push_probe(const probe_t & item, dest_t & dest) {
+		if (m_spilled)
+			m_probeOut[partition(m_probeKey(item))].write(item);
+		else
+			probe(item, dest);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Join the partitions, if the build side was spilled.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename dest_t>
+	void end_probe(dest_t & dest) {
+		if (!m_spilled) return;
+		m_probeOut.resize(0);
+		allocate(m_probeMemory);
+		for (memory_size_type p = 0; p < m_fanout; ++p) {
+			file_stream<build_t> buildIn;
+			buildIn.open(m_buildFiles[p], access_read);
+			file_stream<probe_t> probeIn;
+			probeIn.open(m_probeFiles[p], access_read);
+			if (probeIn.size() == 0) continue;
+			while (buildIn.can_read()) {
+				m_count = 0;
+				while (m_count < m_items.size() && buildIn.can_read())
+					m_items[m_count++] = buildIn.read();
+				index();
+				probeIn.seek(0);
+				while (probeIn.can_read()) probe(probeIn.read(), dest);
+			}
+		}
+	}
+
+	void free() {
+		m_items.resize(0);
+		m_next.resize(0);
+		m_heads.resize(0);
+		m_buildOut.resize(0);
+		m_probeOut.resize(0);
+		m_buildFiles.resize(0);
+		m_probeFiles.resize(0);
+		m_count = 0;
+	}
+
+private:
+	static const memory_size_type minimum_capacity = 1024;
+	static const memory_size_type minimum_fanout = 2;
+	static const memory_size_type maximum_fanout = 64;
+	static const memory_size_type no_item = static_cast<memory_size_type>(-1);
+
+	// An item, its chain pointer, and at most two bucket heads.
+	static memory_size_type item_memory_usage() {
+		return sizeof(build_t) + 3 * sizeof(memory_size_type);
+	}
+
+	static memory_size_type stream_memory_usage() {
+		return std::max(file_stream<build_t>::memory_usage(),
+						file_stream<probe_t>::memory_usage());
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Allocate room for as many build items as fit in the memory
+	/// left after the partition streams.
+	///////////////////////////////////////////////////////////////////////////
+	void allocate(memory_size_type memory) {
+		const memory_size_type reserved = (m_fanout + 1) * stream_memory_usage();
+		const memory_size_type capacity = std::max(minimum_capacity,
+			(memory > reserved ? memory - reserved : 0) / item_memory_usage());
+		memory_size_type buckets = 1;
+		while (buckets < capacity) buckets *= 2;
+		m_items.resize(capacity);
+		m_next.resize(capacity);
+		m_heads.resize(buckets);
+		m_count = 0;
+	}
+
+	uint64_t mix(const key_type & key) const {
+		uint64_t h = static_cast<uint64_t>(m_hash(key));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Use the high bits for partitioning and the low bits for the buckets.
+	memory_size_type partition(const key_type & key) const {
+		return static_cast<memory_size_type>((mix(key) >> 32) % m_fanout);
+	}
+
+	memory_size_type bucket(const key_type & key) const {
+		return static_cast<memory_size_type>(mix(key)) & (m_heads.size() - 1);
+	}
+
+	void spill() {
+		log_debug() << "hash_join: build side exceeds " << m_items.size()
+					<< " items; partitioning into " << m_fanout << std::endl;
+		m_spilled = true;
+		m_buildFiles.resize(m_fanout);
+		m_buildOut.resize(m_fanout);
+		for (memory_size_type i = 0; i < m_fanout; ++i)
+			m_buildOut[i].open(m_buildFiles[i], access_write);
+		for (memory_size_type i = 0; i < m_count; ++i)
+			m_buildOut[partition(m_buildKey(m_items[i]))].write(m_items[i]);
+		m_items.resize(0);
+		m_next.resize(0);
+		m_heads.resize(0);
+		m_count = 0;
+	}
+
+	void index() {
+		std::fill(m_heads.begin(), m_heads.end(), no_item);
+		for (memory_size_type i = 0; i < m_count; ++i) {
+			const memory_size_type b = bucket(m_buildKey(m_items[i]));
+			m_next[i] = m_heads[b];
+			m_heads[b] = i;
+		}
+	}
+
+	template <typename dest_t>
+	void probe(const probe_t & item, dest_t & dest) {
+		const key_type & key = m_probeKey(item);
+		for (memory_size_type i = m_heads[bucket(key)]; i != no_item; i = m_next[i]) {
+			if (m_equal(m_buildKey(m_items[i]), key))
+				dest.push(item_type(m_items[i], item));
+		}
+	}
+
+	build_key_t m_buildKey;
+	probe_key_t m_probeKey;
+	tpie::hash<key_type> m_hash;
+	std::equal_to<key_type> m_equal;
+	memory_size_type m_buildMemory;
+	memory_size_type m_probeMemory;
+	memory_size_type m_fanout;
+
+	array<build_t> m_items;
+	array<memory_size_type> m_next;
+	array<memory_size_type> m_heads;
+	memory_size_type m_count;
+
+	bool m_spilled;
+	array<temp_file> m_buildFiles;
+	array<temp_file> m_probeFiles;
+	array<file_stream<build_t> > m_buildOut;
+	array<file_stream<probe_t> > m_probeOut;
+};
+
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t>
+const memory_size_type hash_join_table<build_t, probe_t, build_key_t, probe_key_t>::minimum_capacity;
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t>
+const memory_size_type hash_join_table<build_t, probe_t, build_key_t, probe_key_t>::minimum_fanout;
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t>
+const memory_size_type hash_join_table<build_t, probe_t, build_key_t, probe_key_t>::maximum_fanout;
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t>
+const memory_size_type hash_join_table<build_t, probe_t, build_key_t, probe_key_t>::no_item;
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Equijoin of two push streams using hashing.
+///
+/// The items pushed into \c build() are stored in memory, and each item
+/// pushed into the pipe \c probe() is pushed on as a (build item, probe item)
+/// pair for each build item with an equal key. The build pipeline is run in
+/// a phase before the probe pipeline, and its items stay in memory while the
+/// probe pipeline runs. If the build items do not fit in the memory of the
+/// build node, both sides are partitioned to temporary files
+/// (Grace hash join), and the output of the partitions is pushed when the
+/// probe input ends.
+///
+/// \tparam build_key_t  Unary function giving the key of a build item.
+/// \tparam probe_key_t  Unary function giving the key of a probe item. Both
+/// must have the same result_type, which is hashed using tpie::hash.
+///////////////////////////////////////////////////////////////////////////////
+template <typename build_t, typename probe_t, typename build_key_t, typename probe_key_t = build_key_t>
+class hash_join {
+public:
+	typedef bits::hash_join_table<build_t, probe_t, build_key_t, probe_key_t> table_t;
+
+	class build_impl : public node {
+	public:
+		typedef build_t item_type;
+
+		build_impl(table_t & table, const node_token & token)
+			: node(token)
+			, table(table)
+		{
+			set_minimum_memory(table_t::minimum_memory());
+			set_memory_fraction(1.0);
+			set_name("Build hash join table", PRIORITY_SIGNIFICANT);
+		}
+
+		virtual void begin() override {
+			node::begin();
+			table.begin_build();
+		}
+
+		void push(const build_t & item) {
+			table.push_build(item);
+		}
+
+		virtual void end() override {
+			node::end();
+			table.end_build();
+		}
+
+	protected:
+		virtual void set_available_memory(memory_size_type availableMemory) override {
+			node::set_available_memory(availableMemory);
+			table.set_build_memory(availableMemory);
+		}
+
+	private:
+		table_t & table;
+	};
+
+	template <typename dest_t>
+	class probe_impl : public node {
+	public:
+		typedef probe_t item_type;
+
+		probe_impl(const dest_t & dest, table_t & table, const node_token & build_token)
+			: dest(dest)
+			, table(table)
+		{
+			add_push_destination(dest);
+			add_dependency(build_token);
+			set_minimum_memory(table_t::minimum_memory());
+			set_memory_fraction(1.0);
+			set_name("Probe hash join table", PRIORITY_SIGNIFICANT);
+		}
+
+		virtual void begin() override {
+			node::begin();
+			table.begin_probe();
+		}
+
+		void push(const probe_t & item) {
+			table.push_probe(item, dest);
+		}
+
+		virtual void end() override {
+			node::end();
+			table.end_probe(dest);
+			table.free();
+		}
+
+	protected:
+		virtual void set_available_memory(memory_size_type availableMemory) override {
+			node::set_available_memory(availableMemory);
+			table.set_probe_memory(availableMemory);
+		}
+
+	private:
+		dest_t dest;
+		table_t & table;
+	};
+
+	hash_join(const build_key_t & buildKey = build_key_t(),
+			  const probe_key_t & probeKey = probe_key_t())
+		: table(buildKey, probeKey)
+	{
+	}
+
+	pipe_end<termfactory_2<build_impl, table_t &, const node_token &> > build() {
+		return termfactory_2<build_impl, table_t &, const node_token &>(table, build_token);
+	}
+
+	pipe_middle<factory_2<probe_impl, table_t &, const node_token &> > probe() {
+		return factory_2<probe_impl, table_t &, const node_token &>(table, build_token);
+	}
+
+private:
+	table_t table;
+	node_token build_token;
+};
+
 } // namespace pipelining
 } // namespace tpie
 
@@ -22,9 +22,13 @@
 
 #include <tpie/pipelining/sort_parameters.h>
 #include <tpie/pipelining/merger.h>
+#include <tpie/pipelining/partitioned_merger.h>
+#include <tpie/pipelining/sorter_job.h>
 #include <tpie/pipelining/exception.h>
 #include <tpie/dummy_progress.h>
 #include <tpie/array_view.h>
+#include <tpie/file_count.h>
+#include <tpie/job.h>
 
 namespace tpie {
 
@@ -56,9 +60,23 @@ public:
 		, pred(pred)
 		, m_evacuated(false)
 		, m_finalMergeInitialized(false)
+		, m_maxParallelMerges(0)
+		, m_doubleBuffering(false)
+		, m_runJob(0)
+		, m_loserTree(true)
+		, m_parallelFinalMerges(1)
+		, m_partitionedMerger(pred)
+		, m_partitionedFinalMerge(false)
 	{
 	}
 
+	inline ~merge_sorter() {
+		if (m_runJob) {
+			m_runJob->join();
+			tpie_delete(m_runJob);
+		}
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Enable setting run length and fanout manually (for testing
 	/// purposes).
@@ -66,13 +84,76 @@ public:
 	inline void set_parameters(memory_size_type runLength, memory_size_type fanout) {
 		tp_assert(m_state == stParameters, "Merge sorting already begun");
 		p.runLength = p.internalReportThreshold = runLength;
+		p.runBuffers = m_doubleBuffering ? 2 : 1;
 		p.fanout = p.finalFanout = fanout;
+		calculate_parallel_merges();
 		m_parametersSet = true;
 		log_debug() << "Manually set merge sort run length and fanout\n";
-		log_debug() << "Run length =       " << p.runLength << " (uses memory " << (p.runLength*sizeof(T) + file_stream<T>::memory_usage()) << ")\n";
+		log_debug() << "Run length =       " << p.runLength << " (uses memory " << (p.runLength*sizeof(T) + run_stream_memory_usage()) << ")\n";
 		log_debug() << "Fanout =           " << p.fanout << " (uses memory " << fanout_memory_usage(p.fanout) << ")" << std::endl;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Limit the number of merges of one merge level that run
+	/// concurrently on the job pool during phase 2.
+	///
+	/// By default (n = 0), as many merges run concurrently as there are
+	/// worker threads and as fit in the phase 2 memory without lowering the
+	/// fanout. When the parameters are set manually with set_parameters,
+	/// merges only run concurrently if n is given. n = 1 merges sequentially.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_parallel_merges(memory_size_type n) {
+		tp_assert(m_state == stParameters, "Merge sorting already begun");
+		m_maxParallelMerges = n;
+		if (m_parametersSet) calculate_parallel_merges();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Merge runs using a loser tree (the default) or a binary heap.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_loser_tree(bool enabled) {
+		tp_assert(m_state == stParameters, "Merge sorting already begun");
+		m_loserTree = enabled;
+		m_merger.set_loser_tree(enabled);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Merge key ranges of the final merge concurrently on the job
+	/// pool.
+	///
+	/// The items of the final runs are partitioned into key ranges by
+	/// splitters sampled from the runs, and up to the given number of ranges
+	/// are merged concurrently into buffers that are reported in order. The
+	/// ranges are located by binary search, so this requires that the run
+	/// files can be memory mapped; otherwise, or if the final runs fit in a
+	/// single buffer, the final merge is sequential. By default (jobs = 1)
+	/// the final merge is sequential, and jobs = 0 uses the number of worker
+	/// threads.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_parallel_final_merge(memory_size_type jobs) {
+		tp_assert(m_state == stParameters, "Merge sorting already begun");
+		m_parallelFinalMerges = (jobs == 0) ? default_worker_count() : jobs;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable double buffering of runs during phase 1.
+	///
+	/// Disabled by default. When enabled, the memory for run formation is
+	/// split into two buffers of half the run length. Each full run is sorted and handed
+	/// to a background job that writes it to disk while the next run is
+	/// formed in the other buffer. Parameters set with set_parameters keep
+	/// their run length and use twice the memory instead.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_double_buffering(bool enabled) {
+		tp_assert(m_state == stParameters, "Merge sorting already begun");
+		m_doubleBuffering = enabled;
+		if (!m_parametersSet) return;
+		if (p.memoryPhase1 > 0)
+			calculate_parameters(p.memoryPhase1, p.memoryPhase2, p.memoryPhase3);
+		else
+			p.runBuffers = enabled ? 2 : 1;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Calculate parameters from given memory amount.
 	/// \param m Memory available for phase 2, 3 and 4
@@ -125,8 +206,10 @@ public:
 		tp_assert(m_state == stParameters, "Merge sorting already begun");
 		if (!m_parametersSet) throw merge_sort_not_ready();
 		log_debug() << "Start forming input runs" << std::endl;
-		m_currentRunItems.resize((size_t)p.runLength);
+		m_currentRunItems.resize((size_t)(p.runLength*p.runBuffers));
 		m_runFiles.resize(p.fanout*2);
+		if (p.runBuffers > 1) m_runJob = tpie_new<run_job>(*this);
+		m_currentRunBegin = 0;
 		m_currentRunItemCount = 0;
 		m_finishedRuns = 0;
 		m_state = stRunFormation;
@@ -138,11 +221,10 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline void push(const T & item) {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
-		if (m_currentRunItemCount >= p.runLength) {
-			sort_current_run();
-			empty_current_run();
+		if (m_currentRunItemCount >= current_run_capacity()) {
+			flush_current_run();
 		}
-		m_currentRunItems[m_currentRunItemCount] = item;
+		m_currentRunItems[m_currentRunBegin + m_currentRunItemCount] = item;
 		++m_currentRunItemCount;
 		++m_itemCount;
 	}
@@ -152,6 +234,9 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline void end() {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
+		wait_for_run_job();
+		tpie_delete(m_runJob);
+		m_runJob = 0;
 		sort_current_run();
 
 		if (m_itemCount == 0) {
@@ -211,7 +296,8 @@ public:
 		if (m_reportInternal) {
 			log_debug() << "Evacuate merge_sorter (" << this << ") in internal reporting mode" << std::endl;
 			m_reportInternal = false;
-			memory_size_type runCount = (m_currentRunItemCount > 0) ? 1 : 0;
+			memory_size_type runCount = (m_currentRunItemCount > 0)
+				? (m_currentRunItemCount + p.runLength - 1) / p.runLength : 0;
 			empty_current_run();
 			m_currentRunItems.resize(0);
 			initialize_final_merger(0, runCount);
@@ -221,6 +307,8 @@ public:
 		}
 		log_debug() << "Evacuate merge_sorter (" << this << ") before reporting in external reporting mode" << std::endl;
 		m_merger.reset();
+		m_partitionedMerger.reset();
+		m_partitionedFinalMerge = false;
 		m_evacuated = true;
 	}
 
@@ -237,30 +325,133 @@ private:
 	// Phase 1 helpers.
 	///////////////////////////////////////////////////////////////////////////
 
+	///////////////////////////////////////////////////////////////////////////
+	/// Number of items the current run may hold. Until the first run is
+	/// written, the current run may fill the entire run buffer, which lets
+	/// inputs that fit in memory be reported internally.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type current_run_capacity() const {
+		return (m_finishedRuns == 0) ? m_currentRunItems.size() : p.runLength;
+	}
+
 	inline void sort_current_run() {
-		parallel_sort(m_currentRunItems.begin(), m_currentRunItems.begin()+m_currentRunItemCount, pred);
+		typename array<T>::iterator begin = m_currentRunItems.begin() + m_currentRunBegin;
+		parallel_sort(begin, begin+m_currentRunItemCount, pred);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Sort the full current run and write it to disk. With double
+	/// buffering, the run is written by m_runJob while the next run is formed
+	/// in the other half of the buffer.
+	///////////////////////////////////////////////////////////////////////////
+	inline void flush_current_run() {
+		sort_current_run();
+		if (p.runBuffers == 1) {
+			empty_current_run();
+			return;
+		}
+		const T * items = m_currentRunItems.get() + m_currentRunBegin;
+		if (m_finishedRuns == 0) {
+			// The buffer holds two runs' worth of items. Write the first
+			// half here and the second half in the background.
+			prepare_run(p.runLength);
+			write_run(m_finishedRuns++, items, p.runLength);
+			items += p.runLength;
+			m_currentRunBegin = p.runLength;
+		} else {
+			wait_for_run_job();
+		}
+		prepare_run(p.runLength);
+		m_runJob->set_run(m_finishedRuns++, items, p.runLength);
+		m_runJob->enqueue();
+		m_currentRunBegin = p.runLength - m_currentRunBegin;
+		m_currentRunItemCount = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Wait for the run being written by m_runJob, if any, and rethrow its
+	/// error.
+	///////////////////////////////////////////////////////////////////////////
+	inline void wait_for_run_job() {
+		if (!m_runJob) return;
+		m_runJob->join();
+		m_runJob->rethrow();
 	}
 
 	// postcondition: m_currentRunItemCount = 0
 	inline void empty_current_run() {
+		// The current run may span both run buffers if no run has been
+		// written yet, in which case it is split into runs of runLength.
+		const T * items = m_currentRunItems.get() + m_currentRunBegin;
+		do {
+			memory_size_type n = std::min(m_currentRunItemCount, p.runLength);
+			prepare_run(n);
+			write_run(m_finishedRuns++, items, n);
+			items += n;
+			m_currentRunItemCount -= n;
+		} while (m_currentRunItemCount > 0);
+		m_currentRunBegin = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Prepare the run file of the next run on the calling thread.
+	///////////////////////////////////////////////////////////////////////////
+	inline void prepare_run(memory_size_type n) {
 		if (m_finishedRuns < 10)
-			log_debug() << "Write " << m_currentRunItemCount << " items to run file " << m_finishedRuns << std::endl;
+			log_debug() << "Write " << n << " items to run file " << m_finishedRuns << std::endl;
 		else if (m_finishedRuns == 10)
 			log_debug() << "..." << std::endl;
+		prepare_run_file_write(0, m_finishedRuns);
+	}
+
+	inline void write_run(memory_size_type runNumber, const T * items, memory_size_type n) {
 		file_stream<T> fs;
-		open_run_file_write(fs, 0, m_finishedRuns);
-		for (memory_size_type i = 0; i < m_currentRunItemCount; ++i) {
-			fs.write(m_currentRunItems[i]);
+		open_prepared_run_file_write(fs, 0, runNumber);
+		for (memory_size_type i = 0; i < n; ++i) {
+			fs.write(items[i]);
 		}
-		m_currentRunItemCount = 0;
-		++m_finishedRuns;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// Job writing a sorted run during phase 1.
+	///////////////////////////////////////////////////////////////////////////
+	class run_job : public sorter_job {
+	public:
+		run_job(merge_sorter & sorter)
+			: m_sorter(sorter)
+			, m_runNumber(0)
+			, m_items(0)
+			, m_itemCount(0)
+		{
+		}
+
+		void set_run(memory_size_type runNumber, const T * items, memory_size_type n) {
+			m_runNumber = runNumber;
+			m_items = items;
+			m_itemCount = n;
+		}
+
+	protected:
+		virtual void perform() {
+			m_sorter.write_run(m_runNumber, m_items, m_itemCount);
+		}
+
+	private:
+		merge_sorter & m_sorter;
+		memory_size_type m_runNumber;
+		const T * m_items;
+		memory_size_type m_itemCount;
+	};
+
 	///////////////////////////////////////////////////////////////////////////
 	/// Prepare m_merger for merging the runNumber'th to the
 	/// (runNumber+runCount)'th run in mergeLevel.
 	///////////////////////////////////////////////////////////////////////////
 	inline void initialize_merger(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount) {
+		initialize_merger(m_merger, mergeLevel, runNumber, runCount);
+	}
+
+	inline void initialize_merger(merger<T, pred_t> & m, memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount) {
 		// runCount is a memory_size_type since we must be able to have that
 		// many file_streams open at the same time.
 
@@ -271,7 +462,7 @@ private:
 		}
 		stream_size_type runLength = calculate_run_length(p.runLength, p.fanout, mergeLevel);
 		// Pass file streams with correct stream offsets to the merger
-		m_merger.reset(in, runLength);
+		m.reset(in, runLength);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -304,6 +495,8 @@ private:
 public:
 	inline void reinitialize_final_merger() {
 		tp_assert(m_finalMergeInitialized, "reinitialize_final_merger while !m_finalMergeInitialized");
+		m_evacuated = false;
+		if (m_parallelFinalMerges > 1 && reinitialize_partitioned_merger()) return;
 		if (m_finalMergeSpecialRunNumber != std::numeric_limits<memory_size_type>::max()) {
 			array<file_stream<T> > in(p.finalFanout);
 			for (memory_size_type i = 0; i < p.finalFanout-1; ++i) {
@@ -318,9 +511,32 @@ public:
 		} else {
 			initialize_merger(m_finalMergeLevel, 0, m_finalRunCount);
 		}
-		m_evacuated = false;
 	}
 
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Prepare m_partitionedMerger for the final merge. Each final run
+	/// fills an entire run file.
+	/// \returns False if the final merge must be done by m_merger.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool reinitialize_partitioned_merger() {
+		array<temp_file *> runs;
+		if (m_finalMergeSpecialRunNumber != std::numeric_limits<memory_size_type>::max()) {
+			runs.resize(p.finalFanout);
+			for (memory_size_type i = 0; i < p.finalFanout-1; ++i)
+				runs[i] = &m_runFiles[run_file_index(m_finalMergeLevel, i)];
+			runs[p.finalFanout-1] = &m_runFiles[run_file_index(m_finalMergeLevel+1, m_finalMergeSpecialRunNumber)];
+		} else {
+			runs.resize(m_finalRunCount);
+			for (memory_size_type i = 0; i < m_finalRunCount; ++i)
+				runs[i] = &m_runFiles[run_file_index(m_finalMergeLevel, i)];
+		}
+		m_partitionedFinalMerge = m_partitionedMerger.reset(runs, m_parallelFinalMerges, memory_usage_phase_3(p));
+		return m_partitionedFinalMerge;
+	}
+
+public:
+
 private:
 	///////////////////////////////////////////////////////////////////////////
 	/// initialize_merger helper.
@@ -340,15 +556,129 @@ private:
 	///////////////////////////////////////////////////////////////////////////
 	template <typename ProgressIndicator>
 	inline memory_size_type merge_runs(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount, ProgressIndicator & pi) {
-		initialize_merger(mergeLevel, runNumber, runCount);
-		file_stream<T> out;
 		memory_size_type nextRunNumber = runNumber/p.fanout;
-		open_run_file_write(out, mergeLevel+1, nextRunNumber);
-		while (m_merger.can_pull()) {
+		prepare_run_file_write(mergeLevel+1, nextRunNumber);
+		merge_runs(m_merger, mergeLevel, runNumber, runCount, pi);
+		return nextRunNumber;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merge runs as above using the given merger. The output run file must
+	/// have been prepared with prepare_run_file_write.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename ProgressIndicator>
+	inline void merge_runs(merger<T, pred_t> & m, memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount, ProgressIndicator & pi) {
+		initialize_merger(m, mergeLevel, runNumber, runCount);
+		file_stream<T> out;
+		open_prepared_run_file_write(out, mergeLevel+1, runNumber/p.fanout);
+		while (m.can_pull()) {
 			pi.step();
-			out.write(m_merger.pull());
+			out.write(m.pull());
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Job performing one merge of merge_level_parallel.
+	///////////////////////////////////////////////////////////////////////////
+	class merge_job : public sorter_job {
+	public:
+		merge_job(merge_sorter & sorter, memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount)
+			: m_sorter(sorter)
+			, m_mergeLevel(mergeLevel)
+			, m_runNumber(runNumber)
+			, m_runCount(runCount)
+		{
+		}
+
+	protected:
+		virtual void perform() {
+			merger<T, pred_t> m(m_sorter.pred, m_sorter.m_loserTree);
+			dummy_progress_indicator pi;
+			m_sorter.merge_runs(m, m_mergeLevel, m_runNumber, m_runCount, pi);
+		}
+
+	private:
+		merge_sorter & m_sorter;
+		memory_size_type m_mergeLevel;
+		memory_size_type m_runNumber;
+		memory_size_type m_runCount;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merge jobs of one wave of merge_level_parallel. The jobs that were
+	/// started are joined and freed when the wave is cleared or destroyed,
+	/// also if an exception unwinds the wave partway through.
+	///////////////////////////////////////////////////////////////////////////
+	class merge_wave {
+	public:
+		merge_wave(memory_size_type capacity)
+			: m_jobs(capacity)
+			, m_size(0)
+		{
+		}
+
+		~merge_wave() {
+			clear();
+		}
+
+		void start(merge_job * job) {
+			m_jobs[m_size++] = job;
+			job->enqueue();
+		}
+
+		void join() {
+			for (memory_size_type i = 0; i < m_size; ++i) m_jobs[i]->join();
+		}
+
+		void rethrow() {
+			for (memory_size_type i = 0; i < m_size; ++i) m_jobs[i]->rethrow();
+		}
+
+		void clear() {
+			join();
+			for (memory_size_type i = 0; i < m_size; ++i) tpie_delete(m_jobs[i]);
+			m_size = 0;
+		}
+
+	private:
+		array<merge_job *> m_jobs;
+		memory_size_type m_size;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merge all runCount runs in mergeLevel into mergeLevel+1, running up to
+	/// p.parallelMerges merges concurrently on the job pool.
+	///
+	/// Merge i appends its output to run file i % fanout of the next level,
+	/// so only merges within the same window of fanout consecutive merges
+	/// may run at the same time.
+	///////////////////////////////////////////////////////////////////////////
+	inline void merge_level_parallel(memory_size_type mergeLevel, memory_size_type runCount, typename Progress::base & pi) {
+		memory_size_type merges = (runCount + p.fanout - 1) / p.fanout;
+		merge_wave wave(p.parallelMerges);
+		memory_size_type first = 0;
+		stream_size_type itemsMerged = 0;
+		while (first < merges) {
+			memory_size_type windowEnd = (first / p.fanout + 1) * p.fanout;
+			memory_size_type last = std::min(std::min(first + p.parallelMerges, windowEnd), merges);
+			stream_size_type items = 0;
+			for (memory_size_type i = first; i < last; ++i) {
+				memory_size_type runNumber = i * p.fanout;
+				memory_size_type n = std::min(runCount - runNumber, p.fanout);
+				items += calculate_run_length(p.runLength, p.fanout, mergeLevel) * n;
+				// Temporary file names are generated in this thread.
+				prepare_run_file_write(mergeLevel+1, i);
+				wave.start(tpie_new<merge_job>(*this, mergeLevel, runNumber, n));
+			}
+			wave.join();
+			wave.rethrow();
+			wave.clear();
+			// The last run of a level may be short.
+			if (last == merges) items = item_count() - itemsMerged;
+			itemsMerged += items;
+			pi.step(items);
+			first = last;
 		}
-		return nextRunNumber;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -365,7 +695,12 @@ private:
 		while (runCount > p.fanout) {
 			log_debug() << "Merge " << runCount << " runs in merge level " << mergeLevel << '\n';
 			memory_size_type newRunCount = 0;
-			for (memory_size_type i = 0; i < runCount; i += p.fanout) {
+			if (p.parallelMerges > 1) {
+				log_debug() << "Run up to " << p.parallelMerges << " merges concurrently" << std::endl;
+				merge_level_parallel(mergeLevel, runCount, pi);
+				newRunCount = (runCount + p.fanout - 1) / p.fanout;
+			}
+			else for (memory_size_type i = 0; i < runCount; i += p.fanout) {
 				memory_size_type n = std::min(runCount-i, p.fanout);
 
 				if (newRunCount < 10)
@@ -396,6 +731,7 @@ public:
 		if (m_reportInternal) return m_itemsPulled < m_currentRunItemCount;
 		else {
 			if (m_evacuated) reinitialize_final_merger();
+			if (m_partitionedFinalMerge) return m_partitionedMerger.can_pull();
 			return m_merger.can_pull();
 		}
 	}
@@ -411,6 +747,7 @@ public:
 			return el;
 		} else {
 			if (m_evacuated) reinitialize_final_merger();
+			if (m_partitionedFinalMerge) return m_partitionedMerger.pull();
 			return m_merger.pull();
 		}
 	}
@@ -420,8 +757,9 @@ public:
 	}
 
 	static memory_size_type memory_usage_phase_1(const sort_parameters & params) {
-		return params.runLength * sizeof(T)
-			+ file_stream<T>::memory_usage()
+		// Only the run being written has an open stream.
+		return std::max<memory_size_type>(params.runBuffers, 1) * params.runLength * sizeof(T)
+			+ run_stream_memory_usage()
 			+ 2*params.fanout*sizeof(temp_file);
 	}
 
@@ -440,7 +778,7 @@ public:
 	}
 
 	static memory_size_type memory_usage_phase_2(const sort_parameters & params) {
-		return fanout_memory_usage(params.fanout);
+		return std::max<memory_size_type>(params.parallelMerges, 1) * fanout_memory_usage(params.fanout);
 	}
 
 	static memory_size_type minimum_memory_phase_2() {
@@ -489,6 +827,7 @@ private:
 			log_debug() << "Not enough memory for fanout " << p.fanout << "! (" << p.memoryPhase2 << " < " << fanout_memory_usage(p.fanout) << ")\n";
 			p.memoryPhase2 = fanout_memory_usage(p.fanout);
 		}
+		calculate_parallel_merges();
 
 		// Phase 3 (final merge & report):
 		// Run length: unbounded
@@ -508,7 +847,7 @@ private:
 		// Run length: determined by the number of items we can hold in memory.
 		// Fanout: unbounded
 
-		memory_size_type streamMemory = file_stream<T>::memory_usage();
+		memory_size_type streamMemory = run_stream_memory_usage();
 		memory_size_type tempFileMemory = 2*p.fanout*sizeof(temp_file);
 
 		log_debug() << "Phase 1: " << p.memoryPhase1 << " b available memory; " << streamMemory << " b for a single stream; " << tempFileMemory << " b for temp_files\n";
@@ -517,14 +856,16 @@ private:
 			log_warning() << "Not enough phase 1 memory for an item and an open stream! (" << p.memoryPhase1 << " < " << min_m1 << ")\n";
 			p.memoryPhase1 = min_m1;
 		}
-		p.runLength = (p.memoryPhase1 - streamMemory - tempFileMemory)/sizeof(T);
+		memory_size_type bufferItems = (p.memoryPhase1 - streamMemory - tempFileMemory)/sizeof(T);
+		p.runBuffers = (m_doubleBuffering && bufferItems >= 2) ? 2 : 1;
+		p.runLength = bufferItems / p.runBuffers;
 
 		p.internalReportThreshold = (std::min(p.memoryPhase1,
 											  std::min(p.memoryPhase2,
 													   p.memoryPhase3))
 									 - tempFileMemory)/sizeof(T);
-		if (p.internalReportThreshold > p.runLength)
-			p.internalReportThreshold = p.runLength;
+		if (p.internalReportThreshold > p.runLength*p.runBuffers)
+			p.internalReportThreshold = p.runLength*p.runBuffers;
 
 		m_parametersSet = true;
 
@@ -570,12 +911,40 @@ private:
 		return fanout_lo;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_parameters helper: Run as many merges of a merge level
+	/// concurrently as the worker threads, the phase 2 memory and the number
+	/// of available file descriptors allow without lowering the fanout.
+	///////////////////////////////////////////////////////////////////////////
+	inline void calculate_parallel_merges() {
+		memory_size_type merges = m_maxParallelMerges;
+		if (merges == 0)
+			merges = (p.memoryPhase2 > 0) ? default_worker_count() : 1;
+		merges = std::min(merges, p.fanout);
+		if (p.memoryPhase2 > 0) {
+			while (merges > 1 && merges * fanout_memory_usage(p.fanout) > p.memoryPhase2)
+				--merges;
+		}
+		// Each merge keeps its input runs and its output run open.
+		memory_size_type files = available_files();
+		while (merges > 1 && merges * (p.fanout + 1) > files)
+			--merges;
+		p.parallelMerges = std::max<memory_size_type>(merges, 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by an open run file.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type run_stream_memory_usage() {
+		return merger<T, pred_t>::run_stream_memory_usage();
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// calculate_parameters helper
 	///////////////////////////////////////////////////////////////////////////
 	static inline memory_size_type fanout_memory_usage(memory_size_type fanout) {
 		return merger<T, pred_t>::memory_usage(fanout) // accounts for the `fanout' open streams
-			+ file_stream<T>::memory_usage() // output stream
+			+ run_stream_memory_usage() // output stream
 			+ 2*sizeof(temp_file); // merge_sorter::m_runFiles
 	}
 
@@ -594,12 +963,14 @@ public:
 		if (m_state != stParameters)
 			throw exception("Wrong state in set_items: state is not stParameters");
 
-		if (n < p.runLength) {
+		if (n < p.runLength*p.runBuffers) {
 			log_debug() << "Decreasing run length from " << p.runLength
 				<< " to " << n << std::endl;
 
-			// Since n < runLength, we may downcast to a smaller type.
+			// Since n < runLength*runBuffers, we may downcast to a smaller type.
+			// All items fit in a single run, so double buffering is not needed.
 			p.runLength = static_cast<memory_size_type>(n);
+			p.runBuffers = 1;
 
 			// Mirror the restriction from calculate_parameters.
 			if (p.internalReportThreshold > p.runLength)
@@ -628,11 +999,30 @@ private:
 	/// \brief Open a new run file and seek to the end.
 	///////////////////////////////////////////////////////////////////////////
 	inline void open_run_file_write(file_stream<T> & fs, memory_size_type mergeLevel, memory_size_type runNumber) {
+		prepare_run_file_write(mergeLevel, runNumber);
+		open_prepared_run_file_write(fs, mergeLevel, runNumber);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Make sure the run file of a new run exists, deleting the
+	/// previous contents if this is the first run of the file.
+	///////////////////////////////////////////////////////////////////////////
+	inline void prepare_run_file_write(memory_size_type mergeLevel, memory_size_type runNumber) {
 		// see run_file_index comment about runNumber
 
 		memory_size_type idx = run_file_index(mergeLevel, runNumber);
 		if (runNumber < p.fanout) m_runFiles[idx].free();
-		fs.open(m_runFiles[idx], access_read_write);
+		m_runFiles[idx].path();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Open a run file prepared with prepare_run_file_write and seek
+	/// to the end.
+	///////////////////////////////////////////////////////////////////////////
+	inline void open_prepared_run_file_write(file_stream<T> & fs, memory_size_type mergeLevel, memory_size_type runNumber) {
+		memory_size_type idx = run_file_index(mergeLevel, runNumber);
+		fs.set_compression(tempname::get_default_compression());
+		fs.open(m_runFiles[idx], access_read_write, 0, tempname::get_sequential_cache_hint());
 		fs.seek(0, file_stream<T>::end);
 	}
 
@@ -643,7 +1033,7 @@ private:
 		// see run_file_index comment about runNumber
 
 		memory_size_type idx = run_file_index(mergeLevel, runNumber);
-		fs.open(m_runFiles[idx], access_read);
+		fs.open(m_runFiles[idx], access_read, 0, tempname::get_sequential_cache_hint());
 		fs.seek(calculate_run_length(p.runLength, p.fanout, mergeLevel) * (runNumber / p.fanout), file_stream<T>::beginning);
 	}
 
@@ -671,6 +1061,9 @@ private:
 	// current run buffer. size 0 before begin(), size runLength after begin().
 	array<T> m_currentRunItems;
 
+	// Index of the first item of the current run in m_currentRunItems.
+	memory_size_type m_currentRunBegin;
+
 	// Number of items in current run buffer.
 	// Used to index into m_currentRunItems, so memory_size_type.
 	memory_size_type m_currentRunItemCount;
@@ -690,6 +1083,23 @@ private:
 	memory_size_type m_finalMergeLevel;
 	memory_size_type m_finalRunCount;
 	memory_size_type m_finalMergeSpecialRunNumber;
+
+	// Limit given to set_parallel_merges, or 0.
+	memory_size_type m_maxParallelMerges;
+
+	bool m_doubleBuffering;
+
+	// Writes runs in the background when p.runBuffers > 1.
+	run_job * m_runJob;
+
+	bool m_loserTree;
+
+	// Number of key ranges merged concurrently in the final merge.
+	memory_size_type m_parallelFinalMerges;
+
+	// Declared after m_runFiles so its streams are closed first.
+	partitioned_merger<T, pred_t> m_partitionedMerger;
+	bool m_partitionedFinalMerge;
 };
 
 } // namespace tpie
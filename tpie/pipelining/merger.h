@@ -21,25 +21,58 @@
 #define __TPIE_PIPELINING_MERGER_H__
 
 #include <tpie/internal_priority_queue.h>
+#include <tpie/loser_tree.h>
 #include <tpie/file_stream.h>
 #include <tpie/tpie_assert.h>
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Merges sorted runs of items read from file streams.
+///
+/// The runs are merged using a loser tree, which replays a single path of
+/// log(fanout) comparisons per item, or using a binary heap of
+/// (item, run) pairs if loserTree is false.
+///////////////////////////////////////////////////////////////////////////////
 template <typename T, typename pred_t>
 class merger {
 public:
-	inline merger(pred_t pred)
+	inline merger(pred_t pred, bool loserTree = true)
 		: pq(0, predwrap(pred))
+		, lt(0, pred)
+		, m_loserTree(loserTree)
 	{
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Select between the loser tree and the binary heap.
+	/// Precondition: !can_pull()
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_loser_tree(bool enabled) {
+		tp_assert(!can_pull(), "set_loser_tree() while merging");
+		m_loserTree = enabled;
+	}
+
 	inline bool can_pull() {
-		return !pq.empty();
+		return m_loserTree ? !lt.empty() : !pq.empty();
 	}
 
 	inline T pull() {
 		tp_assert(can_pull(), "pull() while !can_pull()");
+		if (m_loserTree) {
+			T el = lt.top();
+			size_t i = lt.top_index();
+			if (in[i].can_read() && itemsRead[i] < runLength) {
+				lt.pop_and_push(in[i].read());
+				++itemsRead[i];
+			} else {
+				lt.pop();
+			}
+			if (lt.empty()) {
+				reset();
+			}
+			return el;
+		}
 		T el = pq.top().first;
 		size_t i = pq.top().second;
 		if (in[i].can_read() && itemsRead[i] < runLength) {
@@ -57,6 +90,7 @@ public:
 	inline void reset() {
 		in.resize(0);
 		pq.resize(0);
+		lt.resize(0);
 		itemsRead.resize(0);
 	}
 
@@ -67,24 +101,45 @@ public:
 	// Precondition: !can_pull()
 	void reset(array<file_stream<T> > & inputs, stream_size_type runLength) {
 		this->runLength = runLength;
-		tp_assert(pq.empty(), "Reset before we are done");
+		tp_assert(!can_pull(), "Reset before we are done");
 		in.swap(inputs);
-		pq.resize(in.size());
-		for (size_t i = 0; i < in.size(); ++i) {
-			pq.unsafe_push(std::make_pair(in[i].read(), i));
+		if (m_loserTree) {
+			lt.resize(in.size());
+			for (size_t i = 0; i < in.size(); ++i) {
+				lt.unsafe_set(i, in[i].read());
+			}
+			lt.make_safe();
+		} else {
+			pq.resize(in.size());
+			for (size_t i = 0; i < in.size(); ++i) {
+				pq.unsafe_push(std::make_pair(in[i].read(), i));
+			}
+			pq.make_safe();
 		}
-		pq.make_safe();
 		itemsRead.resize(in.size(), 1);
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by one of the input streams, which are compressed
+	/// if tempname::set_default_compression is set.
+	///////////////////////////////////////////////////////////////////////////
+	inline static memory_size_type run_stream_memory_usage() {
+		return file_stream<T>::memory_usage(1.0, true, false,
+			tempname::get_default_compression() != compression_none);
+	}
+
 	inline static memory_size_type memory_usage(memory_size_type fanout) {
+		// Only one of pq and lt is in use.
+		stream_size_type pqUsage = internal_priority_queue<std::pair<T, size_t>, predwrap>::memory_usage(fanout);
+		stream_size_type ltUsage = loser_tree<T, pred_t>::memory_usage(fanout);
 		return sizeof(merger)
 			- sizeof(internal_priority_queue<std::pair<T, size_t>, predwrap>) // pq
-			+ static_cast<memory_size_type>(internal_priority_queue<std::pair<T, size_t>, predwrap>::memory_usage(fanout)) // pq
+			- sizeof(loser_tree<T, pred_t>) // lt
+			+ static_cast<memory_size_type>(std::max(pqUsage, ltUsage)) // pq or lt
 			- sizeof(array<file_stream<T> >) // in
 			+ static_cast<memory_size_type>(array<file_stream<T> >::memory_usage(fanout)) // in
 			- fanout*sizeof(file_stream<T>) // in file_streams
-			+ fanout*file_stream<T>::memory_usage() // in file_streams
+			+ fanout*run_stream_memory_usage() // in file_streams
 			- sizeof(array<size_t>) // itemsRead
 			+ static_cast<memory_size_type>(array<size_t>::memory_usage(fanout)) // itemsRead
 			;
@@ -112,6 +167,8 @@ public:
 
 private:
 	internal_priority_queue<std::pair<T, size_t>, predwrap> pq;
+	loser_tree<T, pred_t> lt;
+	bool m_loserTree;
 	array<file_stream<T> > in;
 	array<stream_size_type> itemsRead;
 	stream_size_type runLength;
@@ -27,6 +27,7 @@
 #include <boost/any.hpp>
 #include <tpie/pipelining/priority_type.h>
 #include <tpie/pipelining/predeclare.h>
+#include <tpie/pipelining/node_stats.h>
 
 namespace tpie {
 
@@ -298,6 +299,13 @@ public:
 		m_state = s;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get the counters collected while the phase of this node ran.
+	///////////////////////////////////////////////////////////////////////////
+	const node_stats & get_stats() const {
+		return m_stats;
+	}
+
 protected:
 #ifdef _WIN32
 	// Disable warning C4355: 'this' : used in base member initializer list
@@ -668,6 +676,7 @@ private:
 	progress_indicator_base * m_pi;
 	STATE m_state;
 	std::auto_ptr<progress_indicator_base> m_piProxy;
+	node_stats m_stats;
 
 	friend class bits::proxy_progress_indicator;
 };
@@ -0,0 +1,75 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2012, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_PIPELINING_NODE_STATS_H__
+#define __TPIE_PIPELINING_NODE_STATS_H__
+
+#include <tpie/types.h>
+
+namespace tpie {
+
+namespace pipelining {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Counters collected for each node while its phase runs.
+///
+/// The times and I/O of begin() and end() are exclusive to the node. The
+/// items of a phase are pushed from within go() of its initiator, so go()
+/// time and I/O include the push() calls of all nodes downstream of the
+/// initiator. When phases run concurrently, the I/O of go() also includes
+/// the I/O of the other phases of the level.
+///////////////////////////////////////////////////////////////////////////////
+struct node_stats {
+	node_stats()
+		: steps(0)
+		, beginTime(0.0)
+		, goTime(0.0)
+		, endTime(0.0)
+		, bytesRead(0)
+		, bytesWritten(0)
+		, memoryAssigned(0)
+		, memoryUsed(0)
+	{
+	}
+
+	/** Progress steps taken. Most nodes step once per item. */
+	stream_size_type steps;
+
+	/** Wall clock seconds spent in begin(), go() and end(). */
+	double beginTime;
+	double goTime;
+	double endTime;
+
+	/** Bytes read and written by begin(), go() and end(). */
+	stream_size_type bytesRead;
+	stream_size_type bytesWritten;
+
+	/** Memory assigned to the node by the pipeline. */
+	memory_size_type memoryAssigned;
+
+	/** Memory allocated by begin() and not freed by the time it returned,
+	 * that is, the memory the node holds while items flow. */
+	memory_size_type memoryUsed;
+};
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_NODE_STATS_H__
@@ -24,6 +24,7 @@
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/push_batch.h>
 
 namespace tpie {
 
@@ -43,10 +44,18 @@ public:
 	inline void push(const item_type & item) {
 		dest.push(item*factor+term);
 	}
+
+	void push_batch(array_view<const item_type> items) {
+		for (size_t i = 0; i < items.size(); ++i) {
+			output.push(dest, items[i]*factor+term);
+		}
+		output.flush(dest);
+	}
 private:
 	dest_t dest;
 	item_type factor;
 	item_type term;
+	batch_output<dest_t> output;
 };
 
 } // namespace bits
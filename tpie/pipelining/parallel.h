@@ -38,7 +38,7 @@
 /// receives the items pushed to each after instance.
 ///
 /// All nodes have access to a single parallel_bits::state instance
-/// which has the mutex and the necessary condition variables.
+/// which has a parallel_bits::worker_handoff for each worker.
 ///    It also has pointers to the parallel_bits::before and
 /// parallel_bits::after instances and it holds an array of worker states (of
 /// enum type parallel_bits::worker_state).
@@ -50,10 +50,14 @@
 /// since we get deadlocks if some of the workers are allowed to wait for a
 /// ready tpie::job worker. Instead, we use boost::threads directly.
 ///
-/// Parallel worker states. The main thread has a condition variable
-/// (producerCond) which is signalled every time a worker changes its own
-/// state. Each worker thread has a condition variable (workerCond[]) which is
-/// signalled when the main thread changes the worker's state.
+/// Parallel worker states. Each state is changed by either the main thread
+/// or the worker, so the state word is a lock-free single-producer,
+/// single-consumer handoff in each direction. The main thread has a
+/// parallel_bits::parker which is unparked every time a worker changes its
+/// own state. Each worker thread has a parker which is unparked when the main
+/// thread changes the worker's state. A waiting thread spins for a while
+/// before it parks, so short waits cost no system calls. The state mutex is
+/// only used when the workers start and stop.
 ///
 /// Initializing: Before the input/output buffers are initialized.
 /// -> Idle (worker thread)
@@ -71,6 +75,16 @@
 /// Outputting: Output buffer is full; input buffer is empty.
 /// -> Idle (main thread)
 ///
+/// Batches are numbered in the order the producer sends them. When order is
+/// maintained, the producer receives output of the batch that is next in
+/// order, and may hold back the output of up to options::reorderBatches later
+/// batches so the workers producing them can go on with new input.
+///
+/// With parallel_adaptive, the producer measures the time the workers spend
+/// per item and sends batches that take roughly target_batch_time to process,
+/// using bufSize as an upper bound. The measurements can be read from a
+/// parallel_stats instance.
+///
 /// TODO at some future point: Optimize code for the case where the buffer size
 /// is one.
 ///////////////////////////////////////////////////////////////////////////////
@@ -78,6 +92,7 @@
 #include <tpie/pipelining/parallel/options.h>
 #include <tpie/pipelining/parallel/worker_state.h>
 #include <tpie/pipelining/parallel/aligned_array.h>
+#include <tpie/pipelining/parallel/handoff.h>
 #include <tpie/pipelining/parallel/base.h>
 #include <tpie/pipelining/parallel/factory.h>
 #include <tpie/pipelining/parallel/pipes.h>
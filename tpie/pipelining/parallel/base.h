@@ -26,6 +26,8 @@
 #include <boost/shared_ptr.hpp>
 #include <tpie/pipelining/maintain_order_type.h>
 #include <tpie/pipelining/parallel/options.h>
+#include <tpie/pipelining/parallel/handoff.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace tpie {
 
@@ -43,6 +45,24 @@ class after;
 template <typename T1, typename T2>
 class state;
 
+typedef boost::posix_time::ptime time_point;
+
+inline time_point now() {
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Wall clock microseconds elapsed since the given time point.
+///////////////////////////////////////////////////////////////////////////////
+inline stream_size_type microseconds_since(const time_point & start) {
+	boost::int64_t us = (now() - start).total_microseconds();
+	return us > 0 ? static_cast<stream_size_type>(us) : 0;
+}
+
+inline double to_seconds(stream_size_type microseconds) {
+	return static_cast<double>(microseconds) / 1000000.0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Class containing an array of node instances. We cannot use
 /// tpie::array or similar, since we need to construct the elements in a
@@ -197,8 +217,9 @@ public:
 /// This class is instantiated once and kept in a boost::shared_ptr, and it is
 /// not copy constructible.
 ///
-/// Unless noted otherwise, a thread must own the state mutex to access other
-/// parts of this instance.
+/// Batches are handed between the producer and the workers through one
+/// worker_handoff per worker, without locking. The mutex is only used when
+/// workers start and stop.
 ///////////////////////////////////////////////////////////////////////////////
 class state_base {
 public:
@@ -213,26 +234,32 @@ public:
 
 	/** Condition variable.
 	 *
-	 * Who waits: The producer, with the single mutex (waits until at least one
-	 * worker has state = IDLE or state = OUTPUTTING).
+	 * Who waits: The producer, with the single mutex (waits until all workers
+	 * are running, or until all workers have stopped).
 	 *
-	 * Who signals: The par_after, when a worker is OUTPUTTING. */
+	 * Who signals: The worker, when it starts and stops. */
 	cond_t producerCond;
 
-	/** Condition variable, one per worker.
-	 *
-	 * Who waits: The worker's par_before when waiting for input (wait for
-	 * state = PROCESSING), the worker's par_after when waiting for output to
-	 * be read (wait for state = IDLE). Waits with the single mutex.
-	 *
-	 * Who signals: par_producer, when input has been written (sets state to PROCESSING).
-	 * par_consumer, when output has been read (sets state to IDLE).
-	 */
-	cond_t * workerCond;
-
-	/** Shared state, must have mutex to write. */
+	/** Shared state, must have mutex to use. */
 	size_t runningWorkers;
 
+	/** Statistics of the workers in microseconds, updated atomically. */
+	volatile stream_size_type workerBusy;
+	volatile stream_size_type workerIdle;
+	volatile stream_size_type workerBlocked;
+	volatile stream_size_type busyItems;
+
+	/// Only used by the worker thread.
+	void add_blocked(size_t idx, stream_size_type us) {
+		m_handoffs.get(idx)->blocked += us;
+		atomic_add(workerBlocked, us);
+	}
+
+	/// Only used by the worker thread.
+	stream_size_type get_blocked(size_t idx) {
+		return m_handoffs.get(idx)->blocked;
+	}
+
 	/// Must not be used concurrently.
 	void set_input_ptr(size_t idx, node * v) {
 		m_inputs[idx] = v;
@@ -264,39 +291,75 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	after_base & output(size_t idx) { return *m_outputs[idx]; }
 
-	/// Shared state, must have mutex to use.
+	/// May be used without the mutex.
 	worker_state get_state(size_t idx) {
-		return m_states[idx];
+		return m_handoffs.get(idx)->get_state();
 	}
 
-	/// Shared state, must have mutex to use.
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Change the state of a worker.
+	///
+	/// May be used without the mutex by the thread that owns the `from`
+	/// state, which must then wake the other side with unpark_worker or
+	/// unpark_producer.
+	///////////////////////////////////////////////////////////////////////////
 	void transition_state(size_t idx, worker_state from, worker_state to) {
-		if (m_states[idx] != from) {
+		if (!m_handoffs.get(idx)->transition(from, to)) {
 			std::stringstream ss;
-			ss << idx << " Invalid state transition " << from << " -> " << to << "; current state is " << m_states[idx];
+			ss << idx << " Invalid state transition " << from << " -> " << to << "; current state is " << get_state(idx);
 			log_error() << ss.str() << std::endl;
 			throw exception(ss.str());
 		}
-		m_states[idx] = to;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wait in worker idx until (obj->*ready)() returns true.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename C, typename F>
+	void wait_worker(size_t idx, C * obj, F ready) {
+		m_handoffs.get(idx)->worker.wait(obj, ready);
+	}
+
+	void unpark_worker(size_t idx) {
+		m_handoffs.get(idx)->worker.unpark();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wait in the producer until (obj->*ready)() returns true.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename C, typename F>
+	void wait_producer(C * obj, F ready) {
+		m_producer.wait(obj, ready);
+	}
+
+	void unpark_producer() {
+		m_producer.unpark();
 	}
 
 protected:
 	std::vector<node *> m_inputs;
 	std::vector<after_base *> m_outputs;
-	std::vector<worker_state> m_states;
+	aligned_array<worker_handoff, 64> m_handoffs;
+	parker m_producer;
 
 	state_base(const options opts)
 		: opts(opts)
 		, runningWorkers(0)
+		, workerBusy(0)
+		, workerIdle(0)
+		, workerBlocked(0)
+		, busyItems(0)
 		, m_inputs(opts.numJobs, 0)
 		, m_outputs(opts.numJobs, 0)
-		, m_states(opts.numJobs, INITIALIZING)
 	{
-		workerCond = new cond_t[opts.numJobs];
+		m_handoffs.realloc(opts.numJobs);
+		for (size_t i = 0; i < opts.numJobs; ++i)
+			new (m_handoffs.get(i)) worker_handoff();
 	}
 
 	virtual ~state_base() {
-		delete[] workerCond;
+		for (size_t i = 0; i < opts.numJobs; ++i)
+			m_handoffs.get(i)->~worker_handoff();
 	}
 };
 
@@ -484,7 +547,7 @@ public:
 	}
 
 private:
-	bool is_done() const {
+	bool is_done() {
 		switch (st.get_state(parId)) {
 			case INITIALIZING:
 				throw tpie::exception("INITIALIZING not expected in after::is_done");
@@ -522,23 +585,22 @@ private:
 	///////////////////////////////////////////////////////////////////////////
 	void flush_buffer_impl(bool complete) {
 		// At this point, we could check if the output buffer is empty and
-		// short-circuit when it is without acquiring the lock; however, we
+		// short-circuit when it is without waking the main thread; however, we
 		// must do a full PROCESSING -> OUTPUTTING -> IDLE transition in this
 		// case to let the main thread know that we are done processing the
 		// input.
 
-		lock_t lock(st.mutex);
 		if (st.get_state(parId) == DONE) {
 			if (*m_cons == 0) throw tpie::exception("Unexpected nullptr in flush_buffer");
 			array_view<T> out = m_buffer->get_output();
 			(*m_cons)->consume(out);
 		} else {
+			time_point start = now();
 			st.transition_state(parId, PROCESSING, complete ? OUTPUTTING : PARTIAL_OUTPUT);
 			// notify producer that output is ready
-			st.producerCond.notify_one();
-			while (!is_done()) {
-				st.workerCond[parId].wait(lock);
-			}
+			st.unpark_producer();
+			st.wait_worker(parId, this, &after::is_done);
+			st.add_blocked(parId, microseconds_since(start));
 		}
 		m_buffer->m_outputSize = 0;
 	}
@@ -611,25 +673,31 @@ private:
 		throw tpie::exception("Unknown state");
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Check if we have a batch of input or should stop.
+	///////////////////////////////////////////////////////////////////////////
+	bool ready_or_done() {
+		return st.get_state(parId) == DONE || ready();
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Class providing RAII-style bookkeeping of number of workers.
 	///////////////////////////////////////////////////////////////////////////
 	class running_signal {
-		typedef state_base::cond_t cond_t;
-		memory_size_type & sig;
-		cond_t & producerCond;
+		state_base & st;
 	public:
-		running_signal(memory_size_type & sig, cond_t & producerCond)
-			: sig(sig)
-			, producerCond(producerCond)
+		running_signal(state_base & st)
+			: st(st)
 		{
-			++sig;
-			producerCond.notify_one();
+			state_base::lock_t lock(st.mutex);
+			++st.runningWorkers;
+			st.producerCond.notify_one();
 		}
 
 		~running_signal() {
-			--sig;
-			producerCond.notify_one();
+			state_base::lock_t lock(st.mutex);
+			--st.runningWorkers;
+			st.producerCond.notify_one();
 		}
 	};
 
@@ -641,8 +709,6 @@ private:
 	/// \brief  Worker thread entry point.
 	///////////////////////////////////////////////////////////////////////////
 	void worker() {
-		state_base::lock_t lock(st.mutex);
-
 		m_buffer.reset(new parallel_input_buffer<T>(st.opts));
 		m_inputBuffers[parId] = m_buffer.get();
 
@@ -650,21 +716,24 @@ private:
 		st.output(parId).worker_initialize();
 
 		st.transition_state(parId, INITIALIZING, IDLE);
-		running_signal _(st.runningWorkers, st.producerCond);
+		running_signal _(st);
 		while (true) {
 			// wait for transition IDLE -> PROCESSING
-			while (!ready()) {
-				if (st.get_state(parId) == DONE) {
-					return;
-				}
-				st.workerCond[parId].wait(lock);
-			}
-			lock.unlock();
+			time_point waitStart = now();
+			st.wait_worker(parId, this, &before::ready_or_done);
+			atomic_add(st.workerIdle, microseconds_since(waitStart));
+			if (st.get_state(parId) == DONE) return;
+			stream_size_type blocked = st.get_blocked(parId);
 
+			time_point start = now();
 			// virtual invocation
 			push_all(m_buffer->get_input());
+			stream_size_type elapsed = microseconds_since(start);
 
-			lock.lock();
+			// Time spent waiting for the output to be taken is not busy time.
+			blocked = st.get_blocked(parId) - blocked;
+			atomic_add(st.workerBusy, elapsed > blocked ? elapsed - blocked : 0);
+			atomic_add(st.busyItems, m_buffer->get_input().size());
 		}
 	}
 };
@@ -739,6 +808,58 @@ public:
 	}
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Output of a batch held back by the producer until the batches
+/// before it have been consumed. The items are stored in one of the
+/// producer's reorder buffers, which hold a full batch.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class reorder_slot {
+	T * m_items;
+	memory_size_type m_size;
+
+public:
+	bool used;
+	bool complete;
+
+	reorder_slot()
+		: m_items(0)
+		, m_size(0)
+		, used(false)
+		, complete(false)
+	{
+	}
+
+	void use(T * items) {
+		m_items = items;
+		used = true;
+	}
+
+	memory_size_type size() const {
+		return m_size;
+	}
+
+	void append(array_view<T> items) {
+		std::copy(items.begin(), items.end(), m_items + m_size);
+		m_size += items.size();
+	}
+
+	array_view<T> get_items() {
+		return array_view<T>(m_items, m_size);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Empty the slot and return its buffer.
+	///////////////////////////////////////////////////////////////////////////
+	T * clear() {
+		T * items = m_items;
+		m_items = 0;
+		m_size = 0;
+		used = complete = false;
+		return items;
+	}
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Producer, running in main thread, managing the parallel execution.
 ///
@@ -757,9 +878,116 @@ private:
 	size_t written;
 	size_t readyIdx;
 	boost::shared_ptr<consumer<T2> > cons;
-	internal_queue<memory_size_type> m_outputOrder;
 	stream_size_type m_steps;
 
+	/** Batch size used when sending input to the workers. */
+	size_t m_batchSize;
+
+	/** Sequence number of the next batch to send to a worker. */
+	stream_size_type m_nextSeq;
+	/** Sequence number of the next batch to output in order. */
+	stream_size_type m_nextOutput;
+	/** Sequence number of the batch each worker is processing. */
+	array<stream_size_type> m_workerBatch;
+	/** Output held back to maintain order, indexed by sequence number. */
+	array<reorder_slot<T2> > m_ring;
+	/** Number of used slots in m_ring. */
+	size_t m_stashed;
+	/** Storage of the reorderBatches buffers used by the slots. */
+	array<T2> m_reorderItems;
+	/** The buffers from index m_stashed on are free. */
+	array<T2 *> m_reorderBuffers;
+
+	stream_size_type m_batches;
+	stream_size_type m_items;
+	stream_size_type m_producerWait;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Check if the output of the given worker can be received now.
+	///
+	/// If we have to maintain order of items, the output of the batch that is
+	/// next in order can always be received. Output of other batches can be
+	/// received if there is room for it in the reorder ring. A slot holds at
+	/// most one batch worth of items; a worker that produces more than that
+	/// waits until its batch is next in order.
+	///////////////////////////////////////////////////////////////////////////
+	bool can_receive(size_t idx) {
+		if (!st->opts.maintainOrder || m_workerBatch[idx] == m_nextOutput)
+			return true;
+		if (m_ring.size() == 0) return false;
+		reorder_slot<T2> & s = slot(m_workerBatch[idx]);
+		if (!s.used) return m_stashed < st->opts.reorderBatches;
+		return s.size() + st->m_outputBuffers[idx]->get_output().size() <= st->opts.bufSize;
+	}
+
+	reorder_slot<T2> & slot(stream_size_type seq) {
+		return m_ring[static_cast<size_t>(seq % m_ring.size())];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Receive output from a worker, either passing it on to the
+	/// consumer or holding it back until the batches before it are done.
+	///////////////////////////////////////////////////////////////////////////
+	void receive_output(size_t idx, bool complete) {
+		stream_size_type seq = m_workerBatch[idx];
+		array_view<T2> output = st->m_outputBuffers[idx]->get_output();
+		if (!st->opts.maintainOrder || seq == m_nextOutput) {
+			// virtual invocation
+			cons->consume(output);
+			if (complete && st->opts.maintainOrder) {
+				++m_nextOutput;
+				drain();
+			}
+			return;
+		}
+		reorder_slot<T2> & s = slot(seq);
+		if (!s.used) s.use(m_reorderBuffers[m_stashed++]);
+		s.append(output);
+		s.complete = complete;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Consume held back output that is now next in order.
+	///////////////////////////////////////////////////////////////////////////
+	void drain() {
+		while (m_stashed > 0) {
+			reorder_slot<T2> & s = slot(m_nextOutput);
+			if (!s.used) break;
+			cons->consume(s.get_items());
+			bool complete = s.complete;
+			m_reorderBuffers[--m_stashed] = s.clear();
+			// The rest of an incomplete batch is received directly.
+			if (!complete) break;
+			++m_nextOutput;
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Adjust the batch size so that a worker spends roughly
+	/// target_batch_time on each batch.
+	///////////////////////////////////////////////////////////////////////////
+	void adapt_batch_size() {
+		if (!st->opts.adaptive) return;
+		stream_size_type items = atomic_read(st->busyItems);
+		if (items == 0) return;
+		double perItem = to_seconds(atomic_read(st->workerBusy)) / static_cast<double>(items);
+		size_t lo = std::min(minimum_batch_size, st->opts.bufSize);
+		size_t hi = st->opts.bufSize;
+		if (perItem * hi <= target_batch_time) {
+			m_batchSize = hi;
+			return;
+		}
+		double size = target_batch_time / perItem;
+		m_batchSize = std::max(lo, std::min(hi, static_cast<size_t>(size)));
+	}
+
+	template <typename F>
+	void wait_for_workers(F ready) {
+		time_point start = now();
+		st->wait_producer(this, ready);
+		m_producerWait += microseconds_since(start);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Check if a worker is waiting for the main thread.
 	///
@@ -776,9 +1004,9 @@ private:
 				case PARTIAL_OUTPUT:
 				case OUTPUTTING:
 					// If we have to maintain order of items, the only
-					// outputting worker we consider to be waiting is the
-					// "front worker".
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
+					// outputting workers we consider to be waiting are the
+					// "front worker" and those whose output can be held back.
+					if (!can_receive(i))
 						break;
 					// fallthrough
 				case IDLE:
@@ -810,7 +1038,7 @@ private:
 					break;
 				case PARTIAL_OUTPUT:
 				case OUTPUTTING:
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
+					if (!can_receive(i))
 						break;
 					readyIdx = i;
 					return true;
@@ -848,6 +1076,17 @@ private:
 		return false;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Check if a worker has output for us or no worker is processing.
+	///
+	/// Used in end() to wait for the workers. Since only processing workers
+	/// can start outputting, checking has_outputting_pipe() after this has
+	/// returned true tells whether all items have been processed.
+	///////////////////////////////////////////////////////////////////////////
+	bool has_output_or_finished() {
+		return !has_processing_pipe() || has_outputting_pipe();
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Propagate progress information.
 	///////////////////////////////////////////////////////////////////////////
@@ -877,6 +1116,13 @@ public:
 		, written(0)
 		, cons(new consumer_t(cons))
 		, m_steps(0)
+		, m_batchSize(st->opts.bufSize)
+		, m_nextSeq(0)
+		, m_nextOutput(0)
+		, m_stashed(0)
+		, m_batches(0)
+		, m_items(0)
+		, m_producerWait(0)
 	{
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
 			this->add_push_destination(st->input(i));
@@ -886,15 +1132,23 @@ public:
 			st->opts.numJobs * st->opts.bufSize * (sizeof(T1) + sizeof(T2)) // workers
 			+ st->opts.bufSize * sizeof(item_type) // our buffer
 			;
+		if (st->opts.maintainOrder)
+			usage += st->opts.reorderBatches * st->opts.bufSize * sizeof(T2); // reorder ring
 		this->set_minimum_memory(usage);
-
-		if (st->opts.maintainOrder) {
-			m_outputOrder.resize(st->opts.numJobs);
-		}
 	}
 
 	virtual void begin() override {
 		inputBuffer.resize(st->opts.bufSize);
+		m_workerBatch.resize(st->opts.numJobs);
+		if (st->opts.maintainOrder && st->opts.reorderBatches > 0) {
+			m_ring.resize(st->opts.numJobs + st->opts.reorderBatches);
+			m_reorderItems.resize(st->opts.reorderBatches * st->opts.bufSize);
+			m_reorderBuffers.resize(st->opts.reorderBatches);
+			for (size_t i = 0; i < st->opts.reorderBatches; ++i)
+				m_reorderBuffers[i] = &m_reorderItems[i * st->opts.bufSize];
+		}
+		if (st->opts.adaptive)
+			m_batchSize = std::min(st->opts.bufSize, 4*minimum_batch_size);
 
 		state_base::lock_t lock(st->mutex);
 		while (st->runningWorkers != st->opts.numJobs) {
@@ -913,24 +1167,24 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void push(item_type item) {
 		inputBuffer[written++] = item;
-		if (written < st->opts.bufSize) {
+		if (written < m_batchSize) {
 			// Wait for more items before doing anything expensive such as
-			// locking.
+			// synchronizing with the workers.
 			return;
 		}
-		state_base::lock_t lock(st->mutex);
 
 		flush_steps();
 
-		empty_input_buffer(lock);
+		empty_input_buffer();
+
+		adapt_batch_size();
 	}
 
 private:
-	void empty_input_buffer(state_base::lock_t & lock) {
+	void empty_input_buffer() {
 		while (written > 0) {
-			while (!has_ready_pipe()) {
-				st->producerCond.wait(lock);
-			}
+			// has_ready_pipe sets readyIdx when it returns true.
+			wait_for_workers(&producer::has_ready_pipe);
 			switch (st->get_state(readyIdx)) {
 				case INITIALIZING:
 					throw tpie::exception("State 'INITIALIZING' not expected at this point");
@@ -941,35 +1195,27 @@ private:
 					item_type * last = first + written;
 					parallel_input_buffer<T1> & dest = *st->m_inputBuffers[readyIdx];
 					dest.set_input(array_view<T1>(first, last));
+					m_workerBatch[readyIdx] = m_nextSeq++;
 					st->transition_state(readyIdx, IDLE, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
+					st->unpark_worker(readyIdx);
+					++m_batches;
+					m_items += written;
 					written = 0;
-					if (st->opts.maintainOrder)
-						m_outputOrder.push(readyIdx);
 					break;
 				}
 				case PROCESSING:
 					throw tpie::exception("State 'processing' not expected at this point");
 				case PARTIAL_OUTPUT:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
+					// Receive buffer
+					receive_output(readyIdx, false);
 					st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
+					st->unpark_worker(readyIdx);
 					break;
 				case OUTPUTTING:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-
+					// Receive buffer
+					receive_output(readyIdx, true);
 					st->transition_state(readyIdx, OUTPUTTING, IDLE);
-					st->workerCond[readyIdx].notify_one();
-					if (st->opts.maintainOrder) {
-						if (m_outputOrder.front() != readyIdx) {
-							log_error() << "Producer: Expected " << readyIdx << " in front; got "
-								<< m_outputOrder.front() << std::endl;
-							throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-						}
-						m_outputOrder.pop();
-					}
+					st->unpark_worker(readyIdx);
 					break;
 				case DONE:
 					throw tpie::exception("State 'DONE' not expected at this point");
@@ -979,57 +1225,64 @@ private:
 
 public:
 	virtual void end() override {
-		state_base::lock_t lock(st->mutex);
-
 		flush_steps();
 
-		empty_input_buffer(lock);
+		empty_input_buffer();
 
 		inputBuffer.resize(0);
 
 		st->set_consumer_ptr(cons.get());
 
-		bool done = false;
-		while (!done) {
-			while (!has_outputting_pipe()) {
-				if (!has_processing_pipe()) {
-					done = true;
-					break;
-				}
-				// All items pushed; wait for processors to complete
-				st->producerCond.wait(lock);
-			}
-			if (done) break;
-
-			// virtual invocation
-			cons->consume(st->m_outputBuffers[readyIdx]->get_output());
+		while (true) {
+			// All items pushed; wait for processors to complete
+			wait_for_workers(&producer::has_output_or_finished);
+			if (!has_outputting_pipe()) break;
 
 			if (st->get_state(readyIdx) == PARTIAL_OUTPUT) {
+				receive_output(readyIdx, false);
 				st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-				st->workerCond[readyIdx].notify_one();
+				st->unpark_worker(readyIdx);
 				continue;
 			}
+			receive_output(readyIdx, true);
 			st->transition_state(readyIdx, OUTPUTTING, IDLE);
-			if (st->opts.maintainOrder) {
-				if (m_outputOrder.front() != readyIdx) {
-					log_error() << "Producer: Expected " << readyIdx << " in front; got "
-						<< m_outputOrder.front() << std::endl;
-					throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-				}
-				m_outputOrder.pop();
-			}
 		}
+		if (m_stashed != 0)
+			throw tpie::exception("Producer: output held back after all batches were processed");
 		// Notify all workers that all processing is done
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
 			st->transition_state(i, IDLE, DONE);
-			st->workerCond[i].notify_one();
+			st->unpark_worker(i);
 		}
+		state_base::lock_t lock(st->mutex);
 		while (st->runningWorkers > 0) {
 			st->producerCond.wait(lock);
 		}
 		// All workers terminated
 
 		flush_steps();
+		m_ring.resize(0);
+		m_reorderBuffers.resize(0);
+		m_reorderItems.resize(0);
+		report_stats();
+	}
+
+private:
+	void report_stats() {
+		parallel_stats stats;
+		stats.batches = m_batches;
+		stats.items = m_items;
+		stats.workerBusy = to_seconds(atomic_read(st->workerBusy));
+		stats.workerIdle = to_seconds(atomic_read(st->workerIdle));
+		stats.workerBlocked = to_seconds(atomic_read(st->workerBlocked));
+		stats.producerWait = to_seconds(m_producerWait);
+		stats.batchSize = m_batchSize;
+		if (st->opts.stats) *st->opts.stats = stats;
+		log_debug() << "Parallel: " << stats.items << " items in " << stats.batches
+			<< " batches, final batch size " << stats.batchSize
+			<< "; workers busy " << stats.workerBusy << " s, idle " << stats.workerIdle
+			<< " s, blocked " << stats.workerBlocked << " s; producer waited "
+			<< stats.producerWait << " s" << std::endl;
 	}
 };
 
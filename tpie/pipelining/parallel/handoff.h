@@ -0,0 +1,208 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_PARALLEL_HANDOFF_H__
+#define __TPIE_PIPELINING_PARALLEL_HANDOFF_H__
+
+#include <tpie/types.h>
+#include <tpie/pipelining/parallel/worker_state.h>
+#include <boost/thread.hpp>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace parallel_bits {
+
+/** Number of times a waiting thread polls before it parks. */
+const size_t handoff_spins = 4096;
+
+inline void cpu_relax() {
+#if defined(_MSC_VER)
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+inline void full_barrier() {
+#ifdef _WIN32
+	_ReadWriteBarrier();
+	_mm_mfence();
+#else
+	__sync_synchronize();
+#endif
+}
+
+inline long atomic_load(const volatile long & x) {
+#ifdef _WIN32
+	long v = x;
+	_ReadWriteBarrier();
+	return v;
+#else
+	return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+#endif
+}
+
+inline void atomic_store(volatile long & x, long v) {
+#ifdef _WIN32
+	_InterlockedExchange(&x, v);
+#else
+	__atomic_store_n(&x, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Set x to desired if it equals expected.
+/// \returns  The previous value of x.
+///////////////////////////////////////////////////////////////////////////////
+inline long compare_and_swap(volatile long & x, long expected, long desired) {
+#ifdef _WIN32
+	return _InterlockedCompareExchange(&x, desired, expected);
+#else
+	return __sync_val_compare_and_swap(&x, expected, desired);
+#endif
+}
+
+inline void atomic_add(volatile stream_size_type & x, stream_size_type v) {
+#ifdef _WIN32
+	_InterlockedExchangeAdd64(reinterpret_cast<volatile __int64 *>(&x), static_cast<__int64>(v));
+#else
+	__sync_fetch_and_add(&x, v);
+#endif
+}
+
+inline stream_size_type atomic_read(volatile stream_size_type & x) {
+#ifdef _WIN32
+	return static_cast<stream_size_type>(
+		_InterlockedCompareExchange64(reinterpret_cast<volatile __int64 *>(&x), 0, 0));
+#else
+	return __sync_fetch_and_add(&x, 0);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Lets a single thread wait for a condition changed by other
+/// threads without locking in the common case.
+///
+/// The waiting thread polls the condition handoff_spins times before it
+/// parks on a condition variable. A thread that changes the condition calls
+/// unpark(), which only takes the lock when the waiter is actually parked.
+/// Spinning is disabled on machines with a single hardware thread.
+///////////////////////////////////////////////////////////////////////////////
+class parker {
+public:
+	parker()
+		: m_parked(0)
+		, m_spins(boost::thread::hardware_concurrency() > 1 ? handoff_spins : 0)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wait until (obj->*ready)() returns true.
+	///
+	/// Only the thread owning this parker may wait on it.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename C, typename F>
+	void wait(C * obj, F ready) {
+		for (size_t i = 0; i < m_spins; ++i) {
+			if ((obj->*ready)()) return;
+			cpu_relax();
+		}
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		atomic_store(m_parked, 1);
+		// Pairs with the barrier in unpark(): either we see the change or
+		// the changing thread sees that we are parked.
+		full_barrier();
+		while (!(obj->*ready)()) {
+			m_cond.wait(lock);
+		}
+		atomic_store(m_parked, 0);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Wake the waiting thread, if it is parked. Must be called after
+	/// changing the condition it waits for.
+	///////////////////////////////////////////////////////////////////////////
+	void unpark() {
+		full_barrier();
+		if (atomic_load(m_parked)) {
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			m_cond.notify_one();
+		}
+	}
+
+private:
+	volatile long m_parked;
+	const size_t m_spins;
+	boost::mutex m_mutex;
+	boost::condition_variable m_cond;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Single-producer, single-consumer handoff between the main thread
+/// and one worker.
+///
+/// The state word is changed by one side at a time: the worker moves itself
+/// out of INITIALIZING and PROCESSING, and the main thread moves the worker
+/// out of IDLE, PARTIAL_OUTPUT and OUTPUTTING. The input and output buffers
+/// of the worker are published by the change of state.
+///////////////////////////////////////////////////////////////////////////////
+class worker_handoff {
+public:
+	worker_handoff()
+		: blocked(0)
+		, m_state(INITIALIZING)
+	{
+	}
+
+	worker_state get_state() {
+		return static_cast<worker_state>(atomic_load(m_state));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Change the state from `from` to `to`.
+	/// \returns  false if the state was not `from`.
+	///////////////////////////////////////////////////////////////////////////
+	bool transition(worker_state from, worker_state to) {
+		return compare_and_swap(m_state, from, to) == from;
+	}
+
+	/** Parked on by the worker while waiting for the main thread. */
+	parker worker;
+
+	/** Microseconds the worker has waited for its output to be taken.
+	 * Only used by the worker thread. */
+	stream_size_type blocked;
+
+private:
+	volatile long m_state;
+};
+
+} // namespace parallel_bits
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PARALLEL_HANDOFF_H__
@@ -20,21 +20,91 @@
 #ifndef __TPIE_PIPELINING_PARALLEL_OPTIONS_H__
 #define __TPIE_PIPELINING_PARALLEL_OPTIONS_H__
 
+#include <tpie/types.h>
+
 namespace tpie {
 
 namespace pipelining {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Statistics collected by a parallel() section, for finding out
+/// whether the workers are starved or blocked.
+///
+/// The times are wall clock seconds, summed over all workers.
+///////////////////////////////////////////////////////////////////////////////
+struct parallel_stats {
+	parallel_stats()
+		: batches(0)
+		, items(0)
+		, workerBusy(0.0)
+		, workerIdle(0.0)
+		, workerBlocked(0.0)
+		, producerWait(0.0)
+		, batchSize(0)
+	{
+	}
+
+	/** Number of batches and items sent to the workers. */
+	stream_size_type batches;
+	stream_size_type items;
+
+	/** Time spent processing items. */
+	double workerBusy;
+
+	/** Time spent waiting for input. */
+	double workerIdle;
+
+	/** Time spent waiting for the main thread to take the output. */
+	double workerBlocked;
+
+	/** Time the main thread spent waiting for a worker. */
+	double producerWait;
+
+	/** The batch size used at the end. */
+	memory_size_type batchSize;
+};
+
 namespace parallel_bits {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief  User-supplied options to the parallelism framework.
 ///////////////////////////////////////////////////////////////////////////////
 struct options {
+	options()
+		: maintainOrder(false)
+		, numJobs(0)
+		, bufSize(0)
+		, adaptive(false)
+		, reorderBatches(0)
+		, stats(0)
+	{
+	}
+
 	bool maintainOrder;
 	size_t numJobs;
+
+	/** Capacity of the buffers, and the batch size unless adaptive. */
 	size_t bufSize;
+
+	/** Choose the batch size from the measured time per item, aiming for
+	 * target_batch_time seconds per batch. */
+	bool adaptive;
+
+	/** With maintainOrder, the number of batches the main thread may hold
+	 * back while waiting for an earlier batch, letting the workers that
+	 * output them run ahead. */
+	size_t reorderBatches;
+
+	/** If not null, receives the statistics when the section ends. */
+	parallel_stats * stats;
 };
 
+/** Time per batch that the adaptive batch size aims for, in seconds. */
+const double target_batch_time = 0.002;
+
+/** Smallest adaptive batch size. */
+const size_t minimum_batch_size = 16;
+
 } // namespace parallel_bits
 
 } // namespace pipelining
@@ -66,6 +66,40 @@ parallel(const pipe_middle<fact_t> & fact, maintain_order_type maintainOrder = a
 	return parallel(fact, maintainOrder, default_worker_count());
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs a pipeline in multiple threads, choosing the batch size from
+/// the measured processing time per item.
+///
+/// Cheap items are sent in large batches to make locking rare, and expensive
+/// items in small batches to keep the workers evenly loaded. When order is
+/// maintained, workers may run up to 2*numJobs batches ahead of the slowest
+/// batch.
+///
+/// \param maintainOrder  Whether to make sure that items are processed and
+/// output in the order they are input.
+/// \param numJobs  The number of threads to utilize for parallel execution.
+/// \param bufSize  The largest number of items sent between threads at a time.
+/// \param stats  If not null, receives statistics when the pipeline ends.
+///////////////////////////////////////////////////////////////////////////////
+template <typename fact_t>
+pipe_middle<parallel_bits::factory<fact_t> >
+parallel_adaptive(const pipe_middle<fact_t> & fact,
+				  maintain_order_type maintainOrder = arbitrary_order,
+				  size_t numJobs = default_worker_count(),
+				  size_t bufSize = 16384,
+				  parallel_stats * stats = 0) {
+	parallel_bits::options opts;
+	opts.maintainOrder = maintainOrder == maintain_order;
+	opts.numJobs = numJobs;
+	opts.bufSize = bufSize;
+	opts.adaptive = true;
+	opts.reorderBatches = opts.maintainOrder ? 2*numJobs : 0;
+	opts.stats = stats;
+	return pipe_middle<parallel_bits::factory<fact_t> >
+		(parallel_bits::factory<fact_t>
+		 (fact.factory, opts));
+}
+
 template <typename fact_t>
 pipe_middle<parallel_bits::factory<fact_t> >
 parallel(const pipe_middle<fact_t> & fact, bool maintainOrder, size_t numJobs, size_t bufSize = 2048) {
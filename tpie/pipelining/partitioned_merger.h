@@ -0,0 +1,421 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_PARTITIONED_MERGER_H__
+#define __TPIE_PIPELINING_PARTITIONED_MERGER_H__
+
+#include <tpie/pipelining/sorter_job.h>
+#include <tpie/loser_tree.h>
+#include <tpie/file_stream.h>
+#include <tpie/file_count.h>
+#include <tpie/tempname.h>
+#include <tpie/tpie_log.h>
+#include <algorithm>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Merges sorted runs in parallel by partitioning the keys into
+/// ranges that are merged independently on the job pool.
+///
+/// Splitters are chosen from a sample of each run, and each key range is
+/// located in every run by binary search on memory mapped run files. Up to
+/// a given number of ranges are merged concurrently into buffers of their
+/// own, which are handed out in key order by pull(). A range that does not
+/// fit in its buffer is continued when the buffer has been pulled.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t>
+class partitioned_merger {
+public:
+	partitioned_merger(pred_t pred)
+		: m_pred(pred)
+		, m_itemCount(0)
+		, m_rangeCount(0)
+		, m_nextRange(0)
+		, m_currentRange(0)
+		, m_itemsPulled(0)
+	{
+	}
+
+	~partitioned_merger() {
+		reset();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Start merging the given runs, each of which fills a whole
+	/// file.
+	///
+	/// \param jobs Number of ranges merged concurrently.
+	/// \param memory Memory available for the buffers, open streams, samples
+	/// and splitters.
+	/// \returns False if the runs cannot be merged in parallel, for instance
+	/// because the files cannot be memory mapped, in which case the merger
+	/// is left empty.
+	///////////////////////////////////////////////////////////////////////////
+	bool reset(array<temp_file *> & runs, memory_size_type jobs, memory_size_type memory) {
+		reset();
+		const memory_size_type k = runs.size();
+		if (k == 0 || jobs == 0) return false;
+
+		// The consumer pulls one buffer while the jobs fill the others, and
+		// each buffer keeps all runs open.
+		memory_size_type slots = jobs + 1;
+		while (slots > 2 && slots * k > available_files()) --slots;
+		if (slots * k > available_files()) return false;
+		if (memory / slots <= slot_memory_usage(k, 0)) return false;
+
+		m_runs.resize(k);
+		m_runSizes.resize(k);
+		array<file_stream<T> > in(k);
+		for (memory_size_type i = 0; i < k; ++i) {
+			m_runs[i] = runs[i];
+			open_run(in[i], i, access_random);
+			if (in[i].size() > 0 && !in[i].memory_mapped()) {
+				log_debug() << "Run files cannot be memory mapped; merge sequentially" << std::endl;
+				reset();
+				return false;
+			}
+			m_runSizes[i] = in[i].size();
+			m_itemCount += m_runSizes[i];
+		}
+		if (m_itemCount == 0) {
+			reset();
+			return false;
+		}
+
+		// The samples and splitters are kept while the buffers are filled,
+		// so they are paid for out of the same memory. Smaller buffers mean
+		// more ranges and thus more samples, so repeat until the reserved
+		// memory suffices.
+		memory_size_type reserved = 0;
+		memory_size_type bufferItems;
+		for (;;) {
+			if (reserved >= memory || (memory - reserved) / slots <= slot_memory_usage(k, 0)) {
+				reset();
+				return false;
+			}
+			bufferItems = ((memory - reserved) / slots - slot_memory_usage(k, 0)) / sizeof(T);
+			if (bufferItems == 0) {
+				reset();
+				return false;
+			}
+			m_rangeCount = static_cast<memory_size_type>((m_itemCount + bufferItems - 1) / bufferItems);
+			memory_size_type needed = splitter_memory_usage(k, m_rangeCount);
+			if (needed <= reserved) break;
+			reserved = needed;
+		}
+		choose_splitters(in);
+		in.resize(0);
+
+		slots = std::min(slots, m_rangeCount);
+		log_debug() << "Merge " << m_itemCount << " items in " << m_rangeCount << " ranges of about "
+					<< bufferItems << " items using " << slots << " buffers" << std::endl;
+		m_jobs.resize(slots, 0);
+		for (memory_size_type i = 0; i < slots; ++i)
+			m_jobs[i] = tpie_new<range_job>(*this, bufferItems);
+		for (m_nextRange = 0; m_nextRange < slots; ++m_nextRange) {
+			m_jobs[m_nextRange]->set_range(m_nextRange);
+			m_jobs[m_nextRange]->enqueue();
+		}
+		m_currentRange = 0;
+		m_itemsPulled = 0;
+		wait_for_range();
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Stop merging and free all buffers and streams.
+	///////////////////////////////////////////////////////////////////////////
+	void reset() {
+		for (memory_size_type i = 0; i < m_jobs.size(); ++i) {
+			m_jobs[i]->join();
+			tpie_delete(m_jobs[i]);
+		}
+		m_jobs.resize(0);
+		m_runs.resize(0);
+		m_runSizes.resize(0);
+		m_samples.resize(0);
+		m_sampleBegin.resize(0);
+		m_splitters.resize(0);
+		m_itemCount = 0;
+		m_rangeCount = 0;
+	}
+
+	bool can_pull() {
+		while (m_jobs.size() > 0) {
+			if (m_itemsPulled < current().item_count()) return true;
+			next_buffer();
+		}
+		return false;
+	}
+
+	T pull() {
+		bool more = can_pull();
+		tp_assert(more, "pull() while !can_pull()");
+		unused(more);
+		return current().item(m_itemsPulled++);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by a buffer of the given number of items and the
+	/// streams of one range merge. The run files are memory mapped, so the
+	/// streams need no block buffers.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type slot_memory_usage(memory_size_type runs, memory_size_type bufferItems) {
+		return sizeof(range_job)
+			+ static_cast<memory_size_type>(array<T>::memory_usage(bufferItems))
+			+ static_cast<memory_size_type>(array<file_stream<T> >::memory_usage(runs))
+			+ runs * (file_stream<T>::memory_usage(0.0) - sizeof(file_stream<T>))
+			+ static_cast<memory_size_type>(loser_tree<T, pred_t>::memory_usage(runs))
+			+ static_cast<memory_size_type>(array<stream_size_type>::memory_usage(runs));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by the samples and splitters that divide the runs
+	/// into the given number of ranges. Choosing the splitters temporarily
+	/// takes as much again for a sorted copy of the samples, but that copy is
+	/// freed before the buffers are allocated.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type splitter_memory_usage(memory_size_type runs, memory_size_type ranges) {
+		// Rounding up the samples of each run adds at most one per run.
+		memory_size_type samples = ranges * samplesPerRange + runs;
+		return static_cast<memory_size_type>(array<T>::memory_usage(samples))
+			+ static_cast<memory_size_type>(array<memory_size_type>::memory_usage(runs + 1))
+			+ static_cast<memory_size_type>(array<T>::memory_usage(ranges - 1));
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Job merging one key range at a time into its buffer.
+	///////////////////////////////////////////////////////////////////////////
+	class range_job : public sorter_job {
+	public:
+		range_job(partitioned_merger & owner, memory_size_type bufferItems)
+			: m_owner(owner)
+			, m_buffer(bufferItems)
+			, m_in(owner.m_runs.size())
+			, m_itemsLeft(owner.m_runs.size())
+			, m_tree(owner.m_runs.size(), owner.m_pred)
+			, m_range(0)
+			, m_itemCount(0)
+			, m_started(false)
+		{
+			for (memory_size_type i = 0; i < m_in.size(); ++i)
+				owner.open_run(m_in[i], i, access_normal);
+		}
+
+		void set_range(memory_size_type range) {
+			m_range = range;
+			m_itemCount = 0;
+			m_started = false;
+		}
+
+		memory_size_type range() const {return m_range;}
+		memory_size_type item_count() const {return m_itemCount;}
+		const T & item(memory_size_type i) const {return m_buffer[i];}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Whether the entire range has been merged into the buffer.
+		///////////////////////////////////////////////////////////////////////
+		bool finished() const {return m_started && m_tree.empty();}
+
+	protected:
+		virtual void perform() {
+			if (!m_started) {
+				start_range();
+				m_started = true;
+			}
+			m_itemCount = 0;
+			while (m_itemCount < m_buffer.size() && !m_tree.empty()) {
+				memory_size_type i = m_tree.top_index();
+				m_buffer[m_itemCount++] = m_tree.top();
+				if (m_itemsLeft[i] > 0) {
+					m_tree.pop_and_push(m_in[i].read());
+					--m_itemsLeft[i];
+				} else {
+					m_tree.pop();
+				}
+			}
+		}
+
+	private:
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Locate the range in every run and fill the loser tree with
+		/// the first item of each.
+		///////////////////////////////////////////////////////////////////////
+		void start_range() {
+			m_tree.clear();
+			for (memory_size_type i = 0; i < m_in.size(); ++i) {
+				stream_size_type begin = (m_range == 0)
+					? 0 : m_owner.lower_bound(m_in[i], i, m_owner.m_splitters[m_range-1]);
+				stream_size_type end = (m_range+1 == m_owner.m_rangeCount)
+					? m_owner.m_runSizes[i] : m_owner.lower_bound(m_in[i], i, m_owner.m_splitters[m_range]);
+				m_itemsLeft[i] = 0;
+				if (begin == end) continue;
+				m_in[i].seek(begin);
+				m_tree.unsafe_set(i, m_in[i].read());
+				m_itemsLeft[i] = end - begin - 1;
+			}
+			m_tree.make_safe();
+		}
+
+		partitioned_merger & m_owner;
+		array<T> m_buffer;
+		array<file_stream<T> > m_in;
+		array<stream_size_type> m_itemsLeft;
+		loser_tree<T, pred_t> m_tree;
+		memory_size_type m_range;
+		memory_size_type m_itemCount;
+		bool m_started;
+	};
+
+	// Average number of samples per range used to choose the splitters.
+	static const memory_size_type samplesPerRange = 8;
+
+	void open_run(file_stream<T> & fs, memory_size_type run, cache_hint cacheHint) {
+		fs.set_memory_mapped(true);
+		fs.open(*m_runs[run], access_read, 0, cacheHint);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Read evenly spaced samples from each run, proportionally to its
+	/// size, and choose m_rangeCount-1 splitters from their quantiles.
+	///////////////////////////////////////////////////////////////////////////
+	void choose_splitters(array<file_stream<T> > & in) {
+		const memory_size_type k = in.size();
+		const stream_size_type wanted = static_cast<stream_size_type>(m_rangeCount) * samplesPerRange;
+		m_sampleBegin.resize(k+1);
+		memory_size_type total = 0;
+		for (memory_size_type i = 0; i < k; ++i) {
+			m_sampleBegin[i] = total;
+			stream_size_type n = (wanted * m_runSizes[i] + m_itemCount - 1) / m_itemCount;
+			total += static_cast<memory_size_type>(std::min(n, m_runSizes[i]));
+		}
+		m_sampleBegin[k] = total;
+
+		m_samples.resize(total);
+		for (memory_size_type i = 0; i < k; ++i) {
+			for (memory_size_type t = 0; t < sample_count(i); ++t) {
+				in[i].seek(sample_position(i, t));
+				m_samples[m_sampleBegin[i] + t] = in[i].read();
+			}
+		}
+
+		array<T> sorted(m_samples);
+		std::sort(sorted.begin(), sorted.end(), m_pred);
+		m_splitters.resize(m_rangeCount - 1);
+		for (memory_size_type r = 0; r + 1 < m_rangeCount; ++r) {
+			memory_size_type idx = static_cast<memory_size_type>(
+				static_cast<stream_size_type>(r + 1) * total / m_rangeCount);
+			m_splitters[r] = sorted[std::min(idx, total - 1)];
+		}
+	}
+
+	memory_size_type sample_count(memory_size_type run) const {
+		return m_sampleBegin[run+1] - m_sampleBegin[run];
+	}
+
+	stream_size_type sample_position(memory_size_type run, memory_size_type t) const {
+		return static_cast<stream_size_type>(t) * m_runSizes[run] / sample_count(run);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Find the first item in the run that is not less than x. The
+	/// samples of the run narrow down the part of the file to search.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type lower_bound(file_stream<T> & fs, memory_size_type run, const T & x) {
+		typename array<T>::const_iterator samples = m_samples.begin() + m_sampleBegin[run];
+		memory_size_type n = sample_count(run);
+		memory_size_type t = std::lower_bound(samples, samples + n, x, m_pred) - samples;
+		stream_size_type lo = (t == 0) ? 0 : sample_position(run, t-1) + 1;
+		stream_size_type hi = (t == n) ? m_runSizes[run] : sample_position(run, t);
+		while (lo < hi) {
+			stream_size_type mid = lo + (hi - lo) / 2;
+			fs.seek(mid);
+			if (m_pred(fs.read(), x))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	range_job & current() {
+		return *m_jobs[m_currentRange % m_jobs.size()];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the buffer of the current range and rethrow the error
+	/// of its job, if any.
+	///////////////////////////////////////////////////////////////////////////
+	void wait_for_range() {
+		current().join();
+		current().rethrow();
+		m_itemsPulled = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Called when the current buffer has been pulled. Continue the
+	/// current range, or hand its job the next unassigned range and move on
+	/// to the next range.
+	///////////////////////////////////////////////////////////////////////////
+	void next_buffer() {
+		range_job & j = current();
+		if (!j.finished()) {
+			j.enqueue();
+			wait_for_range();
+			return;
+		}
+		if (m_nextRange < m_rangeCount) {
+			j.set_range(m_nextRange++);
+			j.enqueue();
+		}
+		if (++m_currentRange == m_rangeCount) {
+			reset();
+			return;
+		}
+		wait_for_range();
+	}
+
+	pred_t m_pred;
+	array<temp_file *> m_runs;
+	array<stream_size_type> m_runSizes;
+	stream_size_type m_itemCount;
+
+	// Samples of each run, concatenated, and the index of the first sample
+	// of each run. Sample t of run i is at position t*size/count.
+	array<T> m_samples;
+	array<memory_size_type> m_sampleBegin;
+
+	// Range r holds the items from m_splitters[r-1] up to but excluding
+	// m_splitters[r].
+	array<T> m_splitters;
+	memory_size_type m_rangeCount;
+
+	// Range r is merged by m_jobs[r % m_jobs.size()].
+	array<range_job *> m_jobs;
+	memory_size_type m_nextRange;
+	memory_size_type m_currentRange;
+	memory_size_type m_itemsPulled;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PARTITIONED_MERGER_H__
@@ -56,7 +56,16 @@ void pipeline_base::plot(std::ostream & out) {
 	out << "digraph {\n";
 	node_map::ptr segmap = m_segmap->find_authority();
 	for (node_map::mapit i = segmap->begin(); i != segmap->end(); ++i) {
-		out << '"' << name(segmap, i->first) << "\";\n";
+		const node_stats & stats = i->second->get_stats();
+		out << '"' << name(segmap, i->first) << "\" ["
+			<< "steps=\"" << stats.steps << "\","
+			<< "begin_time=\"" << stats.beginTime << "\","
+			<< "go_time=\"" << stats.goTime << "\","
+			<< "end_time=\"" << stats.endTime << "\","
+			<< "bytes_read=\"" << stats.bytesRead << "\","
+			<< "bytes_written=\"" << stats.bytesWritten << "\","
+			<< "memory_assigned=\"" << stats.memoryAssigned << "\","
+			<< "memory_used=\"" << stats.memoryUsed << "\"];\n";
 	}
 	const node_map::relmap_t & relations = segmap->get_relations();
 	for (node_map::relmapit i = relations.begin(); i != relations.end(); ++i) {
@@ -77,7 +86,6 @@ void pipeline_base::plot(std::ostream & out) {
 
 void pipeline_base::operator()(stream_size_type items, progress_indicator_base & pi, const memory_size_type initialMemory) {
 	typedef std::vector<phase> phases_t;
-	typedef phases_t::const_iterator it;
 
 	node_map::ptr map = m_segmap->find_authority();
 	graph_traits g(*map);
@@ -93,13 +101,16 @@ void pipeline_base::operator()(stream_size_type items, progress_indicator_base &
 	}
 
 	log_debug() << "Assigning " << mem << " b memory to each pipelining phase." << std::endl;
-	for (it i = phases.begin(); i != phases.end(); ++i) {
-		i->assign_memory(mem);
+	for (size_t i = 0; i < phases.size(); ++i) {
+		// Concurrent phases share the memory.
+		const size_t concurrency = m_concurrentPhases ? g.concurrency(i) : 1;
+		phases[i].assign_memory(mem / concurrency);
 #ifndef TPIE_NDEBUG
-		i->print_memory(log_debug());
+		phases[i].print_memory(log_debug());
 #endif // TPIE_NDEBUG
 	}
-	g.go_all(items, pi);
+	g.go_all(items, pi, m_concurrentPhases);
+	if (m_statsOutput) plot(*m_statsOutput);
 }
 
 void pipeline_base::forward_any(std::string key, const boost::any & value) {
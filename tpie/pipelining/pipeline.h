@@ -38,6 +38,13 @@ namespace bits {
 ///////////////////////////////////////////////////////////////////////////////
 class pipeline_base {
 public:
+	pipeline_base()
+		: m_memory(0)
+		, m_concurrentPhases(false)
+		, m_statsOutput(0)
+	{
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Invoke the pipeline.
 	///////////////////////////////////////////////////////////////////////////
@@ -52,6 +59,10 @@ public:
 	///
 	/// Thus, a downwards arrow in the plot is a push edge, and an upwards
 	/// arrow is a pull edge (assuming no cycles in the item flow graph).
+	///
+	/// Each node carries the node_stats of the last run as the attributes
+	/// steps, begin_time, go_time, end_time, bytes_read, bytes_written,
+	/// memory_assigned and memory_used, which are zero before the first run.
 	///////////////////////////////////////////////////////////////////////////
 	void plot(std::ostream & out);
 
@@ -59,6 +70,31 @@ public:
 		return m_memory;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Run phases that do not depend on each other concurrently on
+	/// the job pool, e.g. the sorts of two inputs that are joined
+	/// afterwards. The memory is divided evenly between concurrent phases.
+	///
+	/// The nodes of concurrent phases must not share state other than through
+	/// dependencies. Requires the job manager to be initialized.
+	///////////////////////////////////////////////////////////////////////////
+	void set_concurrent_phases(bool concurrent) {
+		m_concurrentPhases = concurrent;
+	}
+
+	bool get_concurrent_phases() const {
+		return m_concurrentPhases;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Write the plot of the pipeline, including the node_stats of
+	/// every node, to the given stream when the pipeline has run, or stop
+	/// reporting if out is null.
+	///////////////////////////////////////////////////////////////////////////
+	void set_stats_output(std::ostream * out) {
+		m_statsOutput = out;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Virtual dtor.
 	///////////////////////////////////////////////////////////////////////////
@@ -77,6 +113,8 @@ public:
 protected:
 	node_map::ptr m_segmap;
 	double m_memory;
+	bool m_concurrentPhases;
+	std::ostream * m_statsOutput;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -143,6 +181,12 @@ public:
 	inline double memory() const {
 		return p->memory();
 	}
+	inline void set_concurrent_phases(bool concurrent) {
+		p->set_concurrent_phases(concurrent);
+	}
+	inline void set_stats_output(std::ostream * out) {
+		p->set_stats_output(out);
+	}
 	inline bits::node_map::ptr get_node_map() const {
 		return p->get_node_map();
 	}
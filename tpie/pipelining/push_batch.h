@@ -0,0 +1,149 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_PUSH_BATCH_H__
+#define __TPIE_PIPELINING_PUSH_BATCH_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file push_batch.h  Pushing items to nodes in batches.
+///
+/// A push node may have, besides push(const item_type &), a member
+///
+///     void push_batch(array_view<const item_type> items);
+///
+/// that accepts a batch of contiguous items. Nodes that have items in
+/// contiguous memory, such as file_stream input, pass them on with
+/// push_items(dest, items), which calls dest.push_batch when dest has it and
+/// otherwise pushes the items one at a time. Since dest_t is a template
+/// parameter, the choice is made at compile time.
+///
+/// A push_batch member must be declared in the node class itself; one
+/// inherited from a base class is not detected.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/array.h>
+#include <tpie/array_view.h>
+#include <boost/type_traits/is_same.hpp>
+
+namespace tpie {
+
+namespace pipelining {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Checks if a push node has a push_batch member accepting
+/// array_view<const item_type>.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class has_push_batch {
+private:
+	template <typename TT, void (TT::*)(array_view<const typename TT::item_type>)>
+	struct check {};
+	template <typename TT>
+	static char magic(check<TT, &TT::push_batch> *);
+	template <typename TT>
+	static long magic(...);
+public:
+	static bool const value=sizeof(magic<T>(0))==sizeof(char);
+};
+
+namespace bits {
+
+template <bool batch>
+struct push_items_impl {
+	template <typename dest_t, typename T>
+	static void push(dest_t & dest, array_view<const T> items) {
+		dest.push_batch(items);
+	}
+};
+
+template <>
+struct push_items_impl<false> {
+	template <typename dest_t, typename T>
+	static void push(dest_t & dest, array_view<const T> items) {
+		for (size_t i = 0; i < items.size(); ++i) {
+			dest.push(items[i]);
+		}
+	}
+};
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Push a batch of items to dest, using dest.push_batch if it has
+/// one and pushing the items one at a time otherwise.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, typename T>
+inline void push_items(dest_t & dest, array_view<const T> items) {
+	bits::push_items_impl<has_push_batch<dest_t>::value
+		&& boost::is_same<T, typename dest_t::item_type>::value>::push(dest, items);
+}
+
+/** Number of items a batch_output collects before pushing them. */
+const memory_size_type batch_output_items = 1024;
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Output of a node that computes new items in its push_batch.
+///
+/// If dest has push_batch, the items are collected and pushed in batches of
+/// batch_output_items; otherwise they are pushed directly.
+/// Call flush at the end of each push_batch.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t, bool batch = has_push_batch<dest_t>::value>
+class batch_output {
+public:
+	typedef typename dest_t::item_type item_type;
+
+	batch_output() : m_size(0) {}
+
+	void push(dest_t & dest, const item_type & item) {
+		if (m_items.size() == 0) m_items.resize(batch_output_items);
+		m_items[m_size++] = item;
+		if (m_size == m_items.size()) flush(dest);
+	}
+
+	void flush(dest_t & dest) {
+		if (m_size == 0) return;
+		array_view<const item_type> items(m_items.get(), m_size);
+		m_size = 0;
+		dest.push_batch(items);
+	}
+
+private:
+	array<item_type> m_items;
+	memory_size_type m_size;
+};
+
+template <typename dest_t>
+class batch_output<dest_t, false> {
+public:
+	typedef typename dest_t::item_type item_type;
+
+	void push(dest_t & dest, const item_type & item) {
+		dest.push(item);
+	}
+
+	void flush(dest_t &) {}
+};
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PUSH_BATCH_H__
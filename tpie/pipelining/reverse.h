@@ -23,16 +23,21 @@
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
-#include <tpie/stack.h>
+#include <tpie/pipelining/buffer.h>
 
 namespace tpie {
 
 namespace pipelining {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Reverser with separate sink and source pipes. The items are kept
+/// in memory if they fit in the memory assigned to both, and otherwise the
+/// newest items are spilled to disk.
+///////////////////////////////////////////////////////////////////////////////
 template <typename T>
 class passive_reverser {
 public:
-	typedef std::vector<T> buf_t;
+	typedef bits::spill_buffer<T> buf_t;
 
 	class sink_t : public node {
 	public:
@@ -42,17 +47,36 @@ public:
 			: node(token)
 			, buffer(buffer)
 		{
-			it = buffer.begin();
 			set_name("Input items to reverse", PRIORITY_INSIGNIFICANT);
+			set_minimum_memory(buf_t::minimum_memory());
+			set_memory_fraction(1.0);
+		}
+
+		virtual void begin() override {
+			node::begin();
+			buffer.begin();
 		}
 
 		inline void push(const T & item) {
-			*it++ = item;
+			buffer.push(item);
+		}
+
+		virtual bool can_evacuate() override {
+			return true;
+		}
+
+		virtual void evacuate() override {
+			buffer.evacuate();
+		}
+
+	protected:
+		virtual void set_available_memory(memory_size_type availableMemory) override {
+			node::set_available_memory(availableMemory);
+			buffer.set_input_memory(availableMemory);
 		}
 
 	private:
 		buf_t & buffer;
-		typename buf_t::iterator it;
 	};
 
 	template <typename dest_t>
@@ -60,40 +84,53 @@ public:
 	public:
 		typedef T item_type;
 
-		inline source_t(const dest_t & dest, const buf_t & buffer, const node_token & sink)
+		inline source_t(const dest_t & dest, buf_t & buffer, const node_token & sink)
 			: dest(dest)
 		   	, buffer(buffer)
-			, it(buffer.rbegin())
 		{
 			add_push_destination(dest);
 			add_dependency(sink);
 			set_name("Output reversed items", PRIORITY_INSIGNIFICANT);
+			set_minimum_memory(buf_t::minimum_memory());
+			set_memory_fraction(1.0);
 		}
 
 		virtual void propagate() override {
-			forward("items", static_cast<stream_size_type>(buffer.size()));
+			forward("items", buffer.size());
+			set_steps(buffer.size());
 		}
 
-		inline void go(progress_indicator_base & pi) {
-			pi.init(buffer.size());
-			while (it != buffer.rend()) {
-				dest.push(*it++);
-				pi.step();
+		virtual void go() override {
+			buffer.rewind_back();
+			while (buffer.can_read_back()) {
+				dest.push(buffer.read_back());
+				step();
 			}
-			pi.done();
+		}
+
+		virtual void end() override {
+			buffer.free();
+		}
+
+	protected:
+		virtual void set_available_memory(memory_size_type availableMemory) override {
+			node::set_available_memory(availableMemory);
+			buffer.set_output_memory(availableMemory);
 		}
 
 	private:
 		dest_t dest;
-		const buf_t & buffer;
-		typename buf_t::const_reverse_iterator it;
+		buf_t & buffer;
 
 		source_t & operator=(const source_t & other);
 	};
 
-	inline passive_reverser(size_t buffer_size)
-		: buffer(buffer_size)
-	{
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor. The buffer size is no longer used, since the
+	/// memory is assigned by the pipeline.
+	///////////////////////////////////////////////////////////////////////////
+	inline passive_reverser(size_t buffer_size = 0) {
+		unused(buffer_size);
 	}
 
 	inline pipe_end<termfactory_2<sink_t, buf_t &, const node_token &> >
@@ -101,14 +138,17 @@ public:
 		return termfactory_2<sink_t, buf_t &, const node_token &>(buffer, sink_token);
 	}
 
-	inline pipe_begin<factory_2<source_t, const buf_t &, const node_token &> >
+	inline pipe_begin<factory_2<source_t, buf_t &, const node_token &> >
 	source() {
-		return factory_2<source_t, const buf_t &, const node_token &>(buffer, sink_token);
+		return factory_2<source_t, buf_t &, const node_token &>(buffer, sink_token);
 	}
 
 private:
 	buf_t buffer;
 	node_token sink_token;
+
+	passive_reverser(const passive_reverser &);
+	passive_reverser & operator=(const passive_reverser &);
 };
 
 namespace bits {
@@ -117,59 +157,91 @@ template <typename T>
 class reverser_input_t: public node {
 public:
 	typedef T item_type;
+	typedef typename spill_buffer<T>::ptr bufferptr;
 
-	inline reverser_input_t(const node_token & token)
+	inline reverser_input_t(const node_token & token, bufferptr buffer)
 		: node(token)
+		, m_buffer(buffer)
 	{
 		set_name("Store items", PRIORITY_SIGNIFICANT);
-		set_minimum_memory(this->the_stack->memory_usage());
+		set_minimum_memory(spill_buffer<T>::minimum_memory());
+		set_memory_fraction(1.0);
 	}
 
-	virtual void propagate() override {
-		the_stack = tpie_new<stack<item_type> >();
-		forward("stack", the_stack);
+	virtual void begin() override {
+		node::begin();
+		m_buffer->begin();
 	}
 
 	void push(const T & t) {
-		the_stack->push(t);
+		m_buffer->push(t);
+	}
+
+	bufferptr get_buffer() const {
+		return m_buffer;
+	}
+
+	virtual bool can_evacuate() override {
+		return true;
+	}
+
+	virtual void evacuate() override {
+		m_buffer->evacuate();
+	}
+
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_buffer->set_input_memory(availableMemory);
 	}
 
-	stack<T> * the_stack;
+private:
+	bufferptr m_buffer;
 };
 
 template <typename dest_t>
 class reverser_output_t: public node {
 public:
 	typedef typename dest_t::item_type item_type;
+	typedef typename spill_buffer<item_type>::ptr bufferptr;
 
-	reverser_output_t(const dest_t & dest, const node_token & input_token)
+	reverser_output_t(const dest_t & dest, const node_token & input_token, bufferptr buffer)
 		: dest(dest)
+		, m_buffer(buffer)
 	{
 		add_dependency(input_token);
 		add_push_destination(dest);
 		set_name("Output reversed", PRIORITY_INSIGNIFICANT);
-		set_minimum_memory(this->the_stack->memory_usage());
+		set_minimum_memory(spill_buffer<item_type>::minimum_memory());
+		set_memory_fraction(1.0);
 	}
 
 	virtual void propagate() override {
-		the_stack = fetch<stack<item_type> *>("stack");
-		forward("items", the_stack->size());
-		set_steps(the_stack->size());
+		forward("items", m_buffer->size());
+		set_steps(m_buffer->size());
 	}
 
 	virtual void go() override {
-		while (!the_stack->empty()) {
-			dest.push(the_stack->pop());
+		m_buffer->rewind_back();
+		while (m_buffer->can_read_back()) {
+			dest.push(m_buffer->read_back());
 			step();
 		}
 	}
 
 	virtual void end() override {
-		tpie_delete(the_stack);
+		m_buffer->free();
 	}
 
+protected:
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		m_buffer->set_output_memory(availableMemory);
+	}
+
+private:
 	dest_t dest;
-	stack<item_type> * the_stack;
+	bufferptr m_buffer;
 };
 
 
@@ -183,8 +255,8 @@ public:
 
 	inline reverser_t(const dest_t & dest)
 		: input_token()
-		, input(input_token)
-		, output(dest, input_token)
+		, input(input_token, typename input_t::bufferptr(new spill_buffer<item_type>()))
+		, output(dest, input_token, input.get_buffer())
 	{
 		add_push_destination(input);
 		set_name("Reverser", PRIORITY_INSIGNIFICANT);
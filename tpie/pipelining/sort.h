@@ -403,6 +403,9 @@ pipesort() {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Pipelining sorter using the given predicate.
+///
+/// To sort by an integer key, pass by_key(key_fn) as the predicate. Runs are
+/// then formed using radix_sort.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename pred_t>
 inline pipe_middle<bits::sort_factory<pred_t> >
@@ -35,20 +35,29 @@ struct sort_parameters {
 	 * that we can have in internal memory.
 	 */
 	memory_size_type runLength;
+	/** Number of buffers of runLength items used during phase 1. With two
+	 * buffers, a run is written to disk while the next run is formed. */
+	memory_size_type runBuffers;
 	/** Maximum item count for internal reporting, subject to memory
-	 * restrictions in all phases. Less or equal to runLength. */
+	 * restrictions in all phases. Less or equal to runLength times
+	 * runBuffers. */
 	memory_size_type internalReportThreshold;
 	/** Fanout of merge tree during phase 3. */
 	memory_size_type fanout;
 	/** Fanout of merge tree during phase 4. Less or equal to fanout. */
 	memory_size_type finalFanout;
+	/** Number of merges of the same merge level that run concurrently during
+	 * phase 2, each using the memory of a merge with the given fanout. */
+	memory_size_type parallelMerges;
 
 	void dump(std::ostream & out) const {
 		out << "Merge sort parameters\n"
 			<< "Phase 1 memory:              " << memoryPhase1 << '\n'
 			<< "Run length:                  " << runLength << '\n'
+			<< "Run buffers:                 " << runBuffers << '\n'
 			<< "Phase 2 memory:              " << memoryPhase2 << '\n'
 			<< "Fanout:                      " << fanout << '\n'
+			<< "Parallel merges:             " << parallelMerges << '\n'
 			<< "Phase 3 memory:              " << memoryPhase3 << '\n'
 			<< "Final merge level fanout:    " << finalFanout << '\n'
 			<< "Internal report threshold:   " << internalReportThreshold << '\n';
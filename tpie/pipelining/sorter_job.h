@@ -0,0 +1,77 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_PIPELINING_SORTER_JOB_H__
+#define __TPIE_PIPELINING_SORTER_JOB_H__
+
+#include <tpie/job.h>
+#include <tpie/exception.h>
+#include <string>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Base class of jobs run on behalf of a sorter. Errors raised by the
+/// job are stored and rethrown in the thread that joins it.
+///////////////////////////////////////////////////////////////////////////////
+class sorter_job : public job {
+public:
+	sorter_job()
+		: m_failed(false)
+		, m_outOfSpace(false)
+	{
+	}
+
+	virtual void operator()() {
+		// Exceptions must not escape into the worker thread.
+		try {
+			perform();
+		} catch (out_of_space_exception & e) {
+			m_failed = m_outOfSpace = true;
+			m_error = e.what();
+		} catch (std::exception & e) {
+			m_failed = true;
+			m_error = e.what();
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Rethrow the error raised by the job, if any, in the calling
+	/// thread.
+	///////////////////////////////////////////////////////////////////////////
+	void rethrow() {
+		if (!m_failed) return;
+		m_failed = false;
+		if (m_outOfSpace) throw out_of_space_exception(m_error);
+		throw io_exception(m_error);
+	}
+
+protected:
+	virtual void perform() = 0;
+
+private:
+	bool m_failed;
+	bool m_outOfSpace;
+	std::string m_error;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_SORTER_JOB_H__
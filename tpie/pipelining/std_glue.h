@@ -25,6 +25,7 @@
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/pipe_base.h>
 #include <tpie/pipelining/factory_helpers.h>
+#include <tpie/pipelining/push_batch.h>
 
 namespace tpie {
 
@@ -48,11 +49,9 @@ public:
 	}
 
 	virtual void go() override {
-		typedef typename std::vector<item_type>::const_iterator IT;
-		for (IT i = input.begin(); i != input.end(); ++i) {
-			dest.push(*i);
-			step();
-		}
+		if (input.empty()) return;
+		push_items(dest, array_view<const item_type>(&input[0], input.size()));
+		step(input.size());
 	}
 private:
 	dest_t dest;
@@ -71,6 +70,10 @@ public:
 	inline void push(const T & item) {
 		output.push_back(item);
 	}
+
+	void push_batch(array_view<const T> items) {
+		output.insert(output.end(), items.begin(), items.end());
+	}
 private:
 	std::vector<item_type> & output;
 };
@@ -84,15 +87,24 @@ public:
 		typedef typename F::argument_type item_type;
 		
 		type(const dest_t & dest, const F & f): f(f), dest(dest) {
+			add_push_destination(dest);
 			set_name("Lambda", PRIORITY_INSIGNIFICANT);
 		}
 		
 		void push(const item_type & item) {
 			dest.push(f(item));
 		}
+
+		void push_batch(array_view<const item_type> items) {
+			for (size_t i = 0; i < items.size(); ++i) {
+				output.push(dest, f(items[i]));
+			}
+			output.flush(dest);
+		}
 	private:
 		F f;
 		dest_t dest;
+		batch_output<dest_t> output;
 	};
 };
 
@@ -105,6 +117,7 @@ public:
 		typedef typename F::argument_type item_type;
 		
 		type(const dest_t & dest, const F & f): f(f), dest(dest) {
+			add_push_destination(dest);
 			set_name("Lambda", PRIORITY_INSIGNIFICANT);
 		}
 		
@@ -112,9 +125,18 @@ public:
 			typename F::result_type t=f(item);
 			if (t.second) dest.push(t.first);
 		}
+
+		void push_batch(array_view<const item_type> items) {
+			for (size_t i = 0; i < items.size(); ++i) {
+				typename F::result_type t=f(items[i]);
+				if (t.second) output.push(dest, t.first);
+			}
+			output.flush(dest);
+		}
 	private:
 		F f;
 		dest_t dest;
+		batch_output<dest_t> output;
 	};
 };
 
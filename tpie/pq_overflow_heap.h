@@ -52,6 +52,14 @@ public:
     ///////////////////////////////////////////////////////////////////////////
     void push(const T& x);
 
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Insert the elements of the range [begin, end) into the
+    /// priority queue. Large ranges are heapified together with the
+    /// elements already in the queue.
+    ///////////////////////////////////////////////////////////////////////////
+    template <typename IT>
+    void push_range(IT begin, IT end);
+
     ///////////////////////////////////////////////////////////////////////////
     /// \brief Remove the top element from the priority queue.
     ///////////////////////////////////////////////////////////////////////////
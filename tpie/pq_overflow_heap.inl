@@ -33,6 +33,19 @@ inline void pq_overflow_heap<T, Comparator>::push(const T& x) {
 	h.push(x);
 }
 
+template<typename T, typename Comparator> template <typename IT>
+inline void pq_overflow_heap<T, Comparator>::push_range(IT begin, IT end) {
+	memory_size_type n = static_cast<memory_size_type>(std::distance(begin, end));
+	assert(h.size() + n <= maxsize);
+	if(n < h.size()) {
+		// Sifting up a few elements is cheaper than heapifying everything.
+		for(; begin != end; ++begin) h.push(*begin);
+		return;
+	}
+	for(; begin != end; ++begin) h.unsafe_push(*begin);
+	h.make_safe();
+}
+
 template<typename T, typename Comparator>
 inline void pq_overflow_heap<T, Comparator>::pop() {
 	assert(!empty());
@@ -0,0 +1,187 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file pq_sequence_heap.h Priority queue overflow heap based on sorted
+/// sequences.
+/// \sa \ref priority_queue.h
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_PQ_SEQUENCE_HEAP_H_
+#define _TPIE_PQ_SEQUENCE_HEAP_H_
+
+#include <tpie/array.h>
+#include <tpie/loser_tree.h>
+#include <algorithm>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class pq_sequence_heap
+///
+/// \brief Overflow Priority Queue based on sorted sequences, in the spirit of
+/// the sequence heap of Sanders (1999).
+///
+/// Inserted elements go into a small binary heap that fits in the L1 cache.
+/// When it is full, it is sorted into a run, and runs of about the same
+/// length are merged merge_fanout at a time, so there are only
+/// logarithmically many. The minimum of the runs is kept in a loser tree over their first
+/// elements. Thus only the small heap and the fronts of the runs are accessed
+/// randomly, where pq_overflow_heap accesses a binary heap of up to maxsize
+/// elements.
+///
+/// All elements are kept in one array of maxsize elements: the runs from the
+/// left, followed by the heap. Free space after the runs is used as the
+/// merge buffer.
+///
+/// Use as the third template parameter of priority_queue.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Comparator = std::less<T> >
+class pq_sequence_heap {
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor.
+	///
+	/// \param maxsize Maximal size of queue.
+	///////////////////////////////////////////////////////////////////////////
+	pq_sequence_heap(memory_size_type maxsize, Comparator c=Comparator());
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert an element into the priority queue.
+	///
+	/// \param x The item.
+	///////////////////////////////////////////////////////////////////////////
+	void push(const T& x);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert the elements of the range [begin, end) into the
+	/// priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename IT>
+	void push_range(IT begin, IT end);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the top element from the priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	void pop();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief See what's on the top of the priority queue.
+	///
+	/// \return Top element.
+	///////////////////////////////////////////////////////////////////////////
+	const T& top();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Returns the size of the queue.
+	///
+	/// \return Queue size.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type size() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return true if queue is empty otherwise false.
+	///
+	/// \return Boolean - empty or not.
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The factor of the size, total, which is returned sorted.
+	///////////////////////////////////////////////////////////////////////////
+	static const double sorted_factor;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Returns whether the overflow heap is full or not.
+	///
+	/// \return Boolean - full or not.
+	///////////////////////////////////////////////////////////////////////////
+	bool full() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merges all elements into one sorted array and returns a pointer to
+	/// it.
+	///
+	/// \return A pointer to the sorted underlying array.
+	///////////////////////////////////////////////////////////////////////////
+	T* sorted_array();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return size of sorted array.
+	///
+	/// \return Size.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type sorted_size() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove all elements from queue.
+	///////////////////////////////////////////////////////////////////////////
+	void sorted_pop();
+
+private:
+	struct run {
+		memory_size_type begin;
+		memory_size_type end;
+		memory_size_type size() const {return end - begin;}
+	};
+
+	// Reversed comparator, such that the std heap functions make a min-heap.
+	struct heap_comp {
+		heap_comp(Comparator c) : comp(c) {}
+		bool operator()(const T & a, const T & b) const {return comp(b, a);}
+		Comparator comp;
+	};
+
+	// Upper bound on the number of runs.
+	static const memory_size_type max_runs = 64;
+	// Number of runs of about the same length that are merged together.
+	static const memory_size_type merge_fanout = 16;
+
+	void make_run();
+	void merge_last_runs(memory_size_type n);
+	void remove_empty_runs();
+	void compact();
+	void rebuild_tree();
+	bool top_in_heap() const;
+
+	Comparator comp;
+	memory_size_type maxsize;
+	memory_size_type heap_capacity;
+
+	/** Runs followed by the heap. */
+	array<T> m_items;
+	/** End of the last run and beginning of the heap. */
+	memory_size_type m_runsEnd;
+	memory_size_type m_heapSize;
+	memory_size_type m_size;
+
+	array<run> m_runs;
+	memory_size_type m_runCount;
+	loser_tree<T, Comparator> m_tree;
+	loser_tree<T, Comparator> m_mergeTree;
+};
+
+template<typename T, typename Comparator>
+const double pq_sequence_heap<T,Comparator>::sorted_factor = 1.0;
+
+#include "pq_sequence_heap.inl"
+
+}  //  tpie namespace
+
+#endif
@@ -0,0 +1,240 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+template<typename T, typename Comparator>
+pq_sequence_heap<T, Comparator>::pq_sequence_heap(memory_size_type m, Comparator c)
+	: comp(c)
+	, maxsize(m)
+	, heap_capacity(std::max(static_cast<memory_size_type>(1),
+							 std::min(m, static_cast<memory_size_type>(16*1024/sizeof(T)))))
+	, m_items(m)
+	, m_runsEnd(0)
+	, m_heapSize(0)
+	, m_size(0)
+	, m_runs(max_runs+1)
+	, m_runCount(0)
+	, m_tree(max_runs+1, c)
+	, m_mergeTree(max_runs, c)
+{
+}
+
+template<typename T, typename Comparator>
+inline void pq_sequence_heap<T, Comparator>::push(const T& x) {
+	assert(!full());
+	if(m_heapSize == heap_capacity || m_runsEnd + m_heapSize == maxsize) {
+		make_run();
+		if(m_runsEnd == maxsize) compact();
+	}
+	T * heap = m_items.get() + m_runsEnd;
+	heap[m_heapSize++] = x;
+	std::push_heap(heap, heap + m_heapSize, heap_comp(comp));
+	++m_size;
+}
+
+template<typename T, typename Comparator> template <typename IT>
+inline void pq_sequence_heap<T, Comparator>::push_range(IT begin, IT end) {
+	for(; begin != end; ++begin) push(*begin);
+}
+
+template<typename T, typename Comparator>
+inline bool pq_sequence_heap<T, Comparator>::top_in_heap() const {
+	if(m_heapSize == 0) return false;
+	if(m_tree.empty()) return true;
+	return comp(m_items[m_runsEnd], m_tree.top());
+}
+
+template<typename T, typename Comparator>
+inline void pq_sequence_heap<T, Comparator>::pop() {
+	assert(!empty());
+	if(top_in_heap()) {
+		T * heap = m_items.get() + m_runsEnd;
+		std::pop_heap(heap, heap + m_heapSize, heap_comp(comp));
+		--m_heapSize;
+	} else {
+		run & r = m_runs[m_tree.top_index()];
+		++r.begin;
+		if(r.begin < r.end)
+			m_tree.pop_and_push(m_items[r.begin]);
+		else
+			m_tree.pop();
+	}
+	--m_size;
+}
+
+template<typename T, typename Comparator>
+inline const T& pq_sequence_heap<T, Comparator>::top() {
+	assert(!empty());
+	if(top_in_heap()) return m_items[m_runsEnd];
+	return m_tree.top();
+}
+
+template<typename T, typename Comparator>
+inline stream_size_type pq_sequence_heap<T, Comparator>::size() const {
+	return m_size;
+}
+
+template<typename T, typename Comparator>
+inline bool pq_sequence_heap<T, Comparator>::full() const {
+	return m_size == maxsize;
+}
+
+template<typename T, typename Comparator>
+inline bool pq_sequence_heap<T, Comparator>::empty() const {
+	return m_size == 0;
+}
+
+template<typename T, typename Comparator>
+T* pq_sequence_heap<T, Comparator>::sorted_array() {
+	make_run();
+	compact();
+	if(m_runCount > 1) merge_last_runs(m_runCount);
+	rebuild_tree();
+	return m_items.get();
+}
+
+template<typename T, typename Comparator>
+inline memory_size_type pq_sequence_heap<T, Comparator>::sorted_size() const {
+	return maxsize;
+}
+
+template<typename T, typename Comparator>
+inline void pq_sequence_heap<T, Comparator>::sorted_pop() {
+	m_size = 0;
+	m_heapSize = 0;
+	m_runsEnd = 0;
+	m_runCount = 0;
+	m_tree.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Sort the heap into a new run. When the last merge_fanout runs have about
+/// the same length, merge them, such that there are at most merge_fanout-1
+/// runs of each length class.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Comparator>
+void pq_sequence_heap<T, Comparator>::make_run() {
+	if(m_heapSize > 0) {
+		std::sort(m_items.get() + m_runsEnd, m_items.get() + m_runsEnd + m_heapSize, comp);
+		m_runs[m_runCount].begin = m_runsEnd;
+		m_runs[m_runCount].end = m_runsEnd + m_heapSize;
+		++m_runCount;
+		m_runsEnd += m_heapSize;
+		m_heapSize = 0;
+	}
+	remove_empty_runs();
+	while(m_runCount >= merge_fanout
+		  && m_runs[m_runCount-merge_fanout].size() <= 2*m_runs[m_runCount-1].size()) {
+		merge_last_runs(merge_fanout);
+	}
+	if(m_runCount > max_runs) merge_last_runs(m_runCount - max_runs + 1);
+	rebuild_tree();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Merge the last n runs into one. The heap must be empty. The runs are
+/// merged into the free space at the end and copied back; without enough
+/// free space, they are sorted together instead.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Comparator>
+void pq_sequence_heap<T, Comparator>::merge_last_runs(memory_size_type n) {
+	assert(m_heapSize == 0);
+	assert(n >= 2 && n <= m_runCount);
+	const memory_size_type first = m_runCount - n;
+	memory_size_type total = 0;
+	for(memory_size_type i = first; i < m_runCount; ++i) total += m_runs[i].size();
+
+	T * items = m_items.get();
+	const memory_size_type begin = m_runs[first].begin;
+	if(maxsize - m_runsEnd >= total) {
+		T * out = items + m_runsEnd;
+		m_mergeTree.clear();
+		for(memory_size_type i = 0; i < n; ++i) {
+			const run & r = m_runs[first+i];
+			if(r.size() > 0) m_mergeTree.unsafe_set(i, items[r.begin]);
+		}
+		m_mergeTree.make_safe();
+		while(!m_mergeTree.empty()) {
+			*out++ = m_mergeTree.top();
+			run & r = m_runs[first + m_mergeTree.top_index()];
+			++r.begin;
+			if(r.begin < r.end)
+				m_mergeTree.pop_and_push(items[r.begin]);
+			else
+				m_mergeTree.pop();
+		}
+		std::copy(items + m_runsEnd, items + m_runsEnd + total, items + begin);
+	} else {
+		memory_size_type write = begin;
+		for(memory_size_type i = first; i < m_runCount; ++i) {
+			const run & r = m_runs[i];
+			if(r.begin != write) std::copy(items + r.begin, items + r.end, items + write);
+			write += r.size();
+		}
+		std::sort(items + begin, items + begin + total, comp);
+	}
+	m_runs[first].begin = begin;
+	m_runs[first].end = begin + total;
+	m_runCount = first + 1;
+	m_runsEnd = begin + total;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Drop exhausted runs from the run list. The space after the last nonempty
+/// run is free.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Comparator>
+void pq_sequence_heap<T, Comparator>::remove_empty_runs() {
+	assert(m_heapSize == 0);
+	memory_size_type j = 0;
+	for(memory_size_type i = 0; i < m_runCount; ++i) {
+		if(m_runs[i].size() > 0) m_runs[j++] = m_runs[i];
+	}
+	m_runCount = j;
+	m_runsEnd = (m_runCount > 0) ? m_runs[m_runCount-1].end : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Move the runs to the beginning of the array, reclaiming the space of the
+/// elements popped from their fronts. The heap must be empty.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Comparator>
+void pq_sequence_heap<T, Comparator>::compact() {
+	remove_empty_runs();
+	memory_size_type write = 0;
+	for(memory_size_type i = 0; i < m_runCount; ++i) {
+		run & r = m_runs[i];
+		const memory_size_type n = r.size();
+		if(r.begin != write)
+			std::copy(m_items.get() + r.begin, m_items.get() + r.end, m_items.get() + write);
+		r.begin = write;
+		r.end = write + n;
+		write += n;
+	}
+	m_runsEnd = write;
+	rebuild_tree();
+}
+
+template<typename T, typename Comparator>
+void pq_sequence_heap<T, Comparator>::rebuild_tree() {
+	m_tree.clear();
+	for(memory_size_type i = 0; i < m_runCount; ++i) {
+		if(m_runs[i].size() > 0) m_tree.unsafe_set(i, m_items[m_runs[i].begin]);
+	}
+	m_tree.make_safe();
+}
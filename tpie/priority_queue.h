@@ -30,6 +30,7 @@
 #include "tpie_log.h"
 #include <cassert>
 #include "pq_overflow_heap.h"
+#include "pq_sequence_heap.h"
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
@@ -71,6 +72,11 @@ namespace tpie {
 /// However, even with as little as 8 MB of memory, this maximum capacity in
 /// practice exceeds 2**48, corresponding to a petabyte-sized dataset of 32-bit
 /// integers.
+///
+/// The insertion buffer is given by OPQType. The default, pq_overflow_heap,
+/// is a binary heap of setting_m elements. pq_sequence_heap keeps only a
+/// small heap and merges it into sorted runs, which is more cache efficient
+/// when setting_m elements exceed the cache.
 ///////////////////////////////////////////////////////////////////////////////
 
 template<typename T, typename Comparator = std::less<T>, typename OPQType = pq_overflow_heap<T, Comparator> >
@@ -156,6 +162,39 @@ public:
     /////////////////////////////////////////////////////////
     template <typename F> F pop_equals(F f);
 
+    /////////////////////////////////////////////////////////
+    ///
+    /// Insert the elements of the range [begin, end) into the
+    /// priority queue.
+    ///
+    /// The insertion buffer is filled a chunk at a time rather
+    /// than an element at a time, and it is flushed to group 0
+    /// only when it is full.
+    ///
+    /// \param begin Iterator to the first element
+    /// \param end Iterator past the last element
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename IT> void push_batch(IT begin, IT end);
+
+    /////////////////////////////////////////////////////////
+    ///
+    /// Remove up to n elements from the top of the priority
+    /// queue, and write them to out in ascending order.
+    ///
+    /// Runs of elements from the deletion buffer are copied
+    /// out at once.
+    ///
+    /// \param out Output iterator receiving the elements
+    /// \param n Maximum number of elements to remove
+    ///
+    /// \return The number of elements removed, which is less
+    /// than n only if the queue became empty
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename OutputIterator>
+    memory_size_type pop_batch(OutputIterator out, memory_size_type n);
+
 private:
     Comparator comp_;
     T dummy;
@@ -206,6 +245,8 @@ private:
 
 	void init(memory_size_type mm_avail);
 
+    void flush_overflow_heap();
+
     void             slot_start_set(slot_type slot, memory_size_type n);
     memory_size_type slot_start(slot_type slot) const;
     void             slot_size_set(slot_type slot, memory_size_type n);
@@ -213,78 +213,79 @@ priority_queue<T, Comparator, OPQType>::~priority_queue() { // destructor
 }
 
 template <typename T, typename Comparator, typename OPQType>
-void priority_queue<T, Comparator, OPQType>::push(const T& x) {
-
-	if(opq->full()) {
-		// When the overflow priority queue (aka. insertion buffer) is full,
-		// insert its contents into a new slot in group 0.
-		//
-		// To maintain the heap invariant
-		//     deletion buffer <= group buffer 0 <= group 0 slots
-		// we bubble lesser elements from insertion buffer down into
-		// deletion buffer and group buffer 0.
+void priority_queue<T, Comparator, OPQType>::flush_overflow_heap() {
+	// When the overflow priority queue (aka. insertion buffer) is full,
+	// insert its contents into a new slot in group 0.
+	//
+	// To maintain the heap invariant
+	//     deletion buffer <= group buffer 0 <= group 0 slots
+	// we bubble lesser elements from insertion buffer down into
+	// deletion buffer and group buffer 0.
 
-		slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
-		                               // by merging it into a slot in group i+1)
+	slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
+	                               // by merging it into a slot in group i+1)
 
-		assert(opq->sorted_size() == setting_m);
-		T* arr = opq->sorted_array();
+	assert(opq->sorted_size() == setting_m);
+	T* arr = opq->sorted_array();
 
-		// Bubble lesser elements down into deletion buffer
-		if(buffer_size > 0) {
+	// Bubble lesser elements down into deletion buffer
+	if(buffer_size > 0) {
 
-			// fetch insertion buffer
-			memcpy(&mergebuffer[0], &arr[0], sizeof(T)*opq->sorted_size());
+		// fetch insertion buffer
+		memcpy(&mergebuffer[0], &arr[0], sizeof(T)*opq->sorted_size());
 
-			// fetch deletion buffer
-			memcpy(&mergebuffer[opq->sorted_size()], &buffer[buffer_start], sizeof(T)*buffer_size);
+		// fetch deletion buffer
+		memcpy(&mergebuffer[opq->sorted_size()], &buffer[buffer_start], sizeof(T)*buffer_size);
 
-			// sort buffer elements
-			std::sort(mergebuffer.get(), mergebuffer.get()+(buffer_size+opq->sorted_size()), comp_);
+		// sort buffer elements
+		std::sort(mergebuffer.get(), mergebuffer.get()+(buffer_size+opq->sorted_size()), comp_);
 
-			// smaller elements go in deletion buffer
-			memcpy(buffer.get()+buffer_start, mergebuffer.get(), sizeof(T)*buffer_size);
+		// smaller elements go in deletion buffer
+		memcpy(buffer.get()+buffer_start, mergebuffer.get(), sizeof(T)*buffer_size);
 
-			// larger elements go in insertion buffer
-			memcpy(&arr[0], mergebuffer.get()+buffer_size, sizeof(T)*opq->sorted_size());
-		}
+		// larger elements go in insertion buffer
+		memcpy(&arr[0], mergebuffer.get()+buffer_size, sizeof(T)*opq->sorted_size());
+	}
 
-		// Bubble lesser elements down into group buffer 0
-		if(group_size(0)> 0) {
+	// Bubble lesser elements down into group buffer 0
+	if(group_size(0)> 0) {
 
-			// Merge insertion buffer and group buffer 0
-			assert(group_size(0)+opq->sorted_size() <= setting_m*2);
-			memory_size_type j = 0;
+		// Merge insertion buffer and group buffer 0
+		assert(group_size(0)+opq->sorted_size() <= setting_m*2);
+		memory_size_type j = 0;
 
-			// fetch gbuffer0
-			for(stream_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
-				mergebuffer[j] = gbuffer0[static_cast<memory_size_type>(i%setting_m)];
-				++j;
-			}
+		// fetch gbuffer0
+		for(stream_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
+			mergebuffer[j] = gbuffer0[static_cast<memory_size_type>(i%setting_m)];
+			++j;
+		}
 
-			// fetch insertion buffer
-			memcpy(&mergebuffer[j], &arr[0], sizeof(T)*opq->sorted_size());
+		// fetch insertion buffer
+		memcpy(&mergebuffer[j], &arr[0], sizeof(T)*opq->sorted_size());
 
-			// sort
-			std::sort(mergebuffer.get(), mergebuffer.get()+(group_size(0)+opq->sorted_size()), comp_);
+		// sort
+		std::sort(mergebuffer.get(), mergebuffer.get()+(group_size(0)+opq->sorted_size()), comp_);
 
-			// smaller elements go in gbuffer0
-			memcpy(gbuffer0.get(), mergebuffer.get(), static_cast<size_t>(sizeof(T)*group_size(0)));
-			group_start_set(0,0);
+		// smaller elements go in gbuffer0
+		memcpy(gbuffer0.get(), mergebuffer.get(), static_cast<size_t>(sizeof(T)*group_size(0)));
+		group_start_set(0,0);
 
-			// larger elements go in insertion buffer (actually a free group 0 slot)
-			memcpy(&arr[0], &mergebuffer[group_size(0)], sizeof(T)*opq->sorted_size());
-		}
+		// larger elements go in insertion buffer (actually a free group 0 slot)
+		memcpy(&arr[0], &mergebuffer[group_size(0)], sizeof(T)*opq->sorted_size());
+	}
 
-		// move insertion buffer (which has elements larger than all of
-		// gbuffer0 and deletion buffer) into a free group 0 slot
+	// move insertion buffer (which has elements larger than all of
+	// gbuffer0 and deletion buffer) into a free group 0 slot
 
-		write_slot(slot, arr, opq->sorted_size());
-		opq->sorted_pop();
+	write_slot(slot, arr, opq->sorted_size());
+	opq->sorted_pop();
 
-		// insertion buffer is now empty
+	// insertion buffer is now empty
+}
 
-	}
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::push(const T& x) {
+	if(opq->full()) flush_overflow_heap();
 
 	// insertion buffer is non-full. insert element.
 	opq->push(x);
@@ -374,6 +375,74 @@ F priority_queue<T, Comparator, OPQType>::pop_equals(F f) {
 	return f;
 }
 
+template <typename T, typename Comparator, typename OPQType> template <typename IT>
+void priority_queue<T, Comparator, OPQType>::push_batch(IT begin, IT end) {
+	memory_size_type remaining = static_cast<memory_size_type>(std::distance(begin, end));
+	while(remaining > 0) {
+		if(opq->full()) flush_overflow_heap();
+
+		// Fill the insertion buffer in one go; it is heapified once.
+		memory_size_type n = std::min(remaining, setting_m - static_cast<memory_size_type>(opq->size()));
+		IT chunkEnd = begin;
+		std::advance(chunkEnd, n);
+		opq->push_range(begin, chunkEnd);
+		begin = chunkEnd;
+		remaining -= n;
+		m_size += n;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+}
+
+template <typename T, typename Comparator, typename OPQType> template <typename OutputIterator>
+memory_size_type priority_queue<T, Comparator, OPQType>::pop_batch(OutputIterator out, memory_size_type n) {
+	memory_size_type popped = 0;
+	while(popped < n && !empty()) {
+		// If the deletion buffer is empty, refill it with elements from the group buffers
+		if(buffer_size == 0 && opq->size() != m_size) {
+			fill_buffer();
+		}
+
+		if(buffer_size == 0) {
+			// Only the insertion buffer has elements
+			*out = opq->top(); ++out;
+			opq->pop();
+			++popped;
+			--m_size;
+			continue;
+		}
+
+		// Take elements from the deletion buffer while they are less than the
+		// top of the insertion buffer, which does not change meanwhile.
+		memory_size_type k = 0;
+		memory_size_type limit = std::min(buffer_size, n - popped);
+		if(opq->size() == 0) {
+			k = limit;
+		} else {
+			const T & opqTop = opq->top();
+			while(k < limit && comp_(buffer[buffer_start+k], opqTop)) ++k; // compare
+		}
+		if(k == 0) {
+			*out = opq->top(); ++out;
+			opq->pop();
+			++popped;
+			--m_size;
+			continue;
+		}
+		out = std::copy(buffer.get()+buffer_start, buffer.get()+buffer_start+k, out);
+		buffer_start += k;
+		buffer_size -= k;
+		if(buffer_size == 0) buffer_start = 0;
+		popped += k;
+		m_size -= k;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+	return popped;
+}
+
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::dump() {
 	TP_LOG_DEBUG( "--------------------------------------------------------------" << "\n"
@@ -36,6 +36,11 @@ namespace tpie {
 
 ///////////////////////////////////////////////////////////////////
 /// \brief Basic Implementation of I/O Efficient FIFO queue
+///
+/// All items are written to one file, which is not shrunk as items are
+/// popped. For temporary queues that are pushed and popped a lot, use
+/// buffered_queue, which keeps short queues in memory and releases
+/// consumed disk space.
 /// \author The TPIE Project
 ///////////////////////////////////////////////////////////////////
 template<class T>
@@ -0,0 +1,264 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2013, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_RADIX_SORT_H__
+#define __TPIE_RADIX_SORT_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file radix_sort.h
+/// \brief In-place MSD radix sort on integer keys.
+///
+/// Sorts given a key functor rather than a predicate are requested by
+/// wrapping the key functor in by_key(). The resulting key_less predicate
+/// can be passed anywhere a predicate is expected, for instance to
+/// pipelining::pipesort() or tpie::sort(), and the run formation of those
+/// sorts then uses radix_sort() instead of a comparison sort.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/config.h>
+#include <tpie/types.h>
+#include <tpie/array.h>
+#include <tpie/job.h>
+#include <algorithm>
+#include <boost/iterator/iterator_traits.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+#include <boost/static_assert.hpp>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Predicate ordering items by an integer key.
+///
+/// \tparam key_fn_t Unary functor extracting the key of an item. Its
+/// result_type must be a (possibly cv-qualified reference to an) integral
+/// type, as with std::unary_function.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_fn_t>
+class key_less {
+public:
+	typedef typename boost::remove_cv<
+		typename boost::remove_reference<typename key_fn_t::result_type>::type
+		>::type key_type;
+
+	BOOST_STATIC_ASSERT(boost::is_integral<key_type>::value);
+
+	key_less(const key_fn_t & keyFn = key_fn_t()) : m_keyFn(keyFn) {}
+
+	template <typename T>
+	bool operator()(const T & a, const T & b) const {
+		return m_keyFn(a) < m_keyFn(b);
+	}
+
+	const key_fn_t & key_fn() const {
+		return m_keyFn;
+	}
+
+private:
+	key_fn_t m_keyFn;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Order items by the integer key extracted by the given functor.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_fn_t>
+key_less<key_fn_t> by_key(const key_fn_t & keyFn) {
+	return key_less<key_fn_t>(keyFn);
+}
+
+namespace bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Map keys to unsigned integers of the same width such that the
+/// order is preserved.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_type, bool Signed = boost::is_signed<key_type>::value>
+struct radix_key {
+	typedef typename boost::make_unsigned<key_type>::type type;
+	static type get(key_type k) {
+		return static_cast<type>(k);
+	}
+};
+
+template <typename key_type>
+struct radix_key<key_type, true> {
+	typedef typename boost::make_unsigned<key_type>::type type;
+	static type get(key_type k) {
+		// Flip the sign bit so negative keys come first.
+		return static_cast<type>(k) ^ (static_cast<type>(1) << (sizeof(type) * 8 - 1));
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief In-place MSD radix sort (American flag sort) on 8-bit digits.
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_fn_t>
+class radix_sort_impl {
+	typedef typename boost::iterator_value<iterator_type>::type value_type;
+	typedef key_less<key_fn_t> pred_t;
+	typedef radix_key<typename pred_t::key_type> rkey;
+	typedef typename rkey::type ukey_type;
+
+	static const size_t buckets = 256;
+	static const int top_shift = static_cast<int>(sizeof(ukey_type) - 1) * 8;
+
+	// Ranges shorter than this are sorted by std::sort.
+	static const size_t small_range = 64;
+
+	// Ranges at least this long have their buckets sorted by separate jobs.
+	static const size_t parallel_min_size = 1024*1024;
+
+public:
+	radix_sort_impl(const pred_t & pred) : m_pred(pred) {}
+
+	void operator()(iterator_type a, iterator_type b) {
+#ifdef TPIE_PARALLEL_SORT
+		if (static_cast<size_t>(b - a) >= parallel_min_size && default_worker_count() > 1) {
+			sort_parallel(a, b);
+			return;
+		}
+#endif
+		sort(a, b, top_shift);
+	}
+
+private:
+	size_t digit(const value_type & x, int shift) const {
+		return static_cast<size_t>((rkey::get(m_pred.key_fn()(x)) >> shift) & (buckets - 1));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Permute [a,b) into buckets by the digit at the given shift.
+	///
+	/// \param starts Receives the bucket boundaries; bucket i is
+	/// [a+starts[i], a+starts[i+1]).
+	/// \returns False if all items are in the same bucket, in which case the
+	/// range is left untouched.
+	///////////////////////////////////////////////////////////////////////////
+	bool distribute(iterator_type a, iterator_type b, int shift, size_t * starts) const {
+		size_t counts[buckets] = {0};
+		for (iterator_type i = a; i != b; ++i) ++counts[digit(*i, shift)];
+
+		starts[0] = 0;
+		for (size_t d = 0; d < buckets; ++d) {
+			if (counts[d] == static_cast<size_t>(b - a)) return false;
+			starts[d+1] = starts[d] + counts[d];
+		}
+
+		size_t heads[buckets];
+		std::copy(starts, starts + buckets, heads);
+		for (size_t d = 0; d < buckets; ++d) {
+			while (heads[d] < starts[d+1]) {
+				value_type x = *(a + heads[d]);
+				size_t e = digit(x, shift);
+				while (e != d) {
+					std::swap(x, *(a + heads[e]++));
+					e = digit(x, shift);
+				}
+				*(a + heads[d]++) = x;
+			}
+		}
+		return true;
+	}
+
+	void sort(iterator_type a, iterator_type b, int shift) const {
+		while (true) {
+			if (static_cast<size_t>(b - a) < small_range) {
+				std::sort(a, b, m_pred);
+				return;
+			}
+			size_t starts[buckets+1];
+			if (distribute(a, b, shift, starts)) {
+				if (shift == 0) return;
+				for (size_t d = 0; d < buckets; ++d)
+					sort(a + starts[d], a + starts[d+1], shift - 8);
+				return;
+			}
+			// All items share this digit; skip it.
+			if (shift == 0) return;
+			shift -= 8;
+		}
+	}
+
+	class bucket_job : public job {
+	public:
+		void set(const radix_sort_impl * sorter, iterator_type a, iterator_type b, int shift) {
+			m_sorter = sorter;
+			m_a = a;
+			m_b = b;
+			m_shift = shift;
+		}
+
+		virtual void operator()() {
+			m_sorter->sort(m_a, m_b, m_shift);
+		}
+
+	private:
+		const radix_sort_impl * m_sorter;
+		iterator_type m_a;
+		iterator_type m_b;
+		int m_shift;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Distribute the top digit sequentially, and sort the buckets
+	/// on the job pool.
+	///////////////////////////////////////////////////////////////////////////
+	void sort_parallel(iterator_type a, iterator_type b) const {
+		int shift = top_shift;
+		size_t starts[buckets+1];
+		while (!distribute(a, b, shift, starts)) {
+			if (shift == 0) return;
+			shift -= 8;
+		}
+		if (shift == 0) return;
+		array<bucket_job> jobs(buckets);
+		for (size_t d = 0; d < buckets; ++d) {
+			if (starts[d] == starts[d+1]) continue;
+			jobs[d].set(this, a + starts[d], a + starts[d+1], shift - 8);
+			jobs[d].enqueue();
+		}
+		for (size_t d = 0; d < buckets; ++d) {
+			if (starts[d] == starts[d+1]) continue;
+			jobs[d].join();
+		}
+	}
+
+	pred_t m_pred;
+};
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort the items in [a,b) by the integer key given by pred.
+///
+/// The sort is in-place and not stable. When TPIE_PARALLEL_SORT is defined,
+/// the buckets of large ranges are sorted in parallel on the job pool.
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_fn_t>
+void radix_sort(iterator_type a, iterator_type b, const key_less<key_fn_t> & pred) {
+	bits::radix_sort_impl<iterator_type, key_fn_t> s(pred);
+	s(a, b);
+}
+
+} // namespace tpie
+
+#endif // __TPIE_RADIX_SORT_H__
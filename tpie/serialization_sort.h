@@ -21,10 +21,12 @@
 #define TPIE_SERIALIZATION_SORT_H
 
 #include <queue>
+#include <string>
 #include <boost/filesystem.hpp>
 
 #include <tpie/array.h>
 #include <tpie/array_view.h>
+#include <tpie/loser_tree.h>
 #include <tpie/tempname.h>
 #include <tpie/tpie_log.h>
 #include <tpie/stats.h>
@@ -35,8 +37,168 @@
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Less-than predicate on strings that provides key prefixes to
+/// serialization_sort.
+///
+/// A predicate provides key prefixes by defining prefix_type and a member
+/// function prefix(item), such that items with different prefixes are
+/// ordered by their prefixes. serialization_sort then stores the prefix of
+/// each item next to it and compares the items only when the prefixes are
+/// equal. Here, the prefix is the first eight characters of the string.
+///////////////////////////////////////////////////////////////////////////////
+struct string_prefix_less {
+	typedef boost::uint64_t prefix_type;
+
+	bool operator()(const std::string & a, const std::string & b) const {
+		return a < b;
+	}
+
+	prefix_type prefix(const std::string & s) const {
+		prefix_type p = 0;
+		for (size_t i = 0; i < sizeof(prefix_type); ++i) {
+			p <<= 8;
+			if (i < s.size()) p |= static_cast<unsigned char>(s[i]);
+		}
+		return p;
+	}
+};
+
 namespace serialization_bits {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Checks if a predicate provides key prefixes.
+///////////////////////////////////////////////////////////////////////////////
+template <typename pred_t>
+class has_prefix {
+	template <typename P>
+	static char magic(typename P::prefix_type *);
+	template <typename P>
+	static long magic(...);
+public:
+	static bool const value = sizeof(magic<pred_t>(0)) == sizeof(char);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Item handling for predicates without key prefixes.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t, bool Prefix = has_prefix<pred_t>::value>
+struct prefix_traits {
+	/** Type stored alongside each item during run formation. Unused. */
+	typedef char key_type;
+	/** Extra bytes per item during run formation. */
+	static const memory_size_type key_size = 0;
+	/** Type of items in the merger. */
+	typedef T merge_item_type;
+	/** Predicate on merge_item_type. */
+	typedef pred_t merge_pred_type;
+
+	static void set_key(array<key_type> &, memory_size_type, const pred_t &, const T &) {
+	}
+
+	static void sort(array<T> & items, array<key_type> &, memory_size_type n, const pred_t & pred) {
+		parallel_sort(items.get(), items.get() + n, pred);
+	}
+
+	static merge_item_type make_merge_item(const pred_t &, const T & item) {
+		return item;
+	}
+
+	static const T & get_item(const merge_item_type & item) {
+		return item;
+	}
+
+	static merge_pred_type merge_pred(const pred_t & pred) {
+		return pred;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Item handling for predicates with key prefixes.
+///
+/// During run formation, the prefix of each item is stored with its index
+/// in a separate array, which is sorted instead of the items. Only when two
+/// prefixes are equal are the items themselves compared. The items are then
+/// permuted into sorted order. In the merger, the prefix is kept next to
+/// each item.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t>
+struct prefix_traits<T, pred_t, true> {
+	typedef typename pred_t::prefix_type prefix_type;
+	typedef std::pair<prefix_type, memory_size_type> key_type;
+	static const memory_size_type key_size = sizeof(key_type);
+
+	struct merge_item_type {
+		prefix_type prefix;
+		T item;
+	};
+
+	class merge_pred_type {
+	public:
+		merge_pred_type(const pred_t & pred) : m_pred(pred) {}
+
+		bool operator()(const merge_item_type & a, const merge_item_type & b) const {
+			if (a.prefix < b.prefix) return true;
+			if (b.prefix < a.prefix) return false;
+			return m_pred(a.item, b.item);
+		}
+
+	private:
+		pred_t m_pred;
+	};
+
+	class key_pred {
+	public:
+		key_pred(const T * items, const pred_t & pred) : m_items(items), m_pred(pred) {}
+
+		bool operator()(const key_type & a, const key_type & b) const {
+			if (a.first < b.first) return true;
+			if (b.first < a.first) return false;
+			return m_pred(m_items[a.second], m_items[b.second]);
+		}
+
+	private:
+		const T * m_items;
+		pred_t m_pred;
+	};
+
+	static void set_key(array<key_type> & keys, memory_size_type i, const pred_t & pred, const T & item) {
+		keys[i] = key_type(pred.prefix(item), i);
+	}
+
+	static void sort(array<T> & items, array<key_type> & keys, memory_size_type n, const pred_t & pred) {
+		parallel_sort(keys.get(), keys.get() + n, key_pred(items.get(), pred));
+
+		// Position i receives the item at position keys[i].second. Follow each
+		// cycle of the permutation, marking the positions that are done.
+		for (memory_size_type i = 0; i < n; ++i) {
+			memory_size_type j = i;
+			while (keys[j].second != i) {
+				memory_size_type k = keys[j].second;
+				std::swap(items[j], items[k]);
+				keys[j].second = j;
+				j = k;
+			}
+			keys[j].second = j;
+		}
+	}
+
+	static merge_item_type make_merge_item(const pred_t & pred, const T & item) {
+		merge_item_type res;
+		res.prefix = pred.prefix(item);
+		res.item = item;
+		return res;
+	}
+
+	static const T & get_item(const merge_item_type & item) {
+		return item.item;
+	}
+
+	static merge_pred_type merge_pred(const pred_t & pred) {
+		return merge_pred_type(pred);
+	}
+};
+
 struct sort_parameters {
 	/** Memory available while forming sorted runs. */
 	memory_size_type memoryPhase1;
@@ -61,7 +223,11 @@ struct sort_parameters {
 
 template <typename T, typename pred_t>
 class internal_sort {
+	typedef prefix_traits<T, pred_t> traits;
+	typedef typename traits::key_type key_type;
+
 	array<T> m_buffer;
+	array<key_type> m_keys;
 	memory_size_type m_items;
 	memory_size_type m_serializedSize;
 	memory_size_type m_memAvail;
@@ -83,7 +249,8 @@ public:
 	}
 
 	void begin(memory_size_type memAvail) {
-		m_buffer.resize(memAvail / sizeof(T) / 2);
+		m_buffer.resize(memAvail / (sizeof(T) + traits::key_size) / 2);
+		if (traits::key_size > 0) m_keys.resize(m_buffer.size());
 		m_items = m_serializedSize = 0;
 		m_largestItem = sizeof(T);
 		m_full = false;
@@ -124,6 +291,7 @@ public:
 
 		m_serializedSize += serSize;
 
+		traits::set_key(m_keys, m_items, m_pred, item);
 		m_buffer[m_items++] = item;
 
 		return true;
@@ -155,6 +323,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	memory_size_type memory_usage() {
 		return m_buffer.size() * sizeof(T)
+			+ m_keys.size() * sizeof(key_type)
 			+ (m_serializedSize - m_items * sizeof(T));
 	}
 
@@ -165,10 +334,11 @@ public:
 	void shrink_buffer() {
 		array<T> newBuffer(array_view<const T>(begin(), end()));
 		m_buffer.swap(newBuffer);
+		m_keys.resize(0);
 	}
 
 	void sort() {
-		parallel_sort(m_buffer.get(), m_buffer.get() + m_items, m_pred);
+		traits::sort(m_buffer, m_keys, m_items, m_pred);
 	}
 
 	const T * begin() const {
@@ -184,6 +354,7 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void free() {
 		m_buffer.resize(0);
+		m_keys.resize(0);
 		reset();
 	}
 
@@ -402,72 +573,53 @@ private:
 
 template <typename T, typename pred_t>
 class merger {
-	class mergepred_t {
-		pred_t m_pred;
-
-	public:
-		typedef std::pair<T, size_t> item_type;
-
-		mergepred_t(const pred_t & pred) : m_pred(pred) {}
-
-		// Used with std::priority_queue, so invert the original relation.
-		bool operator()(const item_type & a, const item_type & b) const {
-			return m_pred(b.first, a.first);
-		}
-	};
-
-	typedef typename mergepred_t::item_type item_type;
+	typedef prefix_traits<T, pred_t> traits;
 
 	file_handler<T> & files;
 	pred_t pred;
 	std::vector<serialization_reader> rd;
-	typedef std::priority_queue<item_type, std::vector<item_type>, mergepred_t> priority_queue_type;
-	priority_queue_type pq;
+	loser_tree<typename traits::merge_item_type, typename traits::merge_pred_type> lt;
 
 public:
 	merger(file_handler<T> & files, const pred_t & pred)
 		: files(files)
 		, pred(pred)
-		, pq(mergepred_t(pred))
+		, lt(0, traits::merge_pred(pred))
 	{
 	}
 
 	// Assume files.open_readers(fanout) has just been called
 	void init(size_t fanout) {
 		rd.resize(fanout);
-		for (size_t i = 0; i < fanout; ++i)
-			push_from(i);
+		lt.resize(fanout);
+		for (size_t i = 0; i < fanout; ++i) {
+			if (files.can_read(i))
+				lt.unsafe_set(i, traits::make_merge_item(pred, files.read(i)));
+		}
+		lt.make_safe();
 	}
 
 	bool empty() const {
-		return pq.empty();
+		return lt.empty();
 	}
 
 	const T & top() const {
-		return pq.top().first;
+		return traits::get_item(lt.top());
 	}
 
 	void pop() {
-		size_t idx = pq.top().second;
-		pq.pop();
-		push_from(idx);
+		size_t idx = lt.top_index();
+		if (files.can_read(idx))
+			lt.pop_and_push(traits::make_merge_item(pred, files.read(idx)));
+		else
+			lt.pop();
 	}
 
 	// files.close_readers_and_delete() should be called after this
 	void free() {
-		{
-			priority_queue_type tmp(pred);
-			std::swap(pq, tmp);
-		}
+		lt.resize(0);
 		rd.resize(0);
 	}
-
-private:
-	void push_from(size_t idx) {
-		if (files.can_read(idx)) {
-			pq.push(std::make_pair(files.read(idx), idx));
-		}
-	}
 };
 
 } // namespace serialization_bits
@@ -606,7 +758,8 @@ private:
 		memory_size_type fanoutMemory = memForMerge - serialization_writer::memory_usage();
 
 		// This is a lower bound on the memory used per fanout.
-		memory_size_type perFanout = m_params.minimumItemSize + serialization_reader::memory_usage();
+		memory_size_type perFanout = m_params.minimumItemSize + serialization_reader::memory_usage()
+			+ serialization_bits::prefix_traits<T, pred_t>::key_size;
 
 		// Floored division to compute the largest possible fanout.
 		memory_size_type fanout = fanoutMemory / perFanout;
@@ -759,7 +912,8 @@ public:
 		// Perform almost the same computation as in calculate_parameters.
 		// Only change the item size to largestItem rather than minimumItemSize.
 		memory_size_type fanoutMemory = m_params.memoryPhase2 - serialization_writer::memory_usage();
-		memory_size_type perFanout = largestItem + serialization_reader::memory_usage();
+		memory_size_type perFanout = largestItem + serialization_reader::memory_usage()
+			+ serialization_bits::prefix_traits<T, pred_t>::key_size;
 		memory_size_type fanout = fanoutMemory / perFanout;
 
 		if (fanout < 2) {
@@ -54,14 +54,17 @@ namespace tpie {
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Sort elements of a stream using the given STL-style comparator
 /// object.
+///
+/// To sort by an integer key, pass by_key(key_fn) as the comparator. Runs are
+/// then formed using radix_sort.
 ///////////////////////////////////////////////////////////////////////////////
 template<typename T, typename Compare>
 void sort(file_stream<T> &instream, file_stream<T> &outstream,
 		  Compare comp, progress_indicator_base & indicator) {
 
 	ami::Internal_Sorter_Obj<T,Compare> myInternalSorter(comp);
-	ami::merge_heap_obj<T,Compare>      myMergeHeap(comp);
-	sort_manager< T, ami::Internal_Sorter_Obj<T,Compare>, ami::merge_heap_obj<T,Compare> > 
+	ami::merge_loser_tree_obj<T,Compare> myMergeHeap(comp);
+	sort_manager< T, ami::Internal_Sorter_Obj<T,Compare>, ami::merge_loser_tree_obj<T,Compare> > 
 	mySortManager(&myInternalSorter, &myMergeHeap);
 
 	mySortManager.sort(&instream, &outstream, &indicator);
@@ -725,7 +725,7 @@ void sort_manager<T,I,M>::merge_to_output(progress_indicator_base* indicator, tp
 		    // We account for these mmBytesPerStream in phase 2
 		    // (temp merge output stream)
 			file_stream<T> curOutputRunStream;
-			curOutputRunStream.open(temporaries[mrgArity*((mrgHeight+1)%2)+ii], access_write);
+			curOutputRunStream.open(temporaries[mrgArity*((mrgHeight+1)%2)+ii], access_write, 0, tempname::get_sequential_cache_hint());
 
 		    // How many runs should this stream get?
 		    // extra runs go in the LAST nXtraRuns streams so that
@@ -22,36 +22,61 @@
 
 #include <tpie/stats.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#undef NO_ERROR
+#endif
+
 namespace tpie {
-	
-	static stream_size_type temp_file_usage=0;
-	static stream_size_type bytes_read=0;
-	static stream_size_type bytes_written=0;
+
+namespace {
+
+	// Streams are read and written from job and I/O threads as well, so the
+	// counters are updated atomically.
+	volatile stream_size_type temp_file_usage=0;
+	volatile stream_size_type bytes_read=0;
+	volatile stream_size_type bytes_written=0;
+
+	inline void atomic_add(volatile stream_size_type & x, stream_size_type v) {
+#ifdef _WIN32
+		_InterlockedExchangeAdd64(reinterpret_cast<volatile __int64 *>(&x), static_cast<__int64>(v));
+#else
+		__sync_fetch_and_add(&x, v);
+#endif
+	}
+
+	inline stream_size_type atomic_read(volatile stream_size_type & x) {
+#ifdef _WIN32
+		return static_cast<stream_size_type>(
+			_InterlockedCompareExchange64(reinterpret_cast<volatile __int64 *>(&x), 0, 0));
+#else
+		return __sync_fetch_and_add(&x, 0);
+#endif
+	}
+
+} // unnamed namespace
 
 	stream_size_type get_temp_file_usage() {
-		return temp_file_usage;
+		return atomic_read(temp_file_usage);
 	}
 
 	void increment_temp_file_usage(stream_offset_type delta) {
-		stream_offset_type x=temp_file_usage+delta;
-		if (x < 0) temp_file_usage=0;
-		temp_file_usage=x;
+		atomic_add(temp_file_usage, static_cast<stream_size_type>(delta));
 	}
 
 	stream_size_type get_bytes_read() {
-		return bytes_read;
+		return atomic_read(bytes_read);
 	}
 
 	stream_size_type get_bytes_written() {
-		return bytes_written;
+		return atomic_read(bytes_written);
 	}
 
 	void increment_bytes_read(stream_size_type delta) {
-		bytes_read += delta;
+		atomic_add(bytes_read, delta);
 	}
 	
 	void increment_bytes_written(stream_size_type delta) {
-		bytes_written += delta;
+		atomic_add(bytes_written, delta);
 	}
 }  //  tpie namespace
-
@@ -25,12 +25,22 @@
 #define __TPIE_STREAM_HEADER_H__
 #include <tpie/util.h>
 #include <tpie/types.h>
+#include <cstddef>
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Header of a stream file.
+///
+/// Uncompressed streams are stored with version 3 headers, which end before
+/// the compression field, so files written before compression was added can
+/// still be read, and files written now can be read by older versions.
+/// Compressed streams are stored with version 4 headers.
+///////////////////////////////////////////////////////////////////////////////
 struct stream_header_t {
 	static const uint64_t magicConst = 0x521cbe927dd6056all;
-	static const uint64_t versionConst = 3;
+	static const uint64_t versionConst = 4;
+	static const uint64_t uncompressedVersionConst = 3;
 
 	uint64_t magic;
 	uint64_t version;
@@ -40,6 +50,19 @@ struct stream_header_t {
 	uint64_t maxUserDataSize;
 	uint64_t size;
 	uint64_t cleanClose;;
+
+	/** Identifier of the block codec (see compression_scheme). Only stored
+	 * in version 4 headers. */
+	uint64_t compression;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes the header occupies on disk in the given
+	/// version. User data follows the header.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type size_on_disk(uint64_t version) {
+		if (version == uncompressedVersionConst) return offsetof(stream_header_t, compression);
+		return sizeof(stream_header_t);
+	}
 };
 
 }
@@ -23,11 +23,13 @@
 #include <time.h>
 #include <cstring>
 #include <tpie/tempname.h>
+#include <tpie/compression.h>
 #include <tpie/tpie_log.h>
 #include <string>
 #include <tpie/portability.h>
 #include <boost/filesystem.hpp>
 #include <boost/random.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <stdexcept>
 #include <tpie/util.h>
@@ -47,6 +49,11 @@ namespace {
 std::string default_path;
 std::string default_base_name;
 std::string default_extension;
+bool direct_io = false;
+memory_size_type default_compression = compression_none;
+// Pipeline phases may run concurrently and create temporary files at the
+// same time, so the name generator state is only touched under this lock.
+boost::mutex mktemp_mutex;
 std::string tpie_mktemp();
 
 }
@@ -133,6 +140,7 @@ std::string tpie_mktemp()
 	"n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", 
 	"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
 	const int chars_count = 62;
+	boost::mutex::scoped_lock lock(mktemp_mutex);
 	static int counter = boost::posix_time::second_clock::local_time().time_of_day().total_seconds() % (chars_count * chars_count); 
 
 	std::string result = "";
@@ -201,6 +209,26 @@ const std::string& tempname::get_default_extension() {
 	return default_extension;
 }
 
+void tempname::set_direct_io(bool enabled) {
+	direct_io = enabled;
+}
+
+bool tempname::get_direct_io() {
+	return direct_io;
+}
+
+cache_hint tempname::get_sequential_cache_hint() {
+	return direct_io ? access_direct : access_sequential;
+}
+
+void tempname::set_default_compression(memory_size_type codec) {
+	default_compression = codec;
+}
+
+memory_size_type tempname::get_default_compression() {
+	return default_compression;
+}
+
 temp_file::temp_file(): m_persist(false), m_recordedSize(0) {}
 
 temp_file::temp_file(const std::string & path, bool persist): m_path(path), m_persist(persist), m_recordedSize(0) {}
@@ -27,6 +27,7 @@
 // Get definitions for working with Unix and Windows
 #include <tpie/portability.h>
 #include <tpie/stats.h>
+#include <tpie/cache_hint.h>
 #include <stdexcept>
 #include <boost/utility.hpp>
 // The name of the environment variable pointing to a tmp directory.
@@ -124,6 +125,39 @@ namespace tpie {
 		///////////////////////////////////////////////////////////////////////
 		static const std::string& get_default_extension();
 
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Enable or disable unbuffered I/O for temporary files that
+		/// are written once and read once, such as the runs of merge sorts.
+		/// Disabled by default.
+		/// \sa access_direct
+		///////////////////////////////////////////////////////////////////////
+		static void set_direct_io(bool enabled);
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Whether unbuffered I/O is enabled for temporary files.
+		/// \sa set_direct_io
+		///////////////////////////////////////////////////////////////////////
+		static bool get_direct_io();
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Cache hint to use when opening a temporary file that is
+		/// accessed sequentially: access_direct if \ref set_direct_io is
+		/// enabled and access_sequential otherwise.
+		///////////////////////////////////////////////////////////////////////
+		static cache_hint get_sequential_cache_hint();
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Set the block codec (see compression_scheme) used for
+		/// temporary streams that opt in to compression, such as the runs of
+		/// merge sorts. Defaults to compression_none.
+		///////////////////////////////////////////////////////////////////////
+		static void set_default_compression(memory_size_type codec);
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Get the block codec used for compressed temporary streams.
+		/// \sa set_default_compression
+		///////////////////////////////////////////////////////////////////////
+		static memory_size_type get_default_compression();
 
 		///////////////////////////////////////////////////////////////////////
 		/// Return The actual path used for temporary files taking environment
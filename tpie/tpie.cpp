@@ -24,6 +24,10 @@
 #include <tpie/prime.h>
 #include <tpie/memory.h>
 #include <tpie/job.h>
+#ifdef TPIE_HAVE_LINUX_IO_URING_H
+#include <tpie/file_accessor/file_accessor.h>
+#include <tpie/file_accessor/uring.h>
+#endif // TPIE_HAVE_LINUX_IO_URING_H
 
 namespace {
 static tpie::memory_size_type the_block_size=0;
@@ -32,8 +36,14 @@ static tpie::memory_size_type the_block_size=0;
 namespace tpie {
 
 void tpie_init(int subsystems) {
-	if (subsystems & MEMORY_MANAGER)	
-	 	init_memory_manager();
+	if (subsystems & MEMORY_MANAGER) {
+		init_memory_manager();
+#ifdef TPIE_USE_IO_URING
+		// Set up the ring of this thread now, so that it is not counted
+		// against the memory of the first stream to use it.
+		file_accessor::bits::uring_queue::get();
+#endif // TPIE_USE_IO_URING
+	}
 
 	if (subsystems & DEFAULT_LOGGING)
 		init_default_log();
@@ -68,8 +78,12 @@ void tpie_finish(int subsystems) {
 	if (subsystems & DEFAULT_LOGGING)
 		finish_default_log();
 
-	if (subsystems & MEMORY_MANAGER)	
-	 	finish_memory_manager();
+	if (subsystems & MEMORY_MANAGER) {
+#ifdef TPIE_HAVE_LINUX_IO_URING_H
+		file_accessor::bits::uring_queue::release();
+#endif // TPIE_HAVE_LINUX_IO_URING_H
+		finish_memory_manager();
+	}
 }
 
 memory_size_type get_block_size() {